@@ -1 +1 @@
-./build/doca_ar -a auxiliary:mlx5_core.sf.4 -a auxiliary:mlx5_core.sf.5 -l 1-3 -- -l 60
+./build/doca_ar -a auxiliary:mlx5_core.sf.4 -a auxiliary:mlx5_core.sf.5 -l 1-2 -- -l 60 --lb-scheme ecmp
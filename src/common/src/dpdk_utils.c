@@ -425,6 +425,9 @@ port_init(struct rte_mempool *mbuf_pool, uint8_t port, struct application_dpdk_c
                 port_conf.txmode.offloads |=
                         DEV_TX_OFFLOAD_IPV4_CKSUM | DEV_TX_OFFLOAD_UDP_CKSUM | DEV_TX_OFFLOAD_TCP_CKSUM;
 	}
+	/* rx timestamps let probe replies be timed by the NIC clock, they cost the datapath so only when asked for */
+	if (app_config->port_config.rx_timestamp && (dev_info.rx_offload_capa & DEV_RX_OFFLOAD_TIMESTAMP))
+		port_conf.rxmode.offloads |= DEV_RX_OFFLOAD_TIMESTAMP;
 
 #ifdef GPU_SUPPORT
 	if (app_config->pipe.gpu_support) {
@@ -493,7 +496,8 @@ port_init(struct rte_mempool *mbuf_pool, uint8_t port, struct application_dpdk_c
 
 	/* Set isolated mode (true or false) before port start */
 	ret = rte_flow_isolate(port, isolated, &error);
-	if (ret < 0) {
+	/* ports without rte_flow (e.g. net_ring, net_pcap) are never isolated */
+	if (ret < 0 && (isolated || (ret != -ENOSYS && ret != -ENOTSUP))) {
 		DOCA_LOG_ERR("Port %u could not be set isolated mode to %s (%s)",
 			     port, isolated ? "true" : "false", error.message);
 		return DOCA_ERROR_DRIVER;
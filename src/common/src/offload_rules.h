@@ -107,6 +107,7 @@ struct application_port_config {
 	uint16_t rss_support	:1;	/* Set on init to 0 for no RSS support, RSS support otherwise */
 	uint16_t lpbk_support	:1;	/* Enable loopback support */
 	uint16_t isolated_mode	:1;	/* Set on init to 0 for no isolation, isolated mode otherwise */
+	uint16_t rx_timestamp	:1;	/* Set on init to 1 to enable rx timestamps where the port supports them */
 };
 
 /* SFT configuration */
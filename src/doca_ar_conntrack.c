@@ -10,84 +10,431 @@
  *
  */
 #include "doca_ar_conntrack.h"
+#include "doca_ar_reroute.h"
 #include <rte_hash.h>
 #include <rte_jhash.h>
 #include <rte_hash_crc.h>
 #include <rte_mempool.h>
 #include <rte_malloc.h>
 #include <rte_memcpy.h>
+#include <rte_prefetch.h>
+#include <rte_alarm.h>
+#include <rte_spinlock.h>
+#include <arpa/inet.h>
 DOCA_LOG_REGISTER(DOCA_AR_CONNTRACK);
-struct rte_hash *CT = NULL;
-struct rte_mempool *CT_POOL = NULL;
-int maxConntrack = 0;
 /**
- * @brief user-defined hash function,here we directly use the rss val precomputed by hardware as the result of hash function so that we can save the cpu cosumption
+ * @brief conntrack shard of a worker, grown at runtime by migrating into a bigger table
  *
- * @param key
- * @param key_len
- * @param init_val
- * @return uint32_t
+ * The control thread publishes a bigger table through next. The worker switches its adds to it and moves the entries of
+ * old over a slice per aging round, looking both tables up meanwhile; the drained old table is handed back through retired.
+ */
+struct doca_ar_ct_shard
+{
+    struct rte_hash *table;            ///< new conns are added here
+    struct rte_hash *old;              ///< being migrated into table, NULL if no migration is going on
+    uint32_t migrateIter;              ///< iterator of the migration over old
+    struct rte_hash *volatile next;    ///< bigger table published by the control thread
+    struct rte_hash *volatile retired; ///< drained table for the control thread to free
+} __rte_cache_aligned;
+
+static struct doca_ar_ct_shard CT[MAX_WORKERS];         ///< conntrack shard of every worker
+static struct rte_mempool *CT_POOLS[CT_MAX_POOLS];      ///< conn mempools, the first one is sized at startup, one more per grow
+static volatile int nbCtPools = 0;
+static rte_spinlock_t ctGrowLock = RTE_SPINLOCK_INITIALIZER; ///< grow is requested by the cmdline and the grow check alarm
+static volatile int ctGrowWanted = 0;                   ///< a worker ran out of space
+struct doca_ar_wheel CT_WHEEL[MAX_WORKERS];             ///< conn lifetime timers of every worker
+volatile uint32_t maxConntrack = 0;                     ///< current capacity of all the shards together
+uint32_t maxConntrackLimit = 0;
+int nbCtShards = 0;
+/**
+ * @brief interned outer ipv6 addresses
+ *
+ */
+struct ct_addr6_map
+{
+    struct rte_hash *table; ///< outer ipv6 address ==> id, lock-free lookups
+    uint8_t (*addrs)[16];   ///< outer ipv6 address of every id, written before its key is published
+    uint32_t nb;            ///< ids handed out, bounded by MAX_VTEP6
+    rte_spinlock_t lock;    ///< serializes interning, which only happens for a new VTEP
+};
+static struct ct_addr6_map ADDR6_MAP = {.lock = RTE_SPINLOCK_INITIALIZER};
+int ctGeneration = 0; ///< tables created so far, keeps their names unique
+
+/**
+ * @brief create the table and the addresses of an address map
+ *
+ * @param map
+ * @param name name of the table
+ * @return int
+ */
+static int ct_addr6_map_init(struct ct_addr6_map *map, const char *name)
+{
+    const struct rte_hash_parameters params =
+        {
+            .name = name,
+            .entries = MAX_VTEP6,
+            .key_len = 16,
+            .hash_func = rte_hash_crc,
+            .socket_id = rte_socket_id(),
+            .extra_flag = RTE_HASH_EXTRA_FLAGS_RW_CONCURRENCY_LF, // interning is serialized by map->lock, lookups are lock-free
+        };
+    map->table = rte_hash_create(&params);
+    map->addrs = rte_zmalloc(name, MAX_VTEP6 * 16, RTE_CACHE_LINE_SIZE);
+    map->nb = 0;
+    if (map->table == NULL || map->addrs == NULL)
+    {
+        DOCA_LOG_ERR("Create %s fail!", name);
+        rte_hash_free(map->table);
+        rte_free(map->addrs);
+        return -1;
+    }
+    return 0;
+}
+/**
+ * @brief free an address map created by ct_addr6_map_init
+ *
+ * @param map
  */
-uint32_t myHash(const void *key, uint32_t key_len, uint32_t init_val)
+static void ct_addr6_map_free(struct ct_addr6_map *map)
 {
-    struct doca_ar_conn_match *mt = (struct doca_ar_conn_match *)key;
-    return mt->rss_val; // rss val is precomputed hash val by hw
+    rte_hash_free(map->table);
+    rte_free(map->addrs);
+    map->table = NULL;
+    map->addrs = NULL;
 }
-int doca_ar_conntrack_init_env(int _maxConntrack)
+/**
+ * @brief id of an outer ipv6 address in a map, a new address is interned
+ *
+ * The address is written into its slot before the key is published, so a worker finding the key always reads the whole address.
+ * Only ids below MAX_VTEP6 are ever published.
+ *
+ * @param map
+ * @param addr
+ * @return int id, -1 if the map is full
+ */
+static inline int ct_addr6_intern(struct ct_addr6_map *map, const uint8_t *addr)
 {
-    maxConntrack = _maxConntrack;
-    CT_POOL = rte_mempool_create("CT_POOL", maxConntrack,
-                                 sizeof(struct doca_ar_conn), maxConntrack / 4 > 256 ? 256 : maxConntrack / 4, 0,
-                                 NULL, NULL, NULL, NULL,
-                                 rte_socket_id(), 0);
-    if (CT_POOL == NULL)
+    void *data;
+    uint32_t id;
+    if (likely(rte_hash_lookup_data(map->table, addr, &data) >= 0))
+        return (uintptr_t)data < MAX_VTEP6 ? (int)(uintptr_t)data : -1;
+    rte_spinlock_lock(&map->lock);
+    if (rte_hash_lookup_data(map->table, addr, &data) >= 0) // another worker interned it meanwhile
     {
-        DOCA_LOG_ERR("Create CT_POOL Fail");
+        rte_spinlock_unlock(&map->lock);
+        return (int)(uintptr_t)data;
+    }
+    id = map->nb;
+    if (id >= MAX_VTEP6)
+    {
+        rte_spinlock_unlock(&map->lock);
+        DOCA_LOG_ERR("No space in ADDR6_TABLE.....");
         return -1;
     }
-    DOCA_LOG_INFO("Create CT_POOL Success");
-
+    rte_memcpy(map->addrs[id], addr, 16);
+    rte_smp_wmb();
+    if (rte_hash_add_key_data(map->table, addr, (void *)(uintptr_t)id) < 0)
+    {
+        rte_spinlock_unlock(&map->lock);
+        DOCA_LOG_ERR("No space in ADDR6_TABLE.....");
+        return -1;
+    }
+    map->nb = id + 1;
+    rte_spinlock_unlock(&map->lock);
+    return id;
+}
+/**
+ * @brief hash signature of a conn, here we directly use the rss val precomputed by hardware so that we can save the cpu cosumption
+ *
+ * The low bits of the rss val also pick the worker queue, so all keys of a shard share them;
+ * one crc instruction spreads them over the buckets again instead of leaving most buckets of a shard empty.
+ * The rss val is not part of the key, so every access of CT passes this signature through the *_with_hash api.
+ *
+ * @param match
+ * @return hash_sig_t
+ */
+static inline hash_sig_t ct_sig(const struct doca_ar_conn_match *match)
+{
+    return rte_hash_crc_4byte(match->rss_val, 0); // rss val is precomputed hash val by hw
+}
+/**
+ * @brief entries of one shard for a given capacity
+ *
+ * CT_POOLS bound the conns of all shards, a shard gets twice its fair share to tolerate uneven rss.
+ *
+ * @param capacity
+ * @return uint32_t
+ */
+static uint32_t ct_shard_entries(uint32_t capacity)
+{
+    return RTE_MIN(capacity, 2 * capacity / nbCtShards + CT_SHARD_SLACK);
+}
+/**
+ * @brief create the table of a shard
+ *
+ * @param q shard
+ * @param entries
+ * @return struct rte_hash*
+ */
+static struct rte_hash *ct_create_table(int q, uint32_t entries)
+{
+    char name[RTE_HASH_NAMESIZE];
+    snprintf(name, sizeof(name), "CT_%d_%d", q, ctGeneration++);
     const struct rte_hash_parameters ConnectionTable =
         {
-            .name = "CT",
-            .entries = maxConntrack,
+            .name = name,
+            .entries = entries,
             .reserved = 0,
-            .key_len = sizeof(struct doca_ar_conn_match),
-            .hash_func = myHash, // rte_jhash,
+            .key_len = CT_KEY_LEN,
+            .hash_func = rte_hash_crc, // unused, signatures come from ct_sig
             .hash_func_init_val = 0,
             .socket_id = rte_socket_id(),
             .extra_flag = RTE_HASH_EXTRA_FLAGS_EXT_TABLE, // 0,
         };
+    return rte_hash_create(&ConnectionTable);
+}
+/**
+ * @brief create a conn mempool and publish it to the workers
+ *
+ * @param size
+ * @return int
+ */
+static int ct_add_pool(uint32_t size)
+{
+    char name[RTE_MEMPOOL_NAMESIZE];
+    struct rte_mempool *pool;
+    if (nbCtPools == CT_MAX_POOLS)
+    {
+        DOCA_LOG_ERR("Conntrack grown %d times already", CT_MAX_POOLS - 1);
+        return -1;
+    }
+    if (nbCtPools == 0)
+        snprintf(name, sizeof(name), "CT_POOL");
+    else
+        snprintf(name, sizeof(name), "CT_POOL_%d", nbCtPools);
+    pool = rte_mempool_create(name, size,
+                              sizeof(struct doca_ar_conn), size / 4 > 256 ? 256 : size / 4, 0,
+                              NULL, NULL, NULL, NULL,
+                              rte_socket_id(), 0);
+    if (pool == NULL)
+    {
+        DOCA_LOG_ERR("Create %s Fail", name);
+        return -1;
+    }
+    CT_POOLS[nbCtPools] = pool;
+    rte_smp_wmb(); // the pool is visible before the count covers it
+    nbCtPools++;
+    DOCA_LOG_INFO("Create %s of %u conns Success", name, size);
+    return 0;
+}
+/**
+ * @brief free the tables drained by the workers
+ *
+ */
+static void ct_reap()
+{
+    for (int q = 0; q < nbCtShards; q++)
+    {
+        if (CT[q].retired == NULL)
+            continue;
+        rte_hash_free(CT[q].retired);
+        CT[q].retired = NULL;
+    }
+}
+/**
+ * @brief publish larger tables and one more pool, ctGrowLock is held
+ *
+ * @param capacity
+ * @return int
+ */
+static int ct_grow(uint32_t capacity)
+{
+    struct rte_hash *tables[MAX_WORKERS] = {NULL};
+    int q, ret = -1;
 
-    CT = rte_hash_create(&ConnectionTable);
-    if (!CT)
+    if (capacity <= maxConntrack || capacity > maxConntrackLimit)
+    {
+        DOCA_LOG_ERR("Conntrack capacity %u should be in (%u, %u]", capacity, maxConntrack, maxConntrackLimit);
+        goto out;
+    }
+    for (q = 0; q < nbCtShards; q++)
+    {
+        if (CT[q].next != NULL || CT[q].old != NULL || CT[q].retired != NULL)
+        {
+            DOCA_LOG_ERR("Shard %d is still migrating", q);
+            goto out;
+        }
+    }
+    // the tables are the slow part, build them all before the workers see anything
+    for (q = 0; q < nbCtShards; q++)
+    {
+        tables[q] = ct_create_table(q, ct_shard_entries(capacity));
+        if (tables[q] == NULL)
+        {
+            DOCA_LOG_ERR("Create ConnectionTable %d of %u entries fail!", q, ct_shard_entries(capacity));
+            goto out;
+        }
+    }
+    if (ct_add_pool(capacity - maxConntrack))
+        goto out;
+    rte_smp_wmb();
+    for (q = 0; q < nbCtShards; q++)
+    {
+        CT[q].next = tables[q];
+        tables[q] = NULL;
+    }
+    DOCA_LOG_INFO("Grow conntrack from %u to %u conns", maxConntrack, capacity);
+    maxConntrack = capacity;
+    ret = 0;
+out:
+    for (q = 0; q < nbCtShards; q++)
+        rte_hash_free(tables[q]);
+    return ret;
+}
+/**
+ * @brief periodic check on the EAL alarm thread: grow the conntrack when a shard or the pools fill up
+ *
+ * @param arg
+ */
+static void ct_grow_check(__rte_unused void *arg)
+{
+    uint32_t avail = 0, grow = ctGrowWanted;
+    // the cmdline may hold the lock for a while to dump the conns, the alarm thread does not wait for it
+    if (rte_spinlock_trylock(&ctGrowLock))
     {
-        DOCA_LOG_ERR("Create ConnectionTable fail!");
+        // a table retired by its worker is only freed by ct_reap under the lock, so it can be counted here
+        for (int p = 0; p < nbCtPools; p++)
+            avail += rte_mempool_avail_count(CT_POOLS[p]);
+        if (avail < maxConntrack / 100 * (100 - CT_GROW_LOAD))
+            grow = 1;
+        for (int q = 0; q < nbCtShards; q++)
+            if ((uint32_t)rte_hash_count(CT[q].table) > ct_shard_entries(maxConntrack) / 100 * CT_GROW_LOAD)
+                grow = 1;
+        ct_reap();
+        if (grow && maxConntrack < maxConntrackLimit)
+            ct_grow(RTE_MIN(maxConntrack * 2, maxConntrackLimit));
+        rte_spinlock_unlock(&ctGrowLock);
+        ctGrowWanted = 0;
+    }
+    rte_eal_alarm_set(CT_GROW_CHECK_US, ct_grow_check, NULL);
+}
+
+int doca_ar_conntrack_init_env(uint32_t _maxConntrack, uint32_t limit, int nbShards)
+{
+    maxConntrack = _maxConntrack;
+    maxConntrackLimit = RTE_MAX(limit, _maxConntrack);
+    nbCtShards = nbShards;
+    if (ct_add_pool(maxConntrack))
+        return -1;
+
+    if (ct_addr6_map_init(&ADDR6_MAP, "ADDR6_TABLE"))
         return -1;
+
+    for (int q = 0; q < nbCtShards; q++)
+    {
+        CT[q].table = ct_create_table(q, ct_shard_entries(maxConntrack));
+        if (!CT[q].table)
+        {
+            DOCA_LOG_ERR("Create ConnectionTable %d fail!", q);
+            return -1;
+        }
+        doca_ar_wheel_init(&CT_WHEEL[q], doca_ar_wheel_tick());
     }
-    DOCA_LOG_INFO("Create CT[%d] success", maxConntrack);
+    DOCA_LOG_INFO("Create CT[%u] x %d shards success, limit %u", ct_shard_entries(maxConntrack), nbCtShards, maxConntrackLimit);
+    if (maxConntrackLimit > maxConntrack && rte_eal_alarm_set(CT_GROW_CHECK_US, ct_grow_check, NULL) < 0)
+        DOCA_LOG_WARN("Cannot set the grow check alarm, use ctgrow to grow the conntrack");
 
     return 0;
 }
 
-struct doca_ar_conn *doca_ar_add_conn(struct doca_ar_conn_match *match, uint16_t bestPath)
+int doca_ar_conntrack_grow(uint32_t capacity)
+{
+    int ret;
+    rte_spinlock_lock(&ctGrowLock);
+    ct_reap();
+    ret = ct_grow(capacity);
+    rte_spinlock_unlock(&ctGrowLock);
+    return ret;
+}
+
+/**
+ * @brief switch to a table published by the control thread and move a slice of the old table over
+ *
+ * Entries are moved, not copied, so a conn deleted meanwhile is never resurrected. Deleting during
+ * rte_hash_iterate may make it skip an entry, so the walk restarts until the old table is empty.
+ *
+ * @param shard
+ */
+static void ct_migrate(struct doca_ar_ct_shard *shard)
+{
+    const void *key;
+    void *data;
+    if (shard->next != NULL && shard->old == NULL && shard->retired == NULL)
+    {
+        rte_smp_rmb();
+        shard->old = shard->table;
+        shard->table = shard->next;
+        shard->migrateIter = 0;
+        shard->next = NULL;
+    }
+    if (shard->old == NULL)
+        return;
+    for (int n = 0; n < CT_MIGRATE_BATCH; n++)
+    {
+        if (rte_hash_iterate(shard->old, &key, &data, &shard->migrateIter) < 0)
+        {
+            shard->migrateIter = 0;
+            if (rte_hash_count(shard->old) > 0)
+                return; // skipped entries, next pass
+            shard->retired = shard->old;
+            shard->old = NULL;
+            return;
+        }
+        struct doca_ar_conn *conn = data;
+        hash_sig_t sig = ct_sig(&conn->match);
+        if (rte_hash_add_key_with_hash_data(shard->table, key, sig, conn) < 0)
+        {
+            DOCA_LOG_ERR("Migrate conn fail, the new table is full");
+            return;
+        }
+        rte_hash_del_key_with_hash(shard->old, &conn->match, sig);
+    }
+}
+
+/**
+ * @brief get a conn from the newest pool that has one
+ *
+ * @return struct doca_ar_conn*
+ */
+static struct doca_ar_conn *ct_pool_get()
+{
+    void *conn;
+    for (int p = nbCtPools - 1; p >= 0; p--)
+        if (rte_mempool_get(CT_POOLS[p], &conn) == 0)
+            return conn;
+    return NULL;
+}
+
+struct doca_ar_conn *doca_ar_add_conn(uint16_t queue, struct doca_ar_conn_match *match, uint16_t bestPath)
 {
     /////////////////////////////////////////////////////////// 1.get a ctx from pool
     struct doca_ar_conn *newConn = NULL;
-    if (CT_POOL == NULL)
+    if (nbCtPools == 0)
     {
         DOCA_LOG_ERR("Pool is NULL.....");
         return NULL;
     }
-    if (rte_mempool_get(CT_POOL, (void **)&newConn) != 0)
+    newConn = ct_pool_get();
+    if (newConn == NULL)
     {
+        ctGrowWanted = 1;
         DOCA_LOG_ERR("Cannot get newConn from pool.....");
         return NULL;
     }
     // DOCA_LOG_INFO("CTX_POOL In Use:%d", rte_mempool_in_use_count(POOL));
 
     ///////////////////////////////////////////////////////////// 2.put match->ctx into CT
-    int ret = rte_hash_add_key_data(CT, match, newConn);
+    int ret = rte_hash_add_key_with_hash_data(CT[queue].table, match, ct_sig(match), newConn);
     if (ret < 0)
     {
         if (ret == -EINVAL)
@@ -95,37 +442,193 @@ struct doca_ar_conn *doca_ar_add_conn(struct doca_ar_conn_match *match, uint16_t
             DOCA_LOG_ERR("Invalid params.....");
         }
         else
+        {
+            ctGrowWanted = 1;
             DOCA_LOG_ERR("No space.....");
+        }
 
-        rte_mempool_put(CT_POOL, (void *)newConn);
+        rte_mempool_put(rte_mempool_from_obj(newConn), (void *)newConn);
         return NULL;
     }
     ///////////////////////////////////////////////////////////// 3.memcpy conn info
     memset(newConn, 0, sizeof(struct doca_ar_conn));
     rte_memcpy(&(newConn->match), match, sizeof(struct doca_ar_conn_match));
     newConn->bestPath = bestPath;
+    newConn->queue = queue;
+    newConn->expireTime = CT_EXPIRE_TIME;
+    newConn->lastSeen = (uint32_t)CT_WHEEL[queue].now;
+    // with rerouting the path is first re-evaluated one interval after the conn was created
+    uint32_t first = ar_config.rerouteIntervalMs ? ar_config.rerouteIntervalMs * WHEEL_TICK_HZ / 1000 : CT_EXPIRE_TIME * WHEEL_TICK_HZ;
+    doca_ar_wheel_add(&CT_WHEEL[queue], &newConn->timer, CT_WHEEL[queue].now + first);
 
     return newConn;
 }
 
-void doca_ar_del_conn(void *_conn)
+void doca_ar_del_conn(struct doca_ar_conn *conn)
 {
-    struct doca_ar_conn *conn = _conn;
-    int ret = rte_hash_del_key(CT, &(conn->match));
+    struct doca_ar_ct_shard *shard = &CT[conn->queue];
+    hash_sig_t sig = ct_sig(&conn->match);
+    doca_ar_wheel_del(&CT_WHEEL[conn->queue], &conn->timer);
+    int ret = rte_hash_del_key_with_hash(shard->table, &(conn->match), sig);
+    if (ret < 0 && shard->old != NULL)
+        ret = rte_hash_del_key_with_hash(shard->old, &(conn->match), sig); // not migrated yet
     if (ret < 0)
     {
         DOCA_LOG_ERR("CT Del failed");
+        return;
     }
+    rte_mempool_put(rte_mempool_from_obj(conn), conn);
     // DOCA_LOG_INFO("Aging Flow");
 }
-struct doca_ar_conn *doca_ar_find_conn(struct doca_ar_conn_match *match)
+
+int doca_ar_conntrack_expire(uint16_t queue, int budget)
+{
+    struct doca_ar_wheel *w = &CT_WHEEL[queue];
+    struct doca_ar_wheel_node *node;
+    int expired = 0;
+
+    ct_migrate(&CT[queue]);
+    doca_ar_wheel_advance(w, doca_ar_wheel_tick());
+    while (budget-- > 0 && (node = doca_ar_wheel_pop(w)) != NULL)
+    {
+        struct doca_ar_conn *conn = container_of(node, struct doca_ar_conn, timer);
+        uint32_t timeout = conn->expireTime * WHEEL_TICK_HZ;
+        uint32_t idle = (uint32_t)w->now - conn->lastSeen;
+        if (conn->probe != NULL || conn->entryPending)
+            doca_ar_wheel_add(w, node, w->now + CT_RECHECK_MS * WHEEL_TICK_HZ / 1000);
+        else if (conn->entry != NULL && ar_config.rerouteIntervalMs)
+            doca_ar_wheel_add(w, node, w->now + doca_ar_reroute_check(conn) * WHEEL_TICK_HZ / 1000);
+        else if (conn->entry != NULL)
+            doca_ar_wheel_add(w, node, w->now + timeout); // the flow backend sees its packets and ages it
+        else if (idle < timeout)
+            doca_ar_wheel_add(w, node, w->now + timeout - idle);
+        else
+        {
+            expired++;
+            doca_ar_del_conn(conn);
+        }
+    }
+    return expired;
+}
+
+uint32_t doca_ar_conntrack_backlog(uint16_t queue)
+{
+    return CT_WHEEL[queue].nbDue;
+}
+uint32_t doca_ar_conntrack_in_use(uint32_t *capacity)
+{
+    uint32_t inUse = 0;
+    int nb = nbCtPools;
+    rte_smp_rmb(); // CT_POOLS[p] is set before nbCtPools grows
+    for (int p = 0; p < nb; p++)
+        inUse += rte_mempool_in_use_count(CT_POOLS[p]);
+    if (capacity)
+        *capacity = maxConntrack;
+    return inUse;
+}
+struct doca_ar_conn *doca_ar_find_conn(uint16_t queue, struct doca_ar_conn_match *match)
 {
     struct doca_ar_conn *conn = NULL;
-    int ret = rte_hash_lookup_data(CT, match, (void **)&conn);
+    hash_sig_t sig = ct_sig(match);
+    int ret = rte_hash_lookup_with_hash_data(CT[queue].table, match, sig, (void **)&conn);
+    if (ret < 0 && CT[queue].old != NULL)
+        ret = rte_hash_lookup_with_hash_data(CT[queue].old, match, sig, (void **)&conn);
     return ret >= 0 ? conn : NULL;
 }
 
-int doca_ar_parse_conn(struct doca_ar_conn_match *match, struct rte_mbuf *m)
+uint64_t doca_ar_find_conn_burst(uint16_t queue, struct rte_mbuf **pkts, uint16_t nb, struct doca_ar_conn_match *matches,
+                                 struct doca_ar_conn **conns, uint64_t *vxlanMask)
+{
+    struct doca_ar_ct_shard *shard = &CT[queue];
+    const void *keys[CT_LOOKUP_BULK];
+    hash_sig_t sigs[CT_LOOKUP_BULK];
+    void *data[CT_LOOKUP_BULK];
+    uint8_t idx[CT_LOOKUP_BULK]; ///< packet of every key
+    uint64_t hits = 0, keyHits = 0;
+    int nbKeys = 0, nbMiss = 0, i;
+
+    *vxlanMask = 0;
+    for (i = 0; i < nb && i < CT_PREFETCH_OFFSET; i++)
+        rte_prefetch0(rte_pktmbuf_mtod(pkts[i], void *));
+    for (i = 0; i < nb; i++)
+    {
+        if (i + CT_PREFETCH_OFFSET < nb)
+            rte_prefetch0(rte_pktmbuf_mtod(pkts[i + CT_PREFETCH_OFFSET], void *));
+        memset(&matches[i], 0, sizeof(struct doca_ar_conn_match));
+        if (!doca_ar_parse_conn(&matches[i], pkts[i]))
+            continue;
+        *vxlanMask |= 1ULL << i;
+        keys[nbKeys] = &matches[i];
+        sigs[nbKeys] = ct_sig(&matches[i]);
+        idx[nbKeys++] = i;
+    }
+    if (nbKeys == 0)
+        return 0;
+    rte_hash_lookup_with_hash_bulk_data(shard->table, keys, sigs, nbKeys, &keyHits, data);
+    for (i = 0; i < nbKeys; i++)
+    {
+        if (!(keyHits & (1ULL << i)))
+        {
+            // compact the misses in place for the old table
+            keys[nbMiss] = keys[i];
+            sigs[nbMiss] = sigs[i];
+            idx[nbMiss++] = idx[i];
+            continue;
+        }
+        hits |= 1ULL << idx[i];
+        conns[idx[i]] = data[i];
+    }
+    if (shard->old == NULL || nbMiss == 0)
+        return hits;
+    // a growing shard: conns not migrated yet are still in the old table
+    rte_hash_lookup_with_hash_bulk_data(shard->old, keys, sigs, nbMiss, &keyHits, data);
+    for (i = 0; i < nbMiss; i++)
+    {
+        if (!(keyHits & (1ULL << i)))
+            continue;
+        hits |= 1ULL << idx[i];
+        conns[idx[i]] = data[i];
+    }
+    return hits;
+}
+
+/**
+ * @brief parse the vni and the inner 5-tuple at fixed offsets behind the outer udp header
+ *
+ * @param match
+ * @param m
+ * @param vxlanOffset CT_VXLAN_OFFSET or CT_VXLAN6_OFFSET
+ */
+static inline void parse_inner(struct doca_ar_conn_match *match, struct rte_mbuf *m, uint32_t vxlanOffset)
+{
+    if (unlikely(rte_pktmbuf_data_len(m) < vxlanOffset + CT_INNER_L4_LEN + sizeof(struct rte_udp_hdr)))
+        return; // vxlan header or inner headers not in the first segment
+    struct rte_vxlan_hdr *vxlan = rte_pktmbuf_mtod_offset(m, struct rte_vxlan_hdr *, vxlanOffset);
+    struct rte_ether_hdr *eth = (struct rte_ether_hdr *)(vxlan + 1);
+    struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(eth + 1);
+    match->vni = vxlan->vx_vni & rte_cpu_to_be_32(0xffffff00);
+    if (eth->ether_type != rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4) || ip->version_ihl != RTE_IPV4_VHL_DEF)
+        return; // the vni alone tells the conns apart
+    // other inner protocols are offloaded into upstream_vxlanOuterPipe, which only tells them apart by the outer 4-tuple and the vni
+    if (ip->next_proto_id != IPPROTO_UDP && ip->next_proto_id != IPPROTO_TCP)
+        return;
+    // tcp and udp start with the same two ports
+    struct rte_udp_hdr *l4 = (struct rte_udp_hdr *)(ip + 1);
+    match->inSip = ip->src_addr;
+    match->inDip = ip->dst_addr;
+    match->inProto = ip->next_proto_id;
+    match->inSport = l4->src_port;
+    match->inDport = l4->dst_port;
+}
+/**
+ * @brief parse a packet into a conn key, outer ipv6 addresses are interned into map
+ *
+ * @param map
+ * @param match
+ * @param m
+ * @return int 1 if it is a vxlan packet
+ */
+static inline int ct_parse(struct ct_addr6_map *map, struct doca_ar_conn_match *match, struct rte_mbuf *m)
 {
     if (RTE_ETH_IS_IPV4_HDR(m->packet_type))
     {
@@ -141,38 +644,99 @@ int doca_ar_parse_conn(struct doca_ar_conn_match *match, struct rte_mbuf *m)
             {
                 match->sport = udp->src_port;
                 match->dport = udp->dst_port;
+                parse_inner(match, m, CT_VXLAN_OFFSET);
                 return 1;
             }
         }
     }
+    else if (RTE_ETH_IS_IPV6_HDR(m->packet_type))
+    {
+        struct rte_ipv6_hdr *ip6 = rte_pktmbuf_mtod_offset(m, struct rte_ipv6_hdr *, sizeof(struct rte_ether_hdr));
+        struct rte_udp_hdr *udp = (struct rte_udp_hdr *)(ip6 + 1);
+        if (ip6->proto != IPPROTO_UDP || udp->dst_port != rte_cpu_to_be_16(4789))
+            return 0; // extension headers are not expected on the underlay
+        int sid = ct_addr6_intern(map, ip6->src_addr), did = ct_addr6_intern(map, ip6->dst_addr);
+        if (unlikely(sid < 0 || did < 0))
+            return 0;
+        match->sip = sid;
+        match->dip = did;
+        match->ipv6 = 1;
+        match->rss_val = m->hash.rss;
+        match->sport = udp->src_port;
+        match->dport = udp->dst_port;
+        parse_inner(match, m, CT_VXLAN6_OFFSET);
+        return 1;
+    }
     return 0;
 }
 
-void doca_ar_print_match(struct doca_ar_conn_match *match)
+int doca_ar_parse_conn(struct doca_ar_conn_match *match, struct rte_mbuf *m)
+{
+    return ct_parse(&ADDR6_MAP, match, m);
+}
+int doca_ar_addr6_id(const uint8_t *addr)
+{
+    return ct_addr6_intern(&ADDR6_MAP, addr);
+}
+const uint8_t *doca_ar_addr6(uint32_t id)
 {
-    char buf1[100] = {0}, buf2[100] = {0};
-    void print_ipv4_addr(const rte_be32_t sip, const rte_be32_t dip)
+    return ADDR6_MAP.addrs[id];
+}
+void doca_ar_sprint_addr(char *buf, size_t len, uint32_t addr, uint8_t ipv6)
+{
+    if (ipv6)
     {
-        sprintf(buf1, "(SIP=%d.%d.%d.%d,DIP=%d.%d.%d.%d,",
-                (sip & 0xff000000) >> 24,
-                (sip & 0x00ff0000) >> 16,
-                (sip & 0x0000ff00) >> 8,
-                (sip & 0x000000ff),
-                (dip & 0xff000000) >> 24,
-                (dip & 0x00ff0000) >> 16,
-                (dip & 0x0000ff00) >> 8,
-                (dip & 0x000000ff));
+        inet_ntop(AF_INET6, ADDR6_MAP.addrs[addr], buf, len);
+        return;
     }
-    print_ipv4_addr(htonl(match->sip), htonl(match->dip));
+    addr = rte_be_to_cpu_32(addr);
+    snprintf(buf, len, "%u.%u.%u.%u", addr >> 24, (addr >> 16) & 0xff, (addr >> 8) & 0xff, addr & 0xff);
+}
+/**
+ * @brief print the vni and the inner 5-tuple of a match
+ *
+ * @param buf
+ * @param len
+ * @param match
+ */
+static void doca_ar_sprint_inner(char *buf, size_t len, const struct doca_ar_conn_match *match)
+{
+    uint32_t sip = rte_be_to_cpu_32(match->inSip), dip = rte_be_to_cpu_32(match->inDip);
+    snprintf(buf, len, "[VNI=%u,%u.%u.%u.%u:%u=>%u.%u.%u.%u:%u,PROTO=%u]",
+             rte_be_to_cpu_32(match->vni) >> 8,
+             sip >> 24, (sip >> 16) & 0xff, (sip >> 8) & 0xff, sip & 0xff, rte_be_to_cpu_16(match->inSport),
+             dip >> 24, (dip >> 16) & 0xff, (dip >> 8) & 0xff, dip & 0xff, rte_be_to_cpu_16(match->inDport),
+             match->inProto);
+}
+void doca_ar_print_match(struct doca_ar_conn_match *match)
+{
+    char buf1[100] = {0}, buf2[100] = {0}, sip[INET6_ADDRSTRLEN], dip[INET6_ADDRSTRLEN];
+    doca_ar_sprint_addr(sip, sizeof(sip), match->sip, match->ipv6);
+    doca_ar_sprint_addr(dip, sizeof(dip), match->dip, match->ipv6);
+    sprintf(buf1, "(SIP=%s,DIP=%s,", sip, dip);
     sprintf(buf2, "UDP,SPORT=%u,DPORT=%u,RSS=%u)",
             rte_be_to_cpu_16(match->sport),
             rte_be_to_cpu_16(match->dport),
             match->rss_val);
-    DOCA_LOG_INFO("%s%s", buf1, buf2);
+    char buf3[100] = {0};
+    doca_ar_sprint_inner(buf3, sizeof(buf3), match);
+    DOCA_LOG_INFO("%s%s%s", buf1, buf2, buf3);
 }
 
 void doca_ar_modify_conn(struct doca_ar_conn *conn, struct rte_mbuf *m)
 {
+    if (conn->match.ipv6)
+    {
+        struct rte_ipv6_hdr *ip6 = rte_pktmbuf_mtod_offset(m, struct rte_ipv6_hdr *, sizeof(struct rte_ether_hdr));
+        struct rte_udp_hdr *udp6 = (struct rte_udp_hdr *)(ip6 + 1);
+        udp6->src_port = conn->bestPath;
+        // ipv6 has no header cksum, the udp cksum is mandatory and seeded with the pseudo header for the offload
+        m->l2_len = sizeof(struct rte_ether_hdr);
+        m->l3_len = sizeof(struct rte_ipv6_hdr);
+        m->ol_flags |= PKT_TX_IPV6 | PKT_TX_UDP_CKSUM;
+        udp6->dgram_cksum = rte_ipv6_phdr_cksum(ip6, m->ol_flags);
+        return;
+    }
     struct rte_ipv4_hdr *ipv4_hdr = rte_pktmbuf_mtod_offset(m, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
     struct rte_udp_hdr *udp;
     udp = rte_pktmbuf_mtod_offset(m, struct rte_udp_hdr *, sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr));
@@ -194,32 +758,273 @@ void doca_ar_dump_conn(struct cmdline *cl)
     struct doca_ar_conn_match *match;
     struct doca_ar_conn *conn;
     uint32_t iter = 0;
-    while (1)
+    int total = 0, q = 0;
+    // no grow starts and no table is freed while the shards are walked
+    rte_spinlock_lock(&ctGrowLock);
+    while (q < nbCtShards)
     {
-        /* code */
-        int ret = rte_hash_iterate(CT, (const void **)&match, (void **)&conn, (uint32_t *)&iter);
+        // the worker of a migrating shard moves and deletes keys of both tables, they are left alone
+        if (CT[q].next != NULL || CT[q].old != NULL)
+        {
+            cmdline_printf(cl, "Shard %d is migrating, skipped\n", q);
+            q++;
+            continue;
+        }
+        int ret = rte_hash_iterate(CT[q].table, (const void **)&match, (void **)&conn, (uint32_t *)&iter);
         if (ret < 0)
-            break;
-
-        char buf1[100] = {0}, buf2[100] = {0};
-        void print_ipv4_addr(const rte_be32_t sip, const rte_be32_t dip)
-        {
-            sprintf(buf1, "(SIP=%d.%d.%d.%d,DIP=%d.%d.%d.%d,",
-                    (sip & 0xff000000) >> 24,
-                    (sip & 0x00ff0000) >> 16,
-                    (sip & 0x0000ff00) >> 8,
-                    (sip & 0x000000ff),
-                    (dip & 0xff000000) >> 24,
-                    (dip & 0x00ff0000) >> 16,
-                    (dip & 0x0000ff00) >> 8,
-                    (dip & 0x000000ff));
-        }
-        print_ipv4_addr(htonl(match->sip), htonl(match->dip));
+        {
+            total += rte_hash_count(CT[q].table);
+            iter = 0;
+            q++;
+            continue;
+        }
+        match = &conn->match; // the stored key ends before rss_val
+
+        char buf1[100] = {0}, buf2[100] = {0}, sip[INET6_ADDRSTRLEN], dip[INET6_ADDRSTRLEN];
+        doca_ar_sprint_addr(sip, sizeof(sip), match->sip, match->ipv6);
+        doca_ar_sprint_addr(dip, sizeof(dip), match->dip, match->ipv6);
+        sprintf(buf1, "(SIP=%s,DIP=%s,", sip, dip);
         sprintf(buf2, "UDP,SPORT=%u,DPORT=%u,RSS=%u)",
                 rte_be_to_cpu_16(match->sport),
                 rte_be_to_cpu_16(match->dport),
                 match->rss_val);
-        cmdline_printf(cl, "%s%s===>BestPath:%d\n", buf1, buf2, rte_be_to_cpu_16(conn->bestPath));
+        char buf3[100] = {0};
+        doca_ar_sprint_inner(buf3, sizeof(buf3), match);
+        cmdline_printf(cl, "%s%s%s===>BestPath:%d Worker:%d\n", buf1, buf2, buf3, rte_be_to_cpu_16(conn->bestPath), conn->queue);
+        if (conn->probePort[0] == 0)
+            continue; // not chosen by probing
+        cmdline_printf(cl, "    ProbedRTT[us]:");
+        for (int p = 0; p < PROBE_PATH_AMOUNT; p++)
+        {
+            if (conn->probeRtt[p] == UINT32_MAX)
+                cmdline_printf(cl, " %d=lost", rte_be_to_cpu_16(conn->probePort[p]));
+            else
+                cmdline_printf(cl, " %d=%u.%03u", rte_be_to_cpu_16(conn->probePort[p]), conn->probeRtt[p] / 1000, conn->probeRtt[p] % 1000);
+        }
+        cmdline_printf(cl, "\n");
+    }
+    rte_spinlock_unlock(&ctGrowLock);
+    cmdline_printf(cl, "Total Active Connections: %d\n", total);
+}
+
+#define CT_BENCH_PARSE_ROUNDS 100000 ///< bursts parsed by the parse bench of every underlay
+
+/**
+ * @brief key of the conntrack table before it was compacted: the rss val inside the key and the key padded to a cache line
+ *
+ */
+struct ct_bench_legacy_key
+{
+    uint32_t sip;
+    uint32_t dip;
+    uint16_t sport;
+    uint16_t dport;
+    uint32_t rss_val;
+} __rte_cache_aligned;
+
+/**
+ * @brief fill a temporary table with nbConns keys, then report its heap footprint and bulk lookup rate
+ *
+ * @param cl
+ * @param name
+ * @param keyLen
+ * @param keySize stride of the keys, the former layout looks up whole struct ct_bench_legacy_key
+ * @param nbConns
+ */
+static void ct_bench_one(struct cmdline *cl, const char *name, uint32_t keyLen, uint32_t keySize, uint32_t nbConns)
+{
+    struct rte_malloc_socket_stats before, after;
+    struct rte_hash *h;
+    uint8_t *keys = rte_zmalloc("CT_BENCH_KEYS", (size_t)nbConns * keySize, RTE_CACHE_LINE_SIZE);
+    hash_sig_t *sigs = rte_malloc("CT_BENCH_SIGS", (size_t)nbConns * sizeof(hash_sig_t), 0);
+    const void *bulk[CT_LOOKUP_BULK];
+    hash_sig_t bulkSigs[CT_LOOKUP_BULK];
+    void *data[CT_LOOKUP_BULK];
+    uint64_t hits, lookups = 0, start, cycles;
+    uint32_t i, pos = 0;
+
+    if (keys == NULL || sigs == NULL)
+    {
+        cmdline_printf(cl, "%s: no memory for %u keys\n", name, nbConns);
+        goto out;
+    }
+    for (i = 0; i < nbConns; i++)
+    {
+        struct doca_ar_conn_match *k = (struct doca_ar_conn_match *)(keys + (size_t)i * keySize);
+        k->sip = rte_cpu_to_be_32(0xc0a80000 | (i >> 16));
+        k->dip = rte_cpu_to_be_32(0xc0a90000 | (i & 0xffff));
+        k->sport = rte_cpu_to_be_16(49152 + (i & 0x3fff));
+        k->dport = rte_cpu_to_be_16(4789);
+        sigs[i] = rte_hash_crc_4byte(i, 0); // stands in for the rss val
+        if (keyLen == CT_KEY_LEN)
+        {
+            k->vni = rte_cpu_to_be_32(100 << 8);
+            k->inSip = rte_cpu_to_be_32(0x0a000000 | (i >> 16));
+            k->inDip = rte_cpu_to_be_32(0x0a010000 | (i & 0xffff));
+            k->inSport = k->sport;
+            k->inDport = rte_cpu_to_be_16(5201);
+            k->inProto = IPPROTO_TCP;
+        }
+        if (keyLen == sizeof(struct ct_bench_legacy_key))
+            ((struct ct_bench_legacy_key *)k)->rss_val = sigs[i];
+    }
+
+    rte_malloc_get_socket_stats(rte_socket_id(), &before);
+    const struct rte_hash_parameters params = {
+        .name = name,
+        .entries = nbConns,
+        .key_len = keyLen,
+        .hash_func = rte_hash_crc,
+        .socket_id = rte_socket_id(),
+        .extra_flag = RTE_HASH_EXTRA_FLAGS_EXT_TABLE,
+    };
+    h = rte_hash_create(&params);
+    if (h == NULL)
+    {
+        cmdline_printf(cl, "%s: create table of %u entries fail\n", name, nbConns);
+        goto out;
+    }
+    for (i = 0; i < nbConns; i++)
+        rte_hash_add_key_with_hash_data(h, keys + (size_t)i * keySize, sigs[i], keys + (size_t)i * keySize);
+    rte_malloc_get_socket_stats(rte_socket_id(), &after);
+
+    // look every key up 4 times in a scattered order, CT_LOOKUP_BULK keys per lookup like process_packets
+    start = rte_rdtsc();
+    while (lookups < 4ULL * nbConns)
+    {
+        for (i = 0; i < CT_LOOKUP_BULK; i++)
+        {
+            pos = (pos + 40503) % nbConns;
+            bulk[i] = keys + (size_t)pos * keySize;
+            bulkSigs[i] = sigs[pos];
+        }
+        rte_hash_lookup_with_hash_bulk_data(h, bulk, bulkSigs, CT_LOOKUP_BULK, &hits, data);
+        lookups += CT_LOOKUP_BULK;
     }
-    cmdline_printf(cl, "Total Active Connections: %d\n", rte_hash_count(CT));
-}
\ No newline at end of file
+    cycles = rte_rdtsc() - start;
+
+    cmdline_printf(cl, "%-8s key %2uB: %u conns, table %8.1f MB (%5.1f B/conn), %6.2f Mlookups/s\n",
+                   name, keyLen, rte_hash_count(h),
+                   (after.heap_allocsz_bytes - before.heap_allocsz_bytes) / 1048576.0,
+                   (double)(after.heap_allocsz_bytes - before.heap_allocsz_bytes) / nbConns,
+                   lookups / ((double)cycles / rte_get_tsc_hz()) / 1E6);
+    rte_hash_free(h);
+out:
+    rte_free(keys);
+    rte_free(sigs);
+}
+
+/**
+ * @brief build a vxlan packet of inner tcp towards one of 16 VTEPs, as received from the host port
+ *
+ * @param m
+ * @param ipv6 build an ipv6 underlay
+ * @param i index of the flow
+ */
+static void ct_bench_fill_pkt(struct rte_mbuf *m, int ipv6, uint32_t i)
+{
+    uint32_t l3Len = ipv6 ? sizeof(struct rte_ipv6_hdr) : sizeof(struct rte_ipv4_hdr);
+    uint32_t len = sizeof(struct rte_ether_hdr) + l3Len + sizeof(struct rte_udp_hdr) + CT_INNER_L4_LEN + sizeof(struct rte_tcp_hdr);
+    uint8_t *p = (uint8_t *)rte_pktmbuf_append(m, len);
+    memset(p, 0, len);
+    struct rte_ether_hdr *eth = (struct rte_ether_hdr *)p;
+    struct rte_udp_hdr *udp = (struct rte_udp_hdr *)(p + sizeof(struct rte_ether_hdr) + l3Len);
+    if (ipv6)
+    {
+        struct rte_ipv6_hdr *ip6 = (struct rte_ipv6_hdr *)(eth + 1);
+        eth->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV6);
+        ip6->vtc_flow = rte_cpu_to_be_32(6 << 28);
+        ip6->proto = IPPROTO_UDP;
+        ip6->src_addr[0] = ip6->dst_addr[0] = 0x20; // 2001:db8::/32, documentation prefix
+        ip6->src_addr[1] = ip6->dst_addr[1] = 0x01;
+        ip6->src_addr[2] = ip6->dst_addr[2] = 0x0d;
+        ip6->src_addr[3] = ip6->dst_addr[3] = 0xb8;
+        ip6->src_addr[15] = 1;
+        ip6->dst_addr[15] = 2 + (i & 15);
+        m->packet_type = RTE_PTYPE_L2_ETHER | RTE_PTYPE_L3_IPV6 | RTE_PTYPE_L4_UDP;
+    }
+    else
+    {
+        struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(eth + 1);
+        eth->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4);
+        ip->version_ihl = RTE_IPV4_VHL_DEF;
+        ip->next_proto_id = IPPROTO_UDP;
+        ip->src_addr = rte_cpu_to_be_32(0xc0a80001);
+        ip->dst_addr = rte_cpu_to_be_32(0xc0a80002 + (i & 15));
+        m->packet_type = RTE_PTYPE_L2_ETHER | RTE_PTYPE_L3_IPV4 | RTE_PTYPE_L4_UDP;
+    }
+    udp->src_port = rte_cpu_to_be_16(49152 + i);
+    udp->dst_port = rte_cpu_to_be_16(4789);
+    struct rte_ether_hdr *inEth = (struct rte_ether_hdr *)((uint8_t *)(udp + 1) + sizeof(struct rte_vxlan_hdr));
+    struct rte_ipv4_hdr *inIp = (struct rte_ipv4_hdr *)(inEth + 1);
+    struct rte_tcp_hdr *tcp = (struct rte_tcp_hdr *)(inIp + 1);
+    inEth->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4);
+    inIp->version_ihl = RTE_IPV4_VHL_DEF;
+    inIp->next_proto_id = IPPROTO_TCP;
+    inIp->src_addr = rte_cpu_to_be_32(0x0a000001);
+    inIp->dst_addr = rte_cpu_to_be_32(0x0a010000 + i);
+    tcp->src_port = rte_cpu_to_be_16(40000 + i);
+    tcp->dst_port = rte_cpu_to_be_16(5201);
+    m->hash.rss = rte_hash_crc_4byte(i, 0);
+}
+
+/**
+ * @brief time doca_ar_parse_conn over a burst of vxlan packets of one underlay
+ *
+ * Both underlays end in the same 32-byte key, so the rest of the fast path costs the same and only the parsing differs.
+ *
+ * @param cl
+ * @param ipv6
+ */
+static void ct_bench_parse(struct cmdline *cl, int ipv6)
+{
+    struct rte_mempool *pool = rte_mempool_lookup("MBUF_POOL");
+    struct rte_mbuf *pkts[CT_LOOKUP_BULK];
+    struct doca_ar_conn_match matches[CT_LOOKUP_BULK];
+    struct ct_addr6_map map = {.lock = RTE_SPINLOCK_INITIALIZER};
+    uint64_t start, cycles, nbParsed = 0;
+
+    if (pool == NULL || rte_pktmbuf_alloc_bulk(pool, pkts, CT_LOOKUP_BULK) != 0)
+    {
+        cmdline_printf(cl, "no packets for the parse bench\n");
+        return;
+    }
+    // the bench addresses must not take ids of real VTEPs
+    if (ct_addr6_map_init(&map, "CT_BENCH_ADDR6"))
+    {
+        cmdline_printf(cl, "no address table for the parse bench\n");
+        rte_pktmbuf_free_bulk(pkts, CT_LOOKUP_BULK);
+        return;
+    }
+    for (int i = 0; i < CT_LOOKUP_BULK; i++)
+        ct_bench_fill_pkt(pkts[i], ipv6, i);
+    start = rte_rdtsc();
+    for (int r = 0; r < CT_BENCH_PARSE_ROUNDS; r++)
+    {
+        for (int i = 0; i < CT_LOOKUP_BULK; i++)
+        {
+            memset(&matches[i], 0, sizeof(struct doca_ar_conn_match));
+            nbParsed += ct_parse(&map, &matches[i], pkts[i]);
+        }
+    }
+    cycles = rte_rdtsc() - start;
+    ct_addr6_map_free(&map);
+    cmdline_printf(cl, "parse %s underlay: %lu/%lu vxlan, %.1f ns/pkt\n", ipv6 ? "ipv6" : "ipv4",
+                   nbParsed, (uint64_t)CT_BENCH_PARSE_ROUNDS * CT_LOOKUP_BULK,
+                   (double)cycles * 1E9 / rte_get_tsc_hz() / ((double)CT_BENCH_PARSE_ROUNDS * CT_LOOKUP_BULK));
+    rte_pktmbuf_free_bulk(pkts, CT_LOOKUP_BULK);
+}
+
+void doca_ar_conntrack_bench(struct cmdline *cl, uint32_t nbConns)
+{
+    struct rte_mempool_objsz sz;
+    if (nbConns == 0)
+        nbConns = MAX_CONNTRACK;
+    ct_bench_one(cl, "CT_OLD", sizeof(struct ct_bench_legacy_key), sizeof(struct ct_bench_legacy_key), nbConns);
+    ct_bench_one(cl, "CT_NEW", CT_KEY_LEN, sizeof(struct doca_ar_conn_match), nbConns);
+    rte_mempool_calc_obj_size(sizeof(struct doca_ar_conn), 0, &sz);
+    cmdline_printf(cl, "conn record %zuB, %uB per pool object, CT_POOL of %u conns %.1f MB\n",
+                   sizeof(struct doca_ar_conn), sz.total_size, nbConns, (double)sz.total_size * nbConns / 1048576.0);
+    ct_bench_parse(cl, 0);
+    ct_bench_parse(cl, 1);
+}
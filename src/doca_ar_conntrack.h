@@ -11,13 +11,33 @@
 #ifndef DOCA_AR_CONNTRACK_H_
 #define DOCA_AR_CONNTRACK_H_
 #include "doca_ar_env.h"
+#include "doca_ar_wheel.h"
+#include <stddef.h>
+#include <rte_vxlan.h>
 #include <cmdline.h>
 
-#define MAX_CONNTRACK 1 << 14 ///< maximum connections can be stored in rte_mempool and offloaded into eSwitch
+#define MAX_CONNTRACK 1 << 14 ///< default maximum connections can be stored in rte_mempool and offloaded into eSwitch, see --max-conns
+#define CT_EXPIRE_TIME 10     ///< default idle timeout of conn[s]
+#define CT_RECHECK_MS 100     ///< a conn busy with probing or entry insertion is rechecked after this[ms]
+#define CT_LOOKUP_BULK 64     ///< maximum packets parsed and looked up by one doca_ar_find_conn_burst, RTE_HASH_LOOKUP_BULK_MAX
+#define CT_PREFETCH_OFFSET 4  ///< packets parsed ahead of the prefetched headers
+#define CT_VXLAN_OFFSET (sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_udp_hdr)) ///< vxlan header behind the outer headers without options
+#define CT_VXLAN6_OFFSET (sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv6_hdr) + sizeof(struct rte_udp_hdr)) ///< vxlan header behind the outer ipv6 headers without extension headers
+#define CT_INNER_L4_LEN (sizeof(struct rte_vxlan_hdr) + sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr)) ///< inner l4 header behind the vxlan header
+#define MAX_VTEP6 4096 ///< maximum outer ipv6 addresses interned into ids of the conntrack key
+#define CT_MAX_POOLS 16       ///< conn mempools, i.e. the initial one plus at most 15 grows
+#define CT_SHARD_SLACK 1024   ///< extra entries of every shard beyond twice its fair share
+#define CT_MIGRATE_BATCH 1024 ///< conns moved into the bigger table by one aging round of a growing shard
+#define CT_GROW_LOAD 90       ///< load of a shard or the mempools triggering an automatic grow[%]
+#define CT_GROW_CHECK_US 100000 ///< interval of the automatic grow check[us]
 
 /**
- * @brief match of hash table and l4-connection
+ * @brief match of hash table and l4-connection: the outer vxlan 4-tuple, the vni and the inner 5-tuple
  *
+ * Overlay conns between the same pair of VTEPs are told apart by their inner headers, so each of them gets its own path.
+ * The inner fields stay 0 if the inner packet is not ipv4 without options.
+ * On an ipv6 underlay sip and dip are the ids of the outer addresses, see doca_ar_addr6_id, so both underlays share one key.
+ * Only the first CT_KEY_LEN bytes are the key of the hash table, the rss val gives its hash signature and is not compared.
  */
 struct doca_ar_conn_match
 {
@@ -25,32 +45,95 @@ struct doca_ar_conn_match
     uint32_t dip;
     uint16_t sport;
     uint16_t dport;
-    uint32_t rss_val; ///< used to store rss value precomputed by hardware
-} __rte_cache_aligned;
+    uint32_t vni;         ///< vni in network order as in the vxlan header, the low byte is reserved and always 0
+    uint32_t inSip;       ///< the inner fields are 0 unless the inner packet is ipv4 tcp or udp
+    uint32_t inDip;
+    uint16_t inSport;
+    uint16_t inDport;
+    uint8_t inProto;      ///< IPPROTO_TCP or IPPROTO_UDP, 0 otherwise
+    uint8_t ipv6;         ///< the underlay is ipv6, sip and dip are ids of the outer addresses
+    uint8_t reserved[2];  ///< always 0, pads the key to 32 bytes
+    uint32_t rss_val;     ///< used to store rss value precomputed by hardware
+};
+#define CT_KEY_LEN offsetof(struct doca_ar_conn_match, rss_val) ///< 32 bytes compared by the conntrack table
 
-typedef void (*ExpireCallback)(void *arg); ///< user-defined callback function when expiring connection
+struct doca_ar_probe; ///< pending probe of a new conn, see doca_ar_probe.h
 
 /**
- * @brief context of a connection
+ * @brief context of a connection, fields touched by every packet forwarded in software come first
  *
  */
 struct doca_ar_conn
 {
     struct doca_ar_conn_match match;
-    struct doca_flow_pipe_entry *entry; ///< used to store the pointer of doca-flow entry
-    ExpireCallback expireCallback;
-    void *expireCallbackArgs;
-    uint64_t expireTime;
-    uint16_t bestPath; ///< used to store the best path we probed by adptive routing algorithm
+    uint16_t bestPath;                  ///< used to store the best path we probed by adptive routing algorithm
+    uint16_t queue;                     ///< worker owning the conn: its conntrack shard, rx/tx queue and doca-flow pipe queue
+    uint16_t expireTime;                ///< idle timeout[s]
+    uint8_t entryPending;               ///< the entry is queued on the pipe queue and not completed yet
+    uint8_t rerouteTries;               ///< flowlet gap samples taken for the pending reroute
+    uint16_t reroutePath;               ///< faster path waiting for a flowlet gap of the offloaded conn, 0 if none
+    struct doca_flow_pipe_entry *entry; ///< used to store the pointer of doca-flow entry, set once the hardware completed the insertion
+    union
+    {
+        struct doca_ar_probe *probe; ///< not NULL while the conn is waiting for its probe replies, only valid without entryPending
+        uint64_t offloadTsc;         ///< tsc when the entry was queued, only valid with entryPending, a probing conn is never offloaded
+    };
+    uint32_t lastSeen;                  ///< low 32 bits of the wheel tick of the latest packet seen by software
+    uint32_t rerouteHits;               ///< low 32 bits of the entry's packet counter at the latest flowlet gap sample
+    struct doca_ar_wheel_node timer;    ///< lifetime timer on the wheel of the owning worker
+    uint32_t probeRtt[PROBE_PATH_AMOUNT];  ///< measured RTT[ns] of every probed path when the best path was chosen, UINT32_MAX if lost
+    uint16_t probePort[PROBE_PATH_AMOUNT]; ///< src port of every probed path, matching probeRtt
 } __rte_cache_aligned;
 
 /**
- * @brief init connection tracking table and mempool
+ * @brief init one connection tracking table per worker and the shared conn mempool
+ *
+ * RSS steers every packet of a conn onto the same worker, so a shard and its timer wheel are only touched by its worker and need no lock.
+ * If limit is above maxConntrack, a periodic check grows the conntrack when a shard or the mempool is nearly full.
  *
- * @param maxConntrack
+ * @param maxConntrack initial capacity
+ * @param limit maximum capacity the conntrack can grow to at runtime
+ * @param nbShards amount of workers
  * @return int
  */
-int doca_ar_conntrack_init_env(int maxConntrack);
+int doca_ar_conntrack_init_env(uint32_t maxConntrack, uint32_t limit, int nbShards);
+/**
+ * @brief grow the conntrack to a bigger capacity without stopping the workers
+ *
+ * A mempool of the extra conns and a bigger table per shard are created here, then every worker switches its adds
+ * to the new table and migrates its old table in slices within its aging rounds, see doca_ar_conntrack_expire.
+ * Tables drained by an earlier grow are freed here.
+ *
+ * @param capacity new capacity, above the current one and at most the limit
+ * @return int -1 if the capacity is invalid, a shard is still migrating or out of memory
+ */
+int doca_ar_conntrack_grow(uint32_t capacity);
+/**
+ * @brief id of an outer ipv6 address, a new address is interned on the fly
+ *
+ * VTEP addresses are few and live long, so interning them keeps the conntrack key and the conn record as compact as on an ipv4 underlay.
+ * Lookups are lock-free and any worker may intern, ids are never reused.
+ *
+ * @param addr 16 bytes
+ * @return int id, -1 if MAX_VTEP6 addresses are interned already
+ */
+int doca_ar_addr6_id(const uint8_t *addr);
+/**
+ * @brief outer ipv6 address of an id
+ *
+ * @param id
+ * @return const uint8_t* 16 bytes
+ */
+const uint8_t *doca_ar_addr6(uint32_t id);
+/**
+ * @brief print an outer address of a match
+ *
+ * @param buf
+ * @param len
+ * @param addr ipv4 address or id of an ipv6 address
+ * @param ipv6
+ */
+void doca_ar_sprint_addr(char *buf, size_t len, uint32_t addr, uint8_t ipv6);
 /**
  * @brief pasrse conn match from rte_mbuf
  *
@@ -66,28 +149,83 @@ int doca_ar_parse_conn(struct doca_ar_conn_match *match, struct rte_mbuf *m);
  */
 void doca_ar_print_match(struct doca_ar_conn_match *match);
 
+extern struct doca_ar_wheel CT_WHEEL[MAX_WORKERS]; ///< conn lifetime timers of every worker
+
 /**
- * @brief get conn from mempool and add conn into the conntrack table
+ * @brief get conn from mempool and add conn into the conntrack table of a worker, its lifetime timer is armed with CT_EXPIRE_TIME
  *
+ * @param queue worker queue
  * @param match
  * @param bestPath
  * @return struct doca_ar_conn*
  */
-struct doca_ar_conn *doca_ar_add_conn(struct doca_ar_conn_match *match, uint16_t bestPath);
+struct doca_ar_conn *doca_ar_add_conn(uint16_t queue, struct doca_ar_conn_match *match, uint16_t bestPath);
 /**
- * @brief find the conn from conntrack table
+ * @brief find the conn from conntrack table of a worker
  *
+ * @param queue worker queue
  * @param match
  * @return struct doca_ar_conn*
  */
-struct doca_ar_conn *doca_ar_find_conn(struct doca_ar_conn_match *match);
+struct doca_ar_conn *doca_ar_find_conn(uint16_t queue, struct doca_ar_conn_match *match);
+/**
+ * @brief parse a burst of packets, prefetching their headers, and find their conns with one bulk lookup
+ *
+ * The rss val precomputed by hardware gives the hash signature of every key, so the table does not hash again.
+ *
+ * @param queue worker queue
+ * @param pkts
+ * @param nb amount of packets, at most CT_LOOKUP_BULK
+ * @param matches parsed match of every packet
+ * @param conns conn of every hit packet
+ * @param vxlanMask bit i is set if packet i is a vxlan packet and matches[i] is valid
+ * @return uint64_t hit mask, bit i is set if conns[i] is found
+ */
+uint64_t doca_ar_find_conn_burst(uint16_t queue, struct rte_mbuf **pkts, uint16_t nb, struct doca_ar_conn_match *matches,
+                                 struct doca_ar_conn **conns, uint64_t *vxlanMask);
 
 /**
- * @brief del conn from the conntrack table and put back to mempool
+ * @brief mark a conn as seen by software, cheap enough for every packet
  *
  * @param conn
  */
-void doca_ar_del_conn(void *conn);
+static inline void doca_ar_touch_conn(struct doca_ar_conn *conn)
+{
+    conn->lastSeen = (uint32_t)CT_WHEEL[conn->queue].now;
+}
+/**
+ * @brief advance the timer wheel of a worker and handle expired lifetime timers
+ *
+ * A conn which never got offloaded expires after expireTime without packets, an offloaded conn is left to the aging of the flow backend
+ * and only rechecked (or has its path re-evaluated, see doca_ar_reroute_check), a conn busy with probing or entry insertion is rechecked after CT_RECHECK_MS.
+ * A growing shard also moves CT_MIGRATE_BATCH conns into its bigger table here.
+ *
+ * @param queue worker queue
+ * @param budget maximum timers handled, the rest stay on the due list
+ * @return int amount of expired conns
+ */
+int doca_ar_conntrack_expire(uint16_t queue, int budget);
+/**
+ * @brief amount of expired lifetime timers waiting to be handled
+ *
+ * @param queue worker queue
+ * @return uint32_t
+ */
+uint32_t doca_ar_conntrack_backlog(uint16_t queue);
+/**
+ * @brief conns taken from CT_POOLS, i.e. the occupancy of the conntrack, read without locking the datapath
+ *
+ * @param capacity current capacity of the conntrack, may be NULL
+ * @return uint32_t
+ */
+uint32_t doca_ar_conntrack_in_use(uint32_t *capacity);
+
+/**
+ * @brief del conn from the conntrack table, cancel its lifetime timer and put back to mempool
+ *
+ * @param conn
+ */
+void doca_ar_del_conn(struct doca_ar_conn *conn);
 
 /**
  * @brief modify the sport of conn and offload cksum
@@ -97,10 +235,18 @@ void doca_ar_del_conn(void *conn);
  */
 void doca_ar_modify_conn(struct doca_ar_conn *conn, struct rte_mbuf *m);
 /**
- * @brief iterate the whole conntrack table and print all conns info onto cmdline
+ * @brief iterate the conntrack tables of all workers and print all conns info onto cmdline
  *
  * @param cl
  */
 void doca_ar_dump_conn(struct cmdline *cl);
+/**
+ * @brief compare memory footprint and bulk lookup rate of the former 64-byte key and the compact 32-byte overlay key with temporary tables,
+ * and the parsing cost of an ipv4 and an ipv6 underlay, run it before traffic
+ *
+ * @param cl
+ * @param nbConns amount of conns inserted, e.g. MAX_CONNTRACK or 1M
+ */
+void doca_ar_conntrack_bench(struct cmdline *cl, uint32_t nbConns);
 
 #endif /* DOCA_AR_CONNTRACK_H_ */
\ No newline at end of file
@@ -11,6 +11,12 @@
 #include "doca_ar_core.h"
 #include "doca_ar_conntrack.h"
 #include "doca_ar_pipe.h"
+#include "doca_ar_probe.h"
+#include "doca_ar_path.h"
+#include "doca_ar_prober.h"
+#include "doca_ar_reroute.h"
+#include "doca_ar_stats.h"
+#include "doca_ar_metrics.h"
 
 #include <cmdline_rdline.h>
 #include <cmdline_parse.h>
@@ -26,255 +32,314 @@
 
 DOCA_LOG_REGISTER(DOCA_AR_CORE);
 #define PACKET_BURST 128    ///< num of tx_burst and rx_burst
-#define EXPIRE_TIME 10      ///< default timeout of conn
-#define PROBE_PATH_AMOUNT 4 ///< default probed paths amount and packets amount we sent
-#define PROBE_TIMEOUT 50    ///< Probe Timeout[ms]
+
+volatile bool force_quit = false;                        ///< flag of quit
+unsigned int prober_lcore_id = 0;                        ///< id of lcore running the prober
 
 /**
- * @brief packets num the control plane recv and sent
+ * @brief print packets num the control plane recv and sent
  *
+ * @param cl
  */
-struct PortStats
+void printPortStats(struct cmdline *cl)
 {
-    uint64_t rx;
-    uint64_t tx;
-} __rte_cache_aligned;
+    struct doca_ar_stats total, s;
+    doca_ar_stats_total(&total);
+    for (int i = 0; i < NB_PORTS; i++)
+    {
+        cmdline_printf(cl, "Port %d: RX-Pkts:%16lu TX-Pkts:%16lu Drop-Pkts:%16lu\n", i, total.rx[i], total.tx[i], total.drop[i]);
+        if (nb_workers == 1)
+            continue;
+        for (unsigned int slot = 0; slot < STATS_SLOTS; slot++)
+        {
+            if (doca_ar_stats_snapshot(slot, &s) && (s.rx[i] || s.tx[i] || s.drop[i]))
+                cmdline_printf(cl, "    Lcore %u: RX-Pkts:%16lu TX-Pkts:%16lu Drop-Pkts:%16lu\n", slot, s.rx[i], s.tx[i], s.drop[i]);
+        }
+    }
+}
 
 /**
- * @brief the user-defined probe packets header
+ * @brief print all the counters of every lcore and their sum
  *
+ * @param cl
  */
-struct PROBE_HDR
+void printStats(struct cmdline *cl)
 {
-    uint64_t timeStamp;
-    uint64_t FlowID; ///< used to distinguish probe packets we sent just now, packets sent before will be discarded
-};
+    struct doca_ar_stats s;
+    cmdline_printf(cl, "%-6s %12s %12s %10s %10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "Lcore", "RX", "TX", "Drop",
+                   "NewConn", "ConnFail", "ProbeTx", "ProbeRx", "ProbeTmo", "PathSw", "OffldOk", "OffldFail", "Aged");
+    for (unsigned int slot = 0; slot <= STATS_SLOTS; slot++)
+    {
+        if (slot == STATS_SLOTS)
+            doca_ar_stats_total(&s);
+        else if (!doca_ar_stats_snapshot(slot, &s))
+            continue;
+        char name[8] = "Total";
+        if (slot == RTE_MAX_LCORE)
+            snprintf(name, sizeof(name), "%s", "Other");
+        else if (slot < RTE_MAX_LCORE)
+            snprintf(name, sizeof(name), "%u", slot);
+        cmdline_printf(cl, "%-6s %12lu %12lu %10lu %10lu %10lu %10lu %10lu %10lu %10lu %10lu %10lu %10lu\n", name,
+                       s.rx[to_host_port] + s.rx[to_net_port], s.tx[to_host_port] + s.tx[to_net_port], s.drop[to_host_port] + s.drop[to_net_port],
+                       s.newConns, s.connFails, s.probeSent, s.probeRcvd, s.probeTimeout, s.pathSwitch, s.offloadOk, s.offloadFail, s.aged);
+    }
+}
+
 /**
- * @brief Load balancing scheme we used
+ * @brief print the percentiles of every histogram summed over the lcores
  *
+ * @param cl
  */
-enum LB_SCHEME
+void printHist(struct cmdline *cl)
 {
-    DOCA_AR, ///< use doca-ar
-    ECMP     ///< use ecmp
-};
-
-volatile bool force_quit = false;           ///< flag of quit
-unsigned int runing_lore_id = 0;            ///< id of lcore processing packets
-struct PortStats portStats[NB_PORTS] = {0}; ///< packets num the control plane recv and sent
-enum LB_SCHEME lb_scheme = ECMP;            ///< Load balancing scheme we used
+    struct doca_ar_hist h;
+    cmdline_printf(cl, "%-16s %12s %10s %10s %10s %10s %10s %10s\n", "Latency[us]", "Count", "Mean", "P50", "P90", "P99", "P99.9", "Max");
+    for (int id = 0; id < HIST_MAX; id++)
+    {
+        uint64_t count = doca_ar_hist_snapshot(id, &h);
+        if (count == 0)
+            continue;
+        cmdline_printf(cl, "%-16s %12lu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", doca_ar_hist_name(id), count, h.sum / 1000.0 / count,
+                       doca_ar_hist_quantile(&h, count, 0.5) / 1000.0, doca_ar_hist_quantile(&h, count, 0.9) / 1000.0,
+                       doca_ar_hist_quantile(&h, count, 0.99) / 1000.0, doca_ar_hist_quantile(&h, count, 0.999) / 1000.0, h.max / 1000.0);
+    }
+}
 
 /**
- * @brief print packets num the control plane recv and sent
+ * @brief print aging counters of every worker
  *
  * @param cl
  */
-void printPortStats(struct cmdline *cl)
+void printAgingStats(struct cmdline *cl)
 {
-    for (int i = 0; i < NB_PORTS; i++)
+    for (int q = 0; q < nb_workers; q++)
     {
-        cmdline_printf(cl, "Port %d: RX-Pkts:%16lu TX-Pkts:%16lu\n", i, portStats[i].rx, portStats[i].tx);
+        const struct doca_ar_aging_stats *s = doca_ar_flow_aging_stats(q);
+        cmdline_printf(cl, "Worker %d: Rounds:%12lu FullRounds:%12lu HwAged:%12lu SwExpired:%12lu Backlog:%8u Budget:%6u Timers:%8u\n",
+                       q, s->rounds, s->fullRounds, s->hwAged, s->swExpired, s->backlog, s->budget, CT_WHEEL[q].nbArmed);
     }
 }
 
-/* OvS flow for sending back probe packets in receiver DPU
-ovs-ofctl del-flows ovsbr1
-ovs-ofctl add-flow ovsbr1 "priority=300,in_port=p0,udp,tp_dst=4789,nw_tos=0x20 actions=mod_dl_dst:08:c0:eb:bf:ef:9a,mod_tp_dst:4788,output:IN_PORT"
-ovs-ofctl add-flow ovsbr1 "priority=100,in_port=p0 actions=output:pf0hpf"
-ovs-ofctl add-flow ovsbr1 "priority=100,in_port=pf0hpf actions=output:p0"
-*/
-
 /**
- * @brief the ar algorithm we used in doca-ar, this is the most critical function the whole app
+ * @brief print rerouting counters of every worker
  *
- * @param pool packets mempool
- * @param match the match of new conn
- * @param m  packet of this new conn
- * @return uint16_t the best path we probed and the final src port of this new conn
+ * @param cl
  */
-uint16_t AR(struct rte_mempool *pool, struct doca_ar_conn_match *match, struct rte_mbuf *m)
+void printRerouteStats(struct cmdline *cl)
 {
-    struct rte_mbuf *mbufs[PROBE_PATH_AMOUNT];
-    int count = rte_pktmbuf_alloc_bulk(pool, mbufs, PROBE_PATH_AMOUNT) == 0 ? PROBE_PATH_AMOUNT : 0;
-    int port_id = to_net_port;
-    uint64_t flowID = rte_rdtsc();
-
-    struct rte_ether_hdr *this_ether_h = rte_pktmbuf_mtod_offset(m, struct rte_ether_hdr *, 0);
-    struct rte_ipv4_hdr *this_ip = rte_pktmbuf_mtod_offset(m, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
-    struct rte_udp_hdr *this_udp_h = rte_pktmbuf_mtod_offset(m, struct rte_udp_hdr *, sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr));
-
-    for (int p = 0; p < count; p++)
+    if (!ar_config.rerouteIntervalMs)
     {
-        struct rte_ether_hdr *ether_h;
-        struct rte_ipv4_hdr *ip;
-        struct rte_udp_hdr *udp_h;
-        struct PROBE_HDR *pay;
-        /**Ether**/
-        ether_h = (struct rte_ether_hdr *)rte_pktmbuf_append(mbufs[p], sizeof(struct rte_ether_hdr));
-        rte_memcpy(ether_h, this_ether_h, sizeof(struct rte_ether_hdr));
-        /**IP**/
-        ip = (struct rte_ipv4_hdr *)rte_pktmbuf_append(mbufs[p], sizeof(struct rte_ipv4_hdr));
-        rte_memcpy(ip, this_ip, sizeof(struct rte_ipv4_hdr));
-        ip->version_ihl = 0x45;
-        ip->type_of_service = 0x20;
-        ip->total_length = htons(sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_udp_hdr) + sizeof(struct PROBE_HDR));
-        ip->packet_id = 0;
-        ip->fragment_offset = 0;
-        ip->time_to_live = 64; // ttl = 64
-        ip->next_proto_id = IPPROTO_UDP;
-        ip->hdr_checksum = 0;
-        /**UDP**/
-        udp_h = (struct rte_udp_hdr *)rte_pktmbuf_append(mbufs[p], sizeof(struct rte_udp_hdr));
-        rte_memcpy(udp_h, this_udp_h, sizeof(struct rte_udp_hdr));
-        udp_h->src_port = rte_cpu_to_be_16(rte_be_to_cpu_16(this_udp_h->src_port) + p);
-        udp_h->dgram_cksum = 0;
-        udp_h->dgram_len = rte_cpu_to_be_16(sizeof(struct PROBE_HDR));
-        /**Payload**/
-        pay = (struct PROBE_HDR *)rte_pktmbuf_append(mbufs[p], sizeof(struct PROBE_HDR));
-        pay->timeStamp = rte_rdtsc();
-        pay->FlowID = flowID;
-        /**offload cksum**/
-        mbufs[p]->l2_len = sizeof(struct rte_ether_hdr);
-        mbufs[p]->l3_len = sizeof(struct rte_ipv4_hdr);
-        mbufs[p]->ol_flags |= PKT_TX_IPV4 | PKT_TX_IP_CKSUM | PKT_TX_UDP_CKSUM;
+        cmdline_printf(cl, "Rerouting is off, see --reroute-interval and --lb-scheme flowlet\n");
+        return;
     }
-    int nb_tx = rte_eth_tx_burst(port_id, 0, mbufs, count);
-    // DOCA_LOG_INFO("Sent %d Probe Packets", count);
-    if (unlikely(nb_tx < count))
+    for (int q = 0; q < nb_workers; q++)
     {
-        do
-        {
-            rte_pktmbuf_free(mbufs[nb_tx]);
-        } while (++nb_tx < count);
+        const struct doca_ar_reroute_stats *s = doca_ar_reroute_stats(q);
+        cmdline_printf(cl, "Worker %d: Checks:%12lu Pending:%12lu Rerouted:%12lu NoGap:%12lu Flowlets:%12lu Deferred:%12lu ModFail:%12lu\n",
+                       q, s->checks, s->pending, s->rerouted, s->noGap, s->flowlets, s->deferred, s->modFail);
     }
+}
 
-    uint64_t start = rte_rdtsc(), gap = PROBE_TIMEOUT * rte_get_tsc_hz() / 1000;
-    while (rte_rdtsc() - start < gap)
+/**
+ * @brief print the noise floor of the tsc and the NIC clock per worker: mean RTT difference of back-to-back replies on the same path and minimum RTT
+ *
+ * @param cl
+ */
+void printProbeNoise(struct cmdline *cl)
+{
+    if (ar_config.proberIntervalMs || ar_config.probeRounds < 2)
     {
-        int nb_rx = rte_eth_rx_burst(port_id, 0, mbufs, PROBE_PATH_AMOUNT);
-        portStats[port_id].rx += nb_rx;
-        for (int i = 0; i < nb_rx; i++)
-        {
-            struct rte_mbuf *m = mbufs[i];
-            if (RTE_ETH_IS_IPV4_HDR(m->packet_type))
-            {
-                struct rte_ipv4_hdr *ip = rte_pktmbuf_mtod_offset(m, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
-                if (ip->next_proto_id == 17)
-                {
-                    struct rte_udp_hdr *udp = rte_pktmbuf_mtod_offset(m, struct rte_udp_hdr *, sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr));
-                    if (udp->dst_port == rte_cpu_to_be_16(4788))
-                    {
-                        struct PROBE_HDR *hdr = rte_pktmbuf_mtod_offset(m, struct PROBE_HDR *, sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_udp_hdr));
-                        if (hdr->FlowID == flowID)
-                        {
-                            uint16_t res = udp->src_port;
-                            if (this_udp_h->src_port != udp->src_port)
-                                DOCA_LOG_INFO("FlowTD[%lu]:%d==>%d", flowID, rte_be_to_cpu_16(this_udp_h->src_port), rte_be_to_cpu_16(udp->src_port));
-                            rte_pktmbuf_free(m);
-                            return res;
-                        }
-                    }
-                }
-            }
-            rte_pktmbuf_free(m);
-        }
+        cmdline_printf(cl, "The noise floor is measured by on-demand probing with --probe-rounds 2 or more\n");
+        return;
+    }
+    for (int q = 0; q < nb_workers; q++)
+    {
+        const struct doca_ar_probe_noise *n = doca_ar_probe_noise(q);
+        cmdline_printf(cl, "Worker %d: TSC Pairs:%10lu Noise:%8lu ns Min:%8u ns | HW Pairs:%10lu Noise:%8lu ns Min:%8u ns\n",
+                       q, n->tscPairs, n->tscPairs ? n->tscDiff / n->tscPairs : 0, n->tscMin == UINT32_MAX ? 0 : n->tscMin,
+                       n->hwPairs, n->hwPairs ? n->hwDiff / n->hwPairs : 0, n->hwMin == UINT32_MAX ? 0 : n->hwMin);
     }
-    DOCA_LOG_ERR("Probe Timeout: Not Find Best Path for Not Received Probe Packets");
-    doca_ar_print_match(match);
-    return match->sport;
 }
 
 /**
  * @brief logic of processing control plane packets
  *
- * @param args
+ * @param args queue index of this worker
  * @return int
  */
 int process_packets(void *args)
 {
-    int nb_rx = 0, nb_tx = 0;
-    int ingress_port = to_host_port, egress_port = to_net_port, queue_index = 0;
+    int nb_rx = 0, nb_tx = 0, nb_fwd = 0;
+    int ingress_port = to_host_port, egress_port = to_net_port;
+    uint16_t queue_index = (uint16_t)(uintptr_t)args;
+    struct doca_ar_stats *stats = doca_ar_stats();
     struct rte_mbuf *packets[PACKET_BURST];
+    struct rte_mbuf *fwdPackets[PACKET_BURST * 2]; ///< packets forwarded in this loop and parked packets released by probes
+    struct doca_ar_conn_match matches[CT_LOOKUP_BULK];
+    struct doca_ar_conn *conns[CT_LOOKUP_BULK];
 
-    struct rte_mempool *pool = rte_mempool_lookup("MBUF_POOL");
-    if (pool == NULL)
-    {
-        DOCA_LOG_ERR("Cannot find packet mempool ERR");
-        return 0;
-    }
-    else
-        DOCA_LOG_INFO("Find out packet mempool success and start DOCA_AR on core %d", rte_lcore_id());
+    DOCA_LOG_INFO("Start DOCA_AR on core %d queue %u", rte_lcore_id(), queue_index);
     while (!force_quit)
     {
         /***********Ingress process**********************/
         nb_rx = rte_eth_rx_burst(ingress_port, queue_index, packets, PACKET_BURST);
-        portStats[ingress_port].rx += nb_rx;
-        for (int i = 0; i < nb_rx; i++)
+        stats->rx[ingress_port] += nb_rx;
+        nb_fwd = 0;
+        // parse and look up CT_LOOKUP_BULK packets at once, only misses take the new-flow path
+        for (int base = 0; base < nb_rx; base += CT_LOOKUP_BULK)
         {
-            struct doca_ar_conn_match match = {0};
-            if (doca_ar_parse_conn(&match, packets[i]))
+            uint16_t nb = RTE_MIN(nb_rx - base, CT_LOOKUP_BULK);
+            uint64_t vxlanMask, hitMask = doca_ar_find_conn_burst(queue_index, &packets[base], nb, matches, conns, &vxlanMask);
+            int nbAdded = 0; ///< conns added from this chunk, a later packet of the same conn missed in the bulk lookup too
+            for (int i = 0; i < nb; i++)
             {
-                // doca_ar_print_match(&match);
-                struct doca_ar_conn *thisConn = doca_ar_find_conn(&match);
-                if (thisConn == NULL)
+                struct rte_mbuf *pkt = packets[base + i];
+                if (vxlanMask & (1ULL << i))
                 {
-                    uint16_t bestPath = lb_scheme == DOCA_AR ? AR(pool, &match, packets[i]) : match.sport;
-                    thisConn = doca_ar_add_conn(&match, bestPath);
-                    if (thisConn)
+                    // doca_ar_print_match(&matches[i]);
+                    struct doca_ar_conn *thisConn = (hitMask & (1ULL << i)) ? conns[i] : (nbAdded ? doca_ar_find_conn(queue_index, &matches[i]) : NULL);
+                    if (thisConn == NULL)
                     {
-                        // DOCA_LOG_INFO("New Conn to best Path %d", rte_be_to_cpu_16(bestPath));
+                        uint64_t born = rte_rdtsc();
+                        thisConn = doca_ar_add_conn(queue_index, &matches[i], matches[i].sport);
+                        nbAdded += thisConn != NULL;
+                        if (thisConn)
+                        {
+                            stats->newConns++;
+                            // expireTime defaults to CT_EXPIRE_TIME, the conn is deleted by aging
+                            if (ar_config.lbScheme != ECMP && ar_config.proberIntervalMs)
+                            {
+                                // the prober keeps the path table fresh, a new conn only looks it up
+                                doca_ar_path_choose(thisConn);
+                                doca_ar_prober_announce(thisConn, pkt);
+                            }
+                            // fresh RTT in the path table saves probing, otherwise the conn keeps its original path until the probe is resolved
+                            else if (ar_config.lbScheme != ECMP && !doca_ar_path_choose(thisConn) && doca_ar_probe_start(thisConn, pkt) == 0)
+                                continue;
+                            // decided without waiting for probe replies, probed conns are timed when the probe is resolved
+                            if (ar_config.lbScheme != ECMP)
+                                doca_ar_hist_record(HIST_SETUP, doca_ar_stats_ns(rte_rdtsc() - born));
+                        }
+                        else
+                        {
+                            stats->connFails++;
+                            DOCA_LOG_ERR("Add conn fail");
+                            fwdPackets[nb_fwd++] = pkt;
+                            continue;
+                        }
                     }
                     else
                     {
-                        DOCA_LOG_ERR("Add conn fail");
-                        continue;
+                        doca_ar_touch_conn(thisConn); // keeps a conn not offloaded yet alive on the timer wheel
+                        if (!thisConn->entryPending && thisConn->probe != NULL)
+                        {
+                            // forwarding a packet beyond a full park queue would overtake the parked ones, so it is dropped
+                            if (doca_ar_probe_park(thisConn, pkt) < 0)
+                            {
+                                stats->drop[egress_port]++;
+                                rte_pktmbuf_free(pkt);
+                            }
+                            continue;
+                        }
+                    }
+
+                    if (thisConn->entry == NULL && !thisConn->entryPending && thisConn->probe == NULL)
+                    {
+                        doca_ar_add_new_flow(thisConn);
                     }
+
+                    doca_ar_modify_conn(thisConn, pkt);
                 }
                 else
                 {
-                    // DOCA_LOG_INFO("Old Conn to best Path %d", rte_be_to_cpu_16(thisConn->bestPath));
-                }
-
-                if (thisConn->entry == NULL)
-                {
-                    thisConn->expireTime = EXPIRE_TIME;
-                    thisConn->expireCallback = doca_ar_del_conn;
-                    thisConn->expireCallbackArgs = (void *)thisConn;
-                    doca_ar_add_new_flow(thisConn);
+                    DOCA_LOG_ERR("Recv Non-VXLAN Packtes ERR");
                 }
-
-                doca_ar_modify_conn(thisConn, packets[i]);
-            }
-            else
-            {
-                DOCA_LOG_ERR("Recv Non-VXLAN Packtes ERR");
+                fwdPackets[nb_fwd++] = pkt;
             }
         }
+        doca_ar_flow_commit(queue_index); // one entries_process for all the new conns of the burst
+        doca_ar_probe_flush(queue_index); // one tx_burst for the probes of all the new conns of the burst
+        nb_fwd += doca_ar_probe_drain(queue_index, &fwdPackets[nb_fwd], PACKET_BURST * 2 - nb_fwd);
 
         /***********Egress process*********************/
-        nb_tx = rte_eth_tx_burst(egress_port, queue_index, packets, nb_rx);
-        portStats[egress_port].tx += nb_tx;
-        if (unlikely(nb_tx < nb_rx))
+        nb_tx = rte_eth_tx_burst(egress_port, queue_index, fwdPackets, nb_fwd);
+        stats->tx[egress_port] += nb_tx;
+        if (unlikely(nb_tx < nb_fwd))
         {
+            stats->drop[egress_port] += nb_fwd - nb_tx;
             do
             {
-                rte_pktmbuf_free(packets[nb_tx]);
-            } while (++nb_tx < nb_rx);
+                rte_pktmbuf_free(fwdPackets[nb_tx]);
+            } while (++nb_tx < nb_fwd);
         }
-        doca_ar_flow_aging();
-        /*************Left Probe pkts Process******************/
-        // this step cannot be ignored cause large accumulation of probed packets will easily cause timeout of probing
-        nb_rx = rte_eth_rx_burst(egress_port, queue_index, packets, PACKET_BURST);
-        portStats[egress_port].rx += nb_rx;
-        for (int i = 0; i < nb_rx; i++)
+        doca_ar_flow_aging(queue_index); // runs once per AGING_INTERVAL_US
+        /*************Probe pkts Process******************/
+        if (ar_config.flowBackend == FLOW_BACKEND_SW)
         {
-            rte_pktmbuf_free(packets[i]);
+            // the emulated hairpin and rss of to_net_port run in the rx callback of this queue, no pipe delivers here
+            nb_rx = rte_eth_rx_burst(egress_port, queue_index, packets, PACKET_BURST);
+            for (int i = 0; i < nb_rx; i++)
+                rte_pktmbuf_free(packets[i]);
         }
+        // probe replies come on probe_queue and are matched against pending probes here, the lcore never waits for them
+        stats->rx[egress_port] += doca_ar_probe_poll(queue_index);
+        doca_ar_stats_publish();
     }
+    doca_ar_stats_publish();
     DOCA_LOG_INFO("lcore %d quit from packet processing", rte_lcore_id());
     return 0;
 }
 
+/**
+ * @brief --role reflector: send the probes delivered by reflectorPipe back to their sender
+ *
+ * @param args queue index of this worker
+ * @return int
+ */
+int process_reflect(void *args)
+{
+    int nb_rx = 0, nb_tx = 0, nb_fwd = 0;
+    uint16_t queue_index = (uint16_t)(uintptr_t)args;
+    struct doca_ar_stats *stats = doca_ar_stats();
+    struct rte_mbuf *packets[PACKET_BURST];
+    struct rte_mbuf *fwdPackets[PACKET_BURST];
+
+    DOCA_LOG_INFO("Start DOCA_AR reflector on core %d queue %u", rte_lcore_id(), queue_index);
+    while (!force_quit)
+    {
+        nb_rx = rte_eth_rx_burst(to_net_port, queue_index, packets, PACKET_BURST);
+        stats->rx[to_net_port] += nb_rx;
+        nb_fwd = 0;
+        for (int i = 0; i < nb_rx; i++)
+        {
+            if (doca_ar_probe_reflect(packets[i]) == 0)
+                fwdPackets[nb_fwd++] = packets[i];
+            else
+                rte_pktmbuf_free(packets[i]);
+        }
+        doca_ar_probe_stamp_reflect(fwdPackets, nb_fwd);
+        nb_tx = rte_eth_tx_burst(to_net_port, queue_index, fwdPackets, nb_fwd);
+        stats->tx[to_net_port] += nb_tx;
+        stats->probeRcvd += nb_fwd;
+        if (unlikely(nb_tx < nb_fwd))
+        {
+            stats->drop[to_net_port] += nb_fwd - nb_tx;
+            do
+            {
+                rte_pktmbuf_free(fwdPackets[nb_tx]);
+            } while (++nb_tx < nb_fwd);
+        }
+        // upstream_hairpinPipe forwards everything, only the software pipes need this queue polled
+        nb_rx = rte_eth_rx_burst(to_host_port, queue_index, packets, PACKET_BURST);
+        for (int i = 0; i < nb_rx; i++)
+            rte_pktmbuf_free(packets[i]);
+        doca_ar_stats_publish();
+    }
+    doca_ar_stats_publish();
+    DOCA_LOG_INFO("lcore %d quit from probe reflecting", rte_lcore_id());
+    return 0;
+}
+
 /********************************dpdk cmdline***************************************/
 struct cmd_simple_result
 {
@@ -288,30 +353,58 @@ static void cmd_simple_parsed(__rte_unused void *parsed_result,
     if (strcmp(res->simple, "quit") == 0)
     {
         force_quit = true;
-        rte_eal_wait_lcore(runing_lore_id);
+        rte_eal_mp_wait_lcore(); // workers and prober
         cmdline_printf(cl, "Quit from the app......\n");
         cmdline_quit(cl);
     }
+    if (ar_config.role == ROLE_REFLECTOR && strcmp(res->simple, "portStats") != 0 && strcmp(res->simple, "stats") != 0)
+    {
+        cmdline_printf(cl, "Only quit/portStats/stats with --role reflector\n");
+        return;
+    }
     if (strcmp(res->simple, "dumpFDB") == 0)
     {
-        for (int i = 0; i < NB_PORTS; i++)
-            doca_flow_port_pipes_dump(ports[i], stdout);
+        doca_ar_flow_dump(stdout);
     }
     if (strcmp(res->simple, "portStats") == 0)
     {
         printPortStats(cl);
     }
+    if (strcmp(res->simple, "stats") == 0)
+    {
+        printStats(cl);
+    }
+    if (strcmp(res->simple, "hist") == 0)
+    {
+        printHist(cl);
+    }
     if (strcmp(res->simple, "conntrack") == 0)
     {
         doca_ar_dump_conn(cl);
     }
+    if (strcmp(res->simple, "paths") == 0)
+    {
+        doca_ar_dump_path(cl);
+    }
+    if (strcmp(res->simple, "aging") == 0)
+    {
+        printAgingStats(cl);
+    }
+    if (strcmp(res->simple, "reroute") == 0)
+    {
+        printRerouteStats(cl);
+    }
+    if (strcmp(res->simple, "probenoise") == 0)
+    {
+        printProbeNoise(cl);
+    }
 }
 cmdline_parse_token_string_t cmd_simple =
-    TOKEN_STRING_INITIALIZER(struct cmd_simple_result, simple, "quit#dumpFDB#portStats#conntrack");
+    TOKEN_STRING_INITIALIZER(struct cmd_simple_result, simple, "quit#dumpFDB#portStats#stats#hist#conntrack#paths#aging#reroute#probenoise");
 cmdline_parse_inst_t simple_cmdline = {
     .f = cmd_simple_parsed, /* function to call */
     .data = NULL,           /* 2nd arg of func */
-    .help_str = "quit/dumpFDB/portStats/conntrack",
+    .help_str = "quit/dumpFDB/portStats/stats/hist/conntrack/paths/aging/reroute/probenoise",
     .tokens = {
         /* token list, NULL terminated */
         (void *)&cmd_simple,
@@ -319,8 +412,69 @@ cmdline_parse_inst_t simple_cmdline = {
     },
 };
 
+struct cmd_ctbench_result
+{
+    cmdline_fixed_string_t ctbench;
+    uint32_t nbConns;
+};
+static void cmd_ctbench_parsed(void *parsed_result,
+                               struct cmdline *cl,
+                               __rte_unused void *data)
+{
+    struct cmd_ctbench_result *res = parsed_result;
+    doca_ar_conntrack_bench(cl, res->nbConns);
+}
+cmdline_parse_token_string_t cmd_ctbench =
+    TOKEN_STRING_INITIALIZER(struct cmd_ctbench_result, ctbench, "ctbench");
+cmdline_parse_token_num_t cmd_ctbench_nb =
+    TOKEN_NUM_INITIALIZER(struct cmd_ctbench_result, nbConns, RTE_UINT32);
+cmdline_parse_inst_t ctbench_cmdline = {
+    .f = cmd_ctbench_parsed,
+    .data = NULL,
+    .help_str = "ctbench <conns>: footprint and lookup rate of the former and the compact conntrack key",
+    .tokens = {
+        (void *)&cmd_ctbench,
+        (void *)&cmd_ctbench_nb,
+        NULL,
+    },
+};
+
+struct cmd_ctgrow_result
+{
+    cmdline_fixed_string_t ctgrow;
+    uint32_t capacity;
+};
+static void cmd_ctgrow_parsed(void *parsed_result,
+                              struct cmdline *cl,
+                              __rte_unused void *data)
+{
+    struct cmd_ctgrow_result *res = parsed_result;
+    if (ar_config.role == ROLE_REFLECTOR)
+        cmdline_printf(cl, "No conntrack with --role reflector\n");
+    else if (doca_ar_conntrack_grow(res->capacity))
+        cmdline_printf(cl, "Grow conntrack fail, see the log\n");
+    else
+        cmdline_printf(cl, "Conntrack grows to %u conns, the workers migrate their shards in the background\n", res->capacity);
+}
+cmdline_parse_token_string_t cmd_ctgrow =
+    TOKEN_STRING_INITIALIZER(struct cmd_ctgrow_result, ctgrow, "ctgrow");
+cmdline_parse_token_num_t cmd_ctgrow_nb =
+    TOKEN_NUM_INITIALIZER(struct cmd_ctgrow_result, capacity, RTE_UINT32);
+cmdline_parse_inst_t ctgrow_cmdline = {
+    .f = cmd_ctgrow_parsed,
+    .data = NULL,
+    .help_str = "ctgrow <conns>: grow the conntrack capacity up to --max-conns-limit",
+    .tokens = {
+        (void *)&cmd_ctgrow,
+        (void *)&cmd_ctgrow_nb,
+        NULL,
+    },
+};
+
 cmdline_parse_ctx_t main_ctx[] = {
     &simple_cmdline,
+    &ctbench_cmdline,
+    &ctgrow_cmdline,
     NULL};
 /**************************************************************************/
 
@@ -333,35 +487,86 @@ void doca_ar_cmd()
     struct cmdline *cl = cmdline_stdin_new(main_ctx, "DOCA-AR-ENV@localhost:~$ ");
     if (cl == NULL)
         rte_exit(EXIT_FAILURE, "Cannot create cmdline instance\n");
-    cmdline_interact(cl);
+    if (!doca_ar_metrics_enabled())
+        cmdline_interact(cl);
+    else
+    {
+        // the main lcore takes turns between the cmdline and the scrapers, the workers are never disturbed
+        while (!force_quit)
+        {
+            int ret = cmdline_poll(cl);
+            if (ret < 0 || ret == RDLINE_EXITED)
+                break;
+            if (doca_ar_metrics_poll() == 0)
+                rte_delay_us_sleep(METRICS_POLL_US);
+        }
+        doca_ar_metrics_destroy();
+    }
     cmdline_stdin_exit(cl);
 }
 
 void doca_ar()
 {
-    if (rte_lcore_count() <= 1)
+    unsigned int worker_lcore_id = 0;
+    int queue = 0;
+    if (doca_ar_stats_init() < 0)
+        rte_exit(EXIT_FAILURE, "Cannot create histograms\n");
+    if (doca_ar_metrics_init() < 0)
+        rte_exit(EXIT_FAILURE, "Cannot serve metrics\n");
+    if (ar_config.role == ROLE_REFLECTOR)
     {
-        DOCA_LOG_ERR("Not Enough Core ERR ( should >=2 )");
+        DOCA_LOG_INFO("Running DOCA-AR Probe Reflector on %d workers", nb_workers);
+        doca_ar_probe_ts_init();
+        RTE_LCORE_FOREACH_WORKER(worker_lcore_id)
+        {
+            if (queue < nb_workers)
+                rte_eal_remote_launch(process_reflect, (void *)(uintptr_t)queue++, worker_lcore_id);
+        }
+        rte_delay_ms(200);
+        doca_ar_cmd();
         return;
     }
-    if (rte_lcore_count() == 2)
+    // main + workers (+ prober), nb_workers is derived from the lcores in doca_ar_env_init
+    if (ar_config.lbScheme == DOCA_AR)
+    {
+        DOCA_LOG_INFO("Running DOCA-AR Load Balancing Scheme on %d workers", nb_workers);
+    }
+    else if (ar_config.lbScheme == FLOWLET)
     {
-        lb_scheme = DOCA_AR;
-        DOCA_LOG_INFO("Running DOCA-AR Load Balancing Scheme");
+        DOCA_LOG_INFO("Running DOCA-AR Flowlet Load Balancing Scheme on %d workers, flowlet gap %u us", nb_workers, ar_config.flowletGapUs);
     }
     else
     {
-        DOCA_LOG_INFO("Running ECMP Load Balancing Scheme");
+        DOCA_LOG_INFO("Running ECMP Load Balancing Scheme on %d workers", nb_workers);
     }
-    if (doca_ar_conntrack_init_env(MAX_CONNTRACK))
+    if (doca_ar_conntrack_init_env(ar_config.maxConns, ar_config.maxConnsLimit, nb_workers))
     {
         return;
     }
-    RTE_LCORE_FOREACH_WORKER(runing_lore_id)
+    if (doca_ar_probe_init_env(MAX_PENDING_PROBE, nb_workers))
     {
-        break;
+        return;
+    }
+    if (doca_ar_path_init_env(MAX_PATH_DST))
+    {
+        return;
+    }
+    if (ar_config.proberIntervalMs && doca_ar_prober_init_env())
+    {
+        return;
+    }
+    // worker i owns queue i, the lcore after the workers runs the prober
+    RTE_LCORE_FOREACH_WORKER(worker_lcore_id)
+    {
+        if (queue < nb_workers)
+            rte_eal_remote_launch(process_packets, (void *)(uintptr_t)queue++, worker_lcore_id);
+        else if (ar_config.proberIntervalMs)
+        {
+            prober_lcore_id = worker_lcore_id;
+            rte_eal_remote_launch(doca_ar_prober, NULL, prober_lcore_id);
+            break;
+        }
     }
-    rte_eal_remote_launch(process_packets, NULL, runing_lore_id);
     rte_delay_ms(200);
     doca_ar_cmd();
 }
\ No newline at end of file
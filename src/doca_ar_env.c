@@ -9,6 +9,9 @@
  *
  */
 #include "doca_ar_env.h"
+#include "doca_ar_pipe.h"
+#include "doca_ar_prober.h"
+#include "doca_ar_reroute.h"
 
 DOCA_LOG_REGISTER(DOCA_AR_ENV);
 
@@ -20,8 +23,609 @@ struct application_dpdk_config dpdk_config = {
 	.sft_config = {0},
 };
 
+struct doca_ar_config ar_config = {
+	.probeWindowUs = 500,
+	.probeRounds = 1,
+	.probePercentile = 0,
+	.pathTtlMs = 100,
+	.proberIntervalMs = 0,
+	.lbScheme = DOCA_AR,
+	.flowBackend = FLOW_BACKEND_HW,
+	.maxConns = MAX_CONNTRACK,
+	.maxConnsLimit = 0,
+	.rerouteIntervalMs = 0,
+	.rerouteHysteresis = 20,
+	.flowletGapUs = 500,
+	.discoveryHops = 0,
+	.probeClock = PROBE_CLOCK_TSC,
+	.probeMetric = PROBE_METRIC_RTT,
+	.role = ROLE_SENDER,
+	.reflectorStamp = false,
+	.hasReflectorMac = false,
+	.metricsPort = 0,
+	.metricsSocket = "",
+};
+
 int to_host_port = 0;
 int to_net_port = 1;
+int probe_queue = 0;
+int nb_workers = 1;
+
+/*
+ * ARGP Callback - Handle probe window parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+probe_window_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+	int window = *(int *)param;
+
+	if (window <= 0)
+	{
+		DOCA_LOG_ERR("Probe window must be positive");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->probeWindowUs = window;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle probe rounds parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+probe_rounds_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+	int rounds = *(int *)param;
+
+	if (rounds <= 0 || rounds > MAX_PROBE_ROUNDS)
+	{
+		DOCA_LOG_ERR("Probe rounds must be in [1, %d]", MAX_PROBE_ROUNDS);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->probeRounds = rounds;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle probe percentile parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+probe_percentile_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+	int percentile = *(int *)param;
+
+	if (percentile < 0 || percentile > 100)
+	{
+		DOCA_LOG_ERR("Probe percentile must be in [0, 100]");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->probePercentile = percentile;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle path ttl parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+path_ttl_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+	int ttl = *(int *)param;
+
+	if (ttl < 0)
+	{
+		DOCA_LOG_ERR("Path ttl must not be negative");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->pathTtlMs = ttl;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle prober interval parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+prober_interval_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+	int interval = *(int *)param;
+
+	if (interval < 0)
+	{
+		DOCA_LOG_ERR("Prober interval must not be negative");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->proberIntervalMs = interval;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle load balancing scheme parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+lb_scheme_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+	const char *scheme = (const char *)param;
+
+	if (strcmp(scheme, "ar") == 0)
+		cfg->lbScheme = DOCA_AR;
+	else if (strcmp(scheme, "ecmp") == 0)
+		cfg->lbScheme = ECMP;
+	else if (strcmp(scheme, "flowlet") == 0)
+		cfg->lbScheme = FLOWLET;
+	else
+	{
+		DOCA_LOG_ERR("Load balancing scheme must be ar, ecmp or flowlet");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle probe timestamp parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+probe_timestamp_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+	const char *clock = (const char *)param;
+
+	if (strcmp(clock, "tsc") == 0)
+		cfg->probeClock = PROBE_CLOCK_TSC;
+	else if (strcmp(clock, "hw") == 0)
+		cfg->probeClock = PROBE_CLOCK_HW;
+	else
+	{
+		DOCA_LOG_ERR("Probe timestamp must be tsc or hw");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle flow backend parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+flow_backend_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+	const char *backend = (const char *)param;
+
+	if (strcmp(backend, "hw") == 0)
+		cfg->flowBackend = FLOW_BACKEND_HW;
+	else if (strcmp(backend, "sw") == 0)
+		cfg->flowBackend = FLOW_BACKEND_SW;
+	else
+	{
+		DOCA_LOG_ERR("Flow backend must be hw or sw");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle max conns parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+max_conns_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+	int conns = *(int *)param;
+
+	if (conns < 1024 || conns > MAX_CONNS_LIMIT)
+	{
+		DOCA_LOG_ERR("Max conns must be between 1024 and %d", MAX_CONNS_LIMIT);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->maxConns = conns;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle max conns limit parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+max_conns_limit_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+	int conns = *(int *)param;
+
+	if (conns < 0 || conns > MAX_CONNS_LIMIT)
+	{
+		DOCA_LOG_ERR("Max conns limit must be between 0 and %d", MAX_CONNS_LIMIT);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->maxConnsLimit = conns;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle reroute interval parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+reroute_interval_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+	int interval = *(int *)param;
+
+	if (interval < 0 || interval >= PROBER_IDLE_MS / 2)
+	{
+		DOCA_LOG_ERR("Reroute interval must be between 0 and %d", PROBER_IDLE_MS / 2 - 1);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->rerouteIntervalMs = interval;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle reroute hysteresis parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+reroute_hysteresis_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+	int pct = *(int *)param;
+
+	if (pct < 0 || pct > 1000)
+	{
+		DOCA_LOG_ERR("Reroute hysteresis must be between 0 and 1000");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->rerouteHysteresis = pct;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle flowlet gap parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+flowlet_gap_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+	int gap = *(int *)param;
+
+	if (gap < 0 || gap > 1000000)
+	{
+		DOCA_LOG_ERR("Flowlet gap must be between 0 and 1000000");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->flowletGapUs = gap;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle path discovery parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+path_discovery_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+	int hops = *(int *)param;
+
+	if (hops < 0 || hops > DISCOVERY_MAX_HOPS)
+	{
+		DOCA_LOG_ERR("Path discovery hops must be between 0 and %d", DISCOVERY_MAX_HOPS);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->discoveryHops = hops;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle probe metric parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+probe_metric_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+	const char *metric = (const char *)param;
+
+	if (strcmp(metric, "rtt") == 0)
+		cfg->probeMetric = PROBE_METRIC_RTT;
+	else if (strcmp(metric, "forward") == 0)
+		cfg->probeMetric = PROBE_METRIC_FORWARD;
+	else if (strcmp(metric, "fwdvar") == 0)
+		cfg->probeMetric = PROBE_METRIC_FWDVAR;
+	else
+	{
+		DOCA_LOG_ERR("Probe metric must be rtt, forward or fwdvar");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle role parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+role_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+	const char *role = (const char *)param;
+
+	if (strcmp(role, "sender") == 0)
+		cfg->role = ROLE_SENDER;
+	else if (strcmp(role, "reflector") == 0)
+		cfg->role = ROLE_REFLECTOR;
+	else
+	{
+		DOCA_LOG_ERR("Role must be sender or reflector");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle reflector stamp parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+reflector_stamp_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+
+	cfg->reflectorStamp = *(bool *)param;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle reflector mac parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+reflector_mac_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+
+	if (rte_ether_unformat_addr((const char *)param, &cfg->reflectorMac) != 0)
+	{
+		DOCA_LOG_ERR("Reflector mac must look like 08:c0:eb:bf:ef:9a");
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->hasReflectorMac = true;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle metrics port parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+metrics_port_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+	int port = *(int *)param;
+
+	if (port < 0 || port > UINT16_MAX)
+	{
+		DOCA_LOG_ERR("Metrics port must be in [0, %d]", UINT16_MAX);
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	cfg->metricsPort = port;
+	return DOCA_SUCCESS;
+}
+
+/*
+ * ARGP Callback - Handle metrics socket parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+metrics_socket_callback(void *param, void *config)
+{
+	struct doca_ar_config *cfg = (struct doca_ar_config *)config;
+	const char *path = (const char *)param;
+
+	if (strlen(path) >= sizeof(cfg->metricsSocket))
+	{
+		DOCA_LOG_ERR("Metrics socket path must be shorter than %zu", sizeof(cfg->metricsSocket));
+		return DOCA_ERROR_INVALID_VALUE;
+	}
+	strcpy(cfg->metricsSocket, path);
+	return DOCA_SUCCESS;
+}
+
+/*
+ * Register one app parameter into doca-argp
+ *
+ * @long_name [in]: long name of the parameter
+ * @arguments [in]: argument shown in the usage
+ * @description [in]: description shown in the usage
+ * @callback [in]: callback saving the parameter into the config
+ * @type [in]: type of the parameter
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+register_param(const char *long_name, const char *arguments, const char *description,
+	       callback_func callback, enum doca_argp_type type)
+{
+	struct doca_argp_param *param;
+	doca_error_t result;
+
+	result = doca_argp_param_create(&param);
+	if (result != DOCA_SUCCESS)
+	{
+		DOCA_LOG_ERR("Failed to create ARGP param: %s", doca_get_error_string(result));
+		return result;
+	}
+	doca_argp_param_set_long_name(param, long_name);
+	doca_argp_param_set_arguments(param, arguments);
+	doca_argp_param_set_description(param, description);
+	doca_argp_param_set_callback(param, callback);
+	doca_argp_param_set_type(param, type);
+	result = doca_argp_register_param(param);
+	if (result != DOCA_SUCCESS)
+		DOCA_LOG_ERR("Failed to register program param %s: %s", long_name, doca_get_error_string(result));
+	return result;
+}
+
+/*
+ * Register all the app parameters of DOCA-AR
+ *
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t
+register_doca_ar_params()
+{
+	doca_error_t result;
+
+	result = register_param("lb-scheme", "<ar|ecmp|flowlet>", "Load balancing scheme, flowlet also moves offloaded connections between flowlets (default ar)",
+				lb_scheme_callback, DOCA_ARGP_TYPE_STRING);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = register_param("flow-backend", "<hw|sw>", "Offload pipes with doca-flow, or emulate them in software on any dpdk port (default hw)",
+				flow_backend_callback, DOCA_ARGP_TYPE_STRING);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = register_param("probe-window", "<us>", "Time to keep collecting probe replies after the first one [us]",
+				probe_window_callback, DOCA_ARGP_TYPE_INT);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = register_param("probe-rounds", "<num>", "Probe packets sent on every path per new connection",
+				probe_rounds_callback, DOCA_ARGP_TYPE_INT);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = register_param("probe-percentile", "<0-100>", "RTT percentile used to compare paths, 0 for minimum RTT",
+				probe_percentile_callback, DOCA_ARGP_TYPE_INT);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = register_param("probe-metric", "<rtt|forward|fwdvar>", "Delay used to compare paths, forward and fwdvar need a reflector started with --reflector-stamp (default rtt)",
+				probe_metric_callback, DOCA_ARGP_TYPE_STRING);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = register_param("role", "<sender|reflector>", "Load balance the host traffic, or send probes back to their sender (default sender)",
+				role_callback, DOCA_ARGP_TYPE_STRING);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = register_param("reflector-stamp", NULL, "Reflector: stamp the receive time into probes, reflected in software",
+				reflector_stamp_callback, DOCA_ARGP_TYPE_BOOLEAN);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = register_param("reflector-mac", "<mac>", "Reflector: dst mac of reflected probes, lets probes be reflected in hardware",
+				reflector_mac_callback, DOCA_ARGP_TYPE_STRING);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = register_param("metrics-port", "<port>", "Serve OpenMetrics over http on this tcp port of localhost, 0 for none (default 0)",
+				metrics_port_callback, DOCA_ARGP_TYPE_INT);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = register_param("metrics-socket", "<path>", "Serve OpenMetrics over http on this unix socket",
+				metrics_socket_callback, DOCA_ARGP_TYPE_STRING);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = register_param("probe-timestamp", "<tsc|hw>", "Clock measuring probe RTT, hw uses NIC timestamps and falls back to tsc (default tsc)",
+				probe_timestamp_callback, DOCA_ARGP_TYPE_STRING);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = register_param("path-ttl", "<ms>", "How long measured path RTT is reused for new connections, 0 to always probe",
+				path_ttl_callback, DOCA_ARGP_TYPE_INT);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = register_param("max-conns", "<num>", "Conntrack capacity at startup (default 16384)",
+				max_conns_callback, DOCA_ARGP_TYPE_INT);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = register_param("max-conns-limit", "<num>", "Conntrack capacity can grow up to this at runtime, 0 for no growth (default 0)",
+				max_conns_limit_callback, DOCA_ARGP_TYPE_INT);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = register_param("reroute-interval", "<ms>", "Re-evaluate the path of offloaded connections this often, 0 to keep the path of a connection (default 0)",
+				reroute_interval_callback, DOCA_ARGP_TYPE_INT);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = register_param("reroute-hysteresis", "<%>", "A path must be this much faster than the current one to reroute a connection (default 20)",
+				reroute_hysteresis_callback, DOCA_ARGP_TYPE_INT);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = register_param("flowlet-gap", "<us>", "Only reroute a connection after it sent nothing for this long (default 500)",
+				flowlet_gap_callback, DOCA_ARGP_TYPE_INT);
+	if (result != DOCA_SUCCESS)
+		return result;
+	result = register_param("path-discovery", "<hops>", "Trace this many hops with ttl-limited probes to find src ports leading onto distinct paths, needs the prober, 0 to probe consecutive ports (default 0)",
+				path_discovery_callback, DOCA_ARGP_TYPE_INT);
+	if (result != DOCA_SUCCESS)
+		return result;
+	return register_param("prober-interval", "<ms>", "Probe active destinations periodically on a dedicated lcore, 0 to probe new connections on demand",
+			      prober_interval_callback, DOCA_ARGP_TYPE_INT);
+}
 
 int init_doca_flow(int nb_queues, const char *mode, struct doca_flow_resources resource, uint32_t nr_shared_resources[], struct doca_flow_error *error)
 {
@@ -33,6 +637,7 @@ int init_doca_flow(int nb_queues, const char *mode, struct doca_flow_resources r
 	flow_cfg.queues = nb_queues;
 	flow_cfg.mode_args = mode;
 	flow_cfg.resource = resource;
+	flow_cfg.cb = doca_ar_flow_process_cb; /* completion of batched entry insertions */
 	for (shared_resource_idx = 0; shared_resource_idx < DOCA_FLOW_SHARED_RESOURCE_MAX; shared_resource_idx++)
 		flow_cfg.nr_shared_resources[shared_resource_idx] = nr_shared_resources[shared_resource_idx];
 	return doca_flow_init(&flow_cfg, error);
@@ -115,18 +720,20 @@ int init_doca_flow_ports(int nb_ports, struct doca_flow_port *ports[], bool is_h
 int doca_ar_env_init(int argc, char **argv)
 {
 	doca_error_t result;
-	struct doca_flow_resources resource = {0};
-	uint32_t nr_shared_resources[DOCA_FLOW_SHARED_RESOURCE_MAX] = {0};
-	struct doca_flow_error error;
-	resource.nb_counters = 80;
 
 	//////////////////////////////////////////////////////////////// Args Process
-	result = doca_argp_init("FlowQoS", NULL);
+	result = doca_argp_init("FlowQoS", &ar_config);
 	if (result != DOCA_SUCCESS)
 	{
 		DOCA_LOG_ERR("Failed to init ARGP resources: %s", doca_get_error_string(result));
 		return EXIT_FAILURE;
 	}
+	result = register_doca_ar_params();
+	if (result != DOCA_SUCCESS)
+	{
+		doca_argp_destroy();
+		return EXIT_FAILURE;
+	}
 	doca_argp_set_dpdk_program(dpdk_init);
 	result = doca_argp_start(argc, argv);
 	if (result != DOCA_SUCCESS)
@@ -136,6 +743,23 @@ int doca_ar_env_init(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
+	flow_ops = ar_config.flowBackend == FLOW_BACKEND_SW ? &doca_ar_flow_sw_ops : &doca_ar_flow_hw_ops;
+	DOCA_LOG_INFO("Flow backend %s", flow_ops->name);
+	if (ar_config.maxConnsLimit < ar_config.maxConns)
+		ar_config.maxConnsLimit = ar_config.maxConns; /* no runtime growth */
+	DOCA_LOG_INFO("Conntrack capacity %u, limit %u", ar_config.maxConns, ar_config.maxConnsLimit);
+	if (ar_config.flowBackend == FLOW_BACKEND_SW)
+		dpdk_config.port_config.nb_hairpin_q = 0; /* hairpin is emulated in software */
+	dpdk_config.port_config.rx_timestamp = ar_config.probeClock == PROBE_CLOCK_HW; /* only --probe-timestamp hw reads them */
+	if (ar_config.role == ROLE_REFLECTOR)
+	{
+		/* a reflector only answers probes, it neither probes nor places conns */
+		ar_config.proberIntervalMs = 0;
+		ar_config.discoveryHops = 0;
+		ar_config.lbScheme = ECMP;
+		DOCA_LOG_INFO("Reflect probes %s", ar_config.hasReflectorMac && !ar_config.reflectorStamp ? "in hardware" : "in software");
+	}
+
 	//////////////////////////////////////////////////////////////// DPDK Port Init
 	/* update queues and ports */
 	result = dpdk_queues_and_ports_init(&dpdk_config);
@@ -147,29 +771,76 @@ int doca_ar_env_init(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 	DOCA_LOG_INFO("QueueNUM %d", dpdk_config.port_config.nb_queues);
+	/* one queue per lcore: workers own the first ones, the prober owns the last one, the main lcore's queue stays idle */
+	nb_workers = dpdk_config.port_config.nb_queues - 1 - (ar_config.proberIntervalMs ? 1 : 0);
+	if (nb_workers < 1 || nb_workers > MAX_WORKERS)
+	{
+		DOCA_LOG_ERR("Worker lcores should be in [1, %d], got %d", MAX_WORKERS, nb_workers);
+		dpdk_queues_and_ports_fini(&dpdk_config);
+		dpdk_fini();
+		doca_argp_destroy();
+		return EXIT_FAILURE;
+	}
+	DOCA_LOG_INFO("WorkerNUM %d", nb_workers);
+	/* without the prober, probe replies get the idle queue of the main lcore so that they never queue behind other traffic */
+	probe_queue = ar_config.proberIntervalMs ? dpdk_config.port_config.nb_queues - 1 : nb_workers;
+	if (ar_config.proberIntervalMs)
+	{
+		if (ar_config.pathTtlMs <= ar_config.proberIntervalMs)
+			DOCA_LOG_WARN("Path ttl %u ms is not longer than prober interval %u ms, new connections will often miss the path table",
+				      ar_config.pathTtlMs, ar_config.proberIntervalMs);
+	}
+	if (ar_config.lbScheme == ECMP)
+		ar_config.rerouteIntervalMs = 0; /* ecmp never moves a conn */
+	/* flowlet re-evaluates offloaded conns every interval, only those with a faster path are then sampled per flowlet gap */
+	if (ar_config.lbScheme == FLOWLET && !ar_config.rerouteIntervalMs)
+		ar_config.rerouteIntervalMs = REROUTE_FLOWLET_INTERVAL_MS;
+	if (ar_config.discoveryHops && !ar_config.proberIntervalMs)
+	{
+		DOCA_LOG_WARN("Path discovery runs on the prober lcore, it is off without --prober-interval");
+		ar_config.discoveryHops = 0;
+	}
+	if (ar_config.rerouteIntervalMs && !ar_config.proberIntervalMs)
+		DOCA_LOG_WARN("Rerouting without the prober only uses RTT measured for new connections within the path ttl");
 	//////////////////////////////////////////////////////////////// DOCA Port Init
+	if (flow_ops->init(dpdk_config.port_config.nb_queues))
+		return EXIT_FAILURE;
+	DOCA_LOG_INFO("Init DOCA_AR_ENV Success");
+
+	return DOCA_SUCCESS;
+}
+int doca_ar_doca_flow_init(int nbQueues)
+{
+	struct doca_flow_resources resource = {0};
+	uint32_t nr_shared_resources[DOCA_FLOW_SHARED_RESOURCE_MAX] = {0};
+	struct doca_flow_error error;
+	resource.nb_counters = 80;
+	if (ar_config.rerouteIntervalMs)
+		resource.nb_counters += ar_config.maxConnsLimit; /* rerouting samples the counter of every upstream_vxlanPipe entry */
 
 	/*hws mode has a conflict with adding entries into multiFlowQueues*/
-	if (init_doca_flow(dpdk_config.port_config.nb_queues, "vnf", resource, nr_shared_resources, &error) < 0)
+	if (init_doca_flow(nbQueues, "vnf", resource, nr_shared_resources, &error) < 0)
 	{
 		DOCA_LOG_ERR("Failed to init DOCA Flow - %s (%u)", error.message, error.type);
-		return EXIT_FAILURE;
+		return -1;
 	}
 
 	if (init_doca_flow_ports(NB_PORTS, ports, true))
 	{
 		DOCA_LOG_ERR("Failed to init DOCA ports");
 		doca_flow_destroy();
-		return EXIT_FAILURE;
+		return -1;
 	}
-	DOCA_LOG_INFO("Init DOCA_AR_ENV Success");
-
-	return DOCA_SUCCESS;
+	return 0;
 }
-void doca_ar_env_destroy()
+void doca_ar_doca_flow_destroy()
 {
 	destroy_doca_flow_ports(NB_PORTS, ports);
 	doca_flow_destroy();
+}
+void doca_ar_env_destroy()
+{
+	flow_ops->destroy();
 
 	/* cleanup resources */
 	dpdk_queues_and_ports_fini(&dpdk_config);
@@ -23,10 +23,99 @@
 #include <rte_tcp.h>
 
 #define NB_PORTS 2                                 ///< we use 2 SF ports
+#define PROBE_PATH_AMOUNT 4                        ///< default probed paths amount and packets amount we sent
+#define MAX_PROBE_ROUNDS 8                         ///< maximum probe packets sent on every path for one new conn
+#define MAX_CONNS_LIMIT (1 << 25)                   ///< upper bound of --max-conns and --max-conns-limit
+#define MAX_WORKERS 16                             ///< maximum worker lcores, worker i owns queue i of both ports and doca-flow pipe queue i
+
+/**
+ * @brief Load balancing scheme we used
+ *
+ */
+enum LB_SCHEME
+{
+    DOCA_AR, ///< use doca-ar
+    ECMP,    ///< use ecmp
+    FLOWLET  ///< use doca-ar for new conns, then steer every flowlet of an offloaded conn onto the best path
+};
+
+/**
+ * @brief implementation of the pipes
+ *
+ */
+enum FLOW_BACKEND
+{
+    FLOW_BACKEND_HW, ///< doca-flow pipes offloaded into the eSwitch of the DPU
+    FLOW_BACKEND_SW  ///< pipes emulated in software on plain dpdk ports, e.g. net_ring or net_pcap vdevs
+};
+
+/**
+ * @brief what the app does on this DPU
+ *
+ */
+enum ROLE
+{
+    ROLE_SENDER,   ///< load balance the vxlan traffic of the host
+    ROLE_REFLECTOR ///< send probes back to their sender, in place of the OvS rule of the receiver DPU
+};
+
+/**
+ * @brief delay of a probed path used to compare paths
+ *
+ */
+enum PROBE_METRIC
+{
+    PROBE_METRIC_RTT,     ///< round trip time
+    PROBE_METRIC_FORWARD, ///< forward one-way delay, from the receive time stamped by a reflector with --reflector-stamp
+    PROBE_METRIC_FWDVAR   ///< forward one-way delay above the floor of the path, i.e. queueing on the way to the reflector
+};
+
+/**
+ * @brief clock measuring probe RTT
+ *
+ */
+enum PROBE_CLOCK
+{
+    PROBE_CLOCK_TSC, ///< tsc of the Arm cores, includes the tx/rx rings and the polling loop
+    PROBE_CLOCK_HW   ///< NIC clock read when probes are sent and rx timestamps of the replies, TSC for replies without one
+};
+
+/**
+ * @brief app parameters of DOCA-AR, parsed by doca-argp
+ *
+ */
+struct doca_ar_config
+{
+    uint32_t probeWindowUs;   ///< how long to keep collecting probe replies after the first one came back[us]
+    uint32_t probeRounds;     ///< probe packets sent on every path, more rounds give percentile a meaning
+    uint32_t probePercentile; ///< RTT percentile of a path used to compare paths, 0 means the minimum RTT
+    uint32_t pathTtlMs;       ///< how long RTT in the path table can be used instead of probing[ms], 0 disables the table
+    uint32_t proberIntervalMs; ///< probe every active destination this often on a dedicated lcore[ms], 0 probes new conns on demand
+    enum LB_SCHEME lbScheme;   ///< load balancing scheme of new conns, independent of the amount of lcores
+    enum FLOW_BACKEND flowBackend; ///< implementation of the pipes
+    uint32_t maxConns;         ///< conntrack capacity at startup
+    uint32_t maxConnsLimit;    ///< conntrack capacity can grow up to this at runtime, sizes upstream_vxlanPipe
+    uint32_t rerouteIntervalMs; ///< re-evaluate the path of every offloaded conn this often[ms], 0 keeps the path for the conn's lifetime
+    uint32_t rerouteHysteresis; ///< a path must be this much faster than the current one to move a conn onto it[%]
+    uint32_t flowletGapUs;      ///< a conn is only moved after sending nothing for this long, so it is not reordered[us]
+    uint32_t discoveryHops;     ///< hops traced by the prober to learn which src ports lead onto distinct paths, 0 probes consecutive ports
+    enum PROBE_CLOCK probeClock; ///< clock measuring probe RTT
+    enum PROBE_METRIC probeMetric; ///< delay of a probed path used to compare paths
+    enum ROLE role;
+    bool reflectorStamp;           ///< the reflector stamps the receive time into probes, so it reflects them in software
+    bool hasReflectorMac;          ///< reflectorMac is given, probes not stamped are reflected in hardware
+    struct rte_ether_addr reflectorMac; ///< dst mac of reflected probes, the next hop towards the senders
+    uint16_t metricsPort;          ///< serve OpenMetrics on this tcp port of localhost, 0 if none
+    char metricsSocket[108];       ///< serve OpenMetrics on this unix socket, empty if none
+};
+
 extern int to_host_port;                           ///< port connected with host pf
 extern int to_net_port;                            ///< port connected with uplink port
+extern int probe_queue;                            ///< queue of to_net_port receiving probe replies, owned by the prober, or shared by the workers without it
+extern int nb_workers;                             ///< worker lcores processing new conns, all lcores but main (and prober)
 extern struct doca_flow_port *ports[NB_PORTS];     ///< pointer of doca-flow port
 extern struct application_dpdk_config dpdk_config; ///< dpdk config
+extern struct doca_ar_config ar_config;            ///< app parameters
 /**
  * @brief build doca-flow and dpdk env
  *
@@ -40,4 +129,16 @@ int doca_ar_env_init(int argc, char **argv);
  *
  */
 void doca_ar_env_destroy();
+/**
+ * @brief init doca-flow and its ports on the started dpdk ports, init of the doca-flow backend
+ *
+ * @param nbQueues
+ * @return int
+ */
+int doca_ar_doca_flow_init(int nbQueues);
+/**
+ * @brief destroy doca-flow ports and doca-flow
+ *
+ */
+void doca_ar_doca_flow_destroy();
 #endif /* DOCA_AR_ENV_H_ */
\ No newline at end of file
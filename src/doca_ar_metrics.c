@@ -0,0 +1,364 @@
+/**
+ * @file doca_ar_metrics.c
+ * @author Mark Chen (markchen77888@gmail.com)
+ * @brief OpenMetrics exporter polled on the main lcore, scraped over http on a local tcp port or a unix socket
+ * @version 1.0
+ * @date 2024-01-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "doca_ar_metrics.h"
+#include "doca_ar_stats.h"
+#include "doca_ar_conntrack.h"
+#include "doca_ar_probe.h"
+#include "doca_ar_pipe.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+DOCA_LOG_REGISTER(DOCA_AR_METRICS);
+
+/**
+ * @brief text of one scrape, kept between scrapes so that it is only reallocated while it grows
+ *
+ */
+struct metrics_buf
+{
+    char *data;
+    size_t len;
+    size_t cap;
+    int err; ///< allocation failed, the scrape is answered with 500
+};
+
+static int metricsFds[2] = {-1, -1}; ///< listening tcp and unix sockets, -1 if not given
+static struct metrics_buf metricsBuf;
+
+/**
+ * @brief append formatted text to the scrape
+ *
+ * @param b
+ * @param fmt
+ * @param ...
+ */
+static void __attribute__((format(printf, 2, 3))) metrics_printf(struct metrics_buf *b, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+    if (b->err)
+        return;
+    va_start(ap, fmt);
+    n = vsnprintf(b->data ? b->data + b->len : NULL, b->data ? b->cap - b->len : 0, fmt, ap);
+    va_end(ap);
+    if (n < 0)
+    {
+        b->err = 1;
+        return;
+    }
+    if (b->len + n >= b->cap)
+    {
+        size_t cap = RTE_MAX(b->cap * 2, b->len + n + 4096);
+        char *data = realloc(b->data, cap);
+        if (data == NULL)
+        {
+            b->err = 1;
+            return;
+        }
+        b->data = data;
+        b->cap = cap;
+        va_start(ap, fmt);
+        vsnprintf(b->data + b->len, b->cap - b->len, fmt, ap);
+        va_end(ap);
+    }
+    b->len += n;
+}
+
+/**
+ * @brief metadata of a metric family
+ *
+ * @param b
+ * @param name
+ * @param type counter, gauge or histogram
+ * @param unit empty if the family has no unit
+ * @param help
+ */
+static void metrics_family(struct metrics_buf *b, const char *name, const char *type, const char *unit, const char *help)
+{
+    metrics_printf(b, "# TYPE %s %s\n", name, type);
+    if (unit[0])
+        metrics_printf(b, "# UNIT %s %s\n", name, unit);
+    metrics_printf(b, "# HELP %s %s\n", name, help);
+}
+
+/**
+ * @brief samples of a histogram in seconds, with one cumulative bucket per power of two of ns
+ *
+ * The bucket bounds never change, so rates over scrapes can be taken per bucket.
+ *
+ * @param b
+ * @param name family name
+ * @param id
+ * @param labels labels of the histogram, or empty
+ */
+static void metrics_hist(struct metrics_buf *b, const char *name, enum DOCA_AR_HIST id, const char *labels)
+{
+    struct doca_ar_hist h;
+    uint64_t count = doca_ar_hist_snapshot(id, &h), cum = 0;
+    const char *sep = labels[0] ? "," : "";
+    // the last bucket also holds every larger value, it is only covered by +Inf
+    for (uint32_t bucket = 0; bucket < HIST_BUCKETS - 1; bucket++)
+    {
+        cum += h.buckets[bucket];
+        if (bucket % HIST_SUB == HIST_SUB - 1)
+            metrics_printf(b, "%s_bucket{%s%sle=\"%.9g\"} %lu\n", name, labels, sep, doca_ar_hist_bucket_max(bucket) / 1e9, cum);
+    }
+    metrics_printf(b, "%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, labels, sep, count);
+    metrics_printf(b, "%s_count{%s} %lu\n", name, labels, count);
+    metrics_printf(b, "%s_sum{%s} %.9f\n", name, labels, h.sum / 1e9);
+}
+
+/**
+ * @brief render all the metrics into metricsBuf
+ *
+ * @param b
+ */
+static void metrics_render(struct metrics_buf *b)
+{
+    struct doca_ar_stats s;
+    uint32_t capacity = 0, inUse = doca_ar_conntrack_in_use(&capacity);
+    char labels[32];
+
+    b->len = 0;
+    b->err = 0;
+    doca_ar_stats_total(&s);
+
+    metrics_family(b, "doca_ar_packets_received", "counter", "", "Packets received per port");
+    metrics_printf(b, "doca_ar_packets_received_total{port=\"host\"} %lu\n", s.rx[to_host_port]);
+    metrics_printf(b, "doca_ar_packets_received_total{port=\"net\"} %lu\n", s.rx[to_net_port]);
+    metrics_family(b, "doca_ar_packets_sent", "counter", "", "Packets sent per port");
+    metrics_printf(b, "doca_ar_packets_sent_total{port=\"host\"} %lu\n", s.tx[to_host_port]);
+    metrics_printf(b, "doca_ar_packets_sent_total{port=\"net\"} %lu\n", s.tx[to_net_port]);
+    metrics_family(b, "doca_ar_packets_dropped", "counter", "", "Packets freed because the tx ring of the port was full");
+    metrics_printf(b, "doca_ar_packets_dropped_total{port=\"host\"} %lu\n", s.drop[to_host_port]);
+    metrics_printf(b, "doca_ar_packets_dropped_total{port=\"net\"} %lu\n", s.drop[to_net_port]);
+    metrics_family(b, "doca_ar_conns_created", "counter", "", "Connections added into the conntrack");
+    metrics_printf(b, "doca_ar_conns_created_total %lu\n", s.newConns);
+    metrics_family(b, "doca_ar_conn_failures", "counter", "", "New connections the conntrack had no room for");
+    metrics_printf(b, "doca_ar_conn_failures_total %lu\n", s.connFails);
+    metrics_family(b, "doca_ar_conns_aged", "counter", "", "Connections deleted by aging");
+    metrics_printf(b, "doca_ar_conns_aged_total %lu\n", s.aged);
+    metrics_family(b, "doca_ar_probes_sent", "counter", "", "Probe packets sent");
+    metrics_printf(b, "doca_ar_probes_sent_total %lu\n", s.probeSent);
+    metrics_family(b, "doca_ar_probes_received", "counter", "", "Probe replies received, or probes reflected by a reflector");
+    metrics_printf(b, "doca_ar_probes_received_total %lu\n", s.probeRcvd);
+    metrics_family(b, "doca_ar_probe_timeouts", "counter", "", "Probes which ended with replies missing");
+    metrics_printf(b, "doca_ar_probe_timeouts_total %lu\n", s.probeTimeout);
+    metrics_family(b, "doca_ar_path_switches", "counter", "", "Connections placed onto another path than their original one, or rerouted");
+    metrics_printf(b, "doca_ar_path_switches_total %lu\n", s.pathSwitch);
+    metrics_family(b, "doca_ar_offloads", "counter", "", "Entries added into upstream_vxlanPipe");
+    metrics_printf(b, "doca_ar_offloads_total{result=\"ok\"} %lu\n", s.offloadOk);
+    metrics_printf(b, "doca_ar_offloads_total{result=\"fail\"} %lu\n", s.offloadFail);
+
+    metrics_family(b, "doca_ar_conntrack_conns", "gauge", "", "Connections taken from CT_POOL");
+    metrics_printf(b, "doca_ar_conntrack_conns %u\n", inUse);
+    metrics_family(b, "doca_ar_conntrack_capacity", "gauge", "", "Current capacity of the conntrack");
+    metrics_printf(b, "doca_ar_conntrack_capacity %u\n", capacity);
+    metrics_family(b, "doca_ar_conntrack_occupancy_ratio", "gauge", "ratio", "Share of the conntrack capacity in use");
+    metrics_printf(b, "doca_ar_conntrack_occupancy_ratio %.6f\n", capacity ? (double)inUse / capacity : 0.0);
+    metrics_family(b, "doca_ar_probes_pending", "gauge", "", "Connections waiting for their probe replies");
+    metrics_printf(b, "doca_ar_probes_pending %u\n", doca_ar_probe_pending());
+    metrics_family(b, "doca_ar_aging_backlog", "gauge", "", "Expired lifetime timers not handled yet per worker");
+    for (int q = 0; q < nb_workers; q++)
+        metrics_printf(b, "doca_ar_aging_backlog{worker=\"%d\"} %u\n", q, doca_ar_flow_aging_stats(q)->backlog);
+
+    metrics_family(b, "doca_ar_probe_rtt_seconds", "histogram", "seconds", "RTT of probe replies per slot of the probe, slots of different destinations are different paths");
+    for (int p = 0; p < PROBE_PATH_AMOUNT; p++)
+    {
+        snprintf(labels, sizeof(labels), "slot=\"%d\"", p);
+        metrics_hist(b, "doca_ar_probe_rtt_seconds", HIST_PROBE_RTT + p, labels);
+    }
+    metrics_family(b, "doca_ar_flow_setup_seconds", "histogram", "seconds", "First packet of a new connection to the decision of its path");
+    metrics_hist(b, "doca_ar_flow_setup_seconds", HIST_SETUP, "");
+    metrics_family(b, "doca_ar_flow_offload_seconds", "histogram", "seconds", "Entry of a connection queued to completed");
+    metrics_hist(b, "doca_ar_flow_offload_seconds", HIST_OFFLOAD, "");
+    metrics_family(b, "doca_ar_aging_round_seconds", "histogram", "seconds", "Duration of an aging round");
+    metrics_hist(b, "doca_ar_aging_round_seconds", HIST_AGING, "");
+    metrics_printf(b, "# EOF\n");
+}
+
+/**
+ * @brief send all the bytes, the socket has a send timeout
+ *
+ * @param fd
+ * @param data
+ * @param len
+ * @return int
+ */
+static int metrics_send(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief answer the http request of an accepted scraper
+ *
+ * @param fd
+ */
+static void metrics_serve(int fd)
+{
+    char req[METRICS_REQ_LEN], hdr[256];
+    size_t len = 0;
+    const char *status = "200 OK";
+    struct timeval tv = {.tv_sec = 0, .tv_usec = METRICS_IO_TIMEOUT_MS * 1000};
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    // only the request line matters, read until the end of the headers
+    while (len < sizeof(req) - 1)
+    {
+        ssize_t n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        len += n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n"))
+            break;
+    }
+    req[len] = '\0';
+    if (strncmp(req, "GET ", 4) != 0)
+        status = "405 Method Not Allowed";
+    else if (strncmp(req + 4, "/metrics ", 9) != 0 && strncmp(req + 4, "/ ", 2) != 0)
+        status = "404 Not Found";
+    else
+    {
+        metrics_render(&metricsBuf);
+        if (metricsBuf.err)
+            status = "500 Internal Server Error";
+    }
+    if (strcmp(status, "200 OK") != 0)
+    {
+        snprintf(hdr, sizeof(hdr), "HTTP/1.0 %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", status);
+        metrics_send(fd, hdr, strlen(hdr));
+        return;
+    }
+    snprintf(hdr, sizeof(hdr),
+             "HTTP/1.0 200 OK\r\nContent-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+             "Content-Length: %zu\r\nConnection: close\r\n\r\n",
+             metricsBuf.len);
+    if (metrics_send(fd, hdr, strlen(hdr)) == 0)
+        metrics_send(fd, metricsBuf.data, metricsBuf.len);
+}
+
+/**
+ * @brief bind a non-blocking listening socket
+ *
+ * @param family AF_INET or AF_UNIX
+ * @param addr
+ * @param len
+ * @return int fd, -1 on failure
+ */
+static int metrics_listen(int family, const struct sockaddr *addr, socklen_t len)
+{
+    int one = 1;
+    int fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        DOCA_LOG_ERR("Create metrics socket fail: %s", strerror(errno));
+        return -1;
+    }
+    if (family == AF_INET)
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, addr, len) < 0 || listen(fd, 8) < 0)
+    {
+        DOCA_LOG_ERR("Listen on metrics socket fail: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int doca_ar_metrics_init()
+{
+    if (ar_config.metricsPort)
+    {
+        struct sockaddr_in in = {0};
+        in.sin_family = AF_INET;
+        in.sin_port = htons(ar_config.metricsPort);
+        in.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // local scrapers only, e.g. an agent on the Arm cores
+        metricsFds[0] = metrics_listen(AF_INET, (struct sockaddr *)&in, sizeof(in));
+        if (metricsFds[0] < 0)
+            return -1;
+        DOCA_LOG_INFO("Serve metrics on http://127.0.0.1:%u/metrics", ar_config.metricsPort);
+    }
+    if (ar_config.metricsSocket[0])
+    {
+        struct sockaddr_un un = {0};
+        un.sun_family = AF_UNIX;
+        snprintf(un.sun_path, sizeof(un.sun_path), "%s", ar_config.metricsSocket);
+        unlink(un.sun_path); // left over by a previous run
+        metricsFds[1] = metrics_listen(AF_UNIX, (struct sockaddr *)&un, sizeof(un));
+        if (metricsFds[1] < 0)
+        {
+            doca_ar_metrics_destroy();
+            return -1;
+        }
+        DOCA_LOG_INFO("Serve metrics on unix socket %s", ar_config.metricsSocket);
+    }
+    return 0;
+}
+
+bool doca_ar_metrics_enabled()
+{
+    return metricsFds[0] >= 0 || metricsFds[1] >= 0;
+}
+
+int doca_ar_metrics_poll()
+{
+    int served = 0;
+    for (int i = 0; i < 2; i++)
+    {
+        if (metricsFds[i] < 0)
+            continue;
+        // the listening socket is non-blocking, the accepted one blocks up to METRICS_IO_TIMEOUT_MS
+        int fd = accept(metricsFds[i], NULL, NULL);
+        if (fd < 0)
+            continue;
+        metrics_serve(fd);
+        close(fd);
+        served++;
+    }
+    return served;
+}
+
+void doca_ar_metrics_destroy()
+{
+    if (metricsFds[0] >= 0)
+        close(metricsFds[0]);
+    if (metricsFds[1] >= 0)
+    {
+        close(metricsFds[1]);
+        unlink(ar_config.metricsSocket);
+    }
+    metricsFds[0] = metricsFds[1] = -1;
+    free(metricsBuf.data);
+    memset(&metricsBuf, 0, sizeof(metricsBuf));
+}
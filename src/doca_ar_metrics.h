@@ -0,0 +1,46 @@
+/**
+ * @file doca_ar_metrics.h
+ * @author Mark Chen (markchen77888@gmail.com)
+ * @brief OpenMetrics exporter polled on the main lcore, scraped over http on a local tcp port or a unix socket
+ * @version 1.0
+ * @date 2024-01-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef DOCA_AR_METRICS_H_
+#define DOCA_AR_METRICS_H_
+#include "doca_ar_env.h"
+
+#define METRICS_POLL_US 1000      ///< sleep of the main lcore between polls when nothing was scraped[us]
+#define METRICS_IO_TIMEOUT_MS 100 ///< a scraper sending its request or reading the response slower than this is dropped[ms]
+#define METRICS_REQ_LEN 2048      ///< request bytes read, the rest of the headers is ignored
+
+/**
+ * @brief listen on --metrics-port and --metrics-socket, nothing happens if neither is given
+ *
+ * @return int
+ */
+int doca_ar_metrics_init();
+/**
+ * @brief whether doca_ar_metrics_init opened a socket
+ *
+ * @return true
+ * @return false
+ */
+bool doca_ar_metrics_enabled();
+/**
+ * @brief serve the scrapers waiting on the sockets, never blocks when nobody is waiting
+ *
+ * Only lock-free snapshots of the lcores are read, so a scrape never stalls the datapath.
+ *
+ * @return int amount of scrapes served
+ */
+int doca_ar_metrics_poll();
+/**
+ * @brief close the sockets and remove the unix socket
+ *
+ */
+void doca_ar_metrics_destroy();
+
+#endif /* DOCA_AR_METRICS_H_ */
@@ -0,0 +1,371 @@
+/**
+ * @file doca_ar_path.c
+ * @author Mark Chen (markchen77888@gmail.com)
+ * @brief path quality table: recent RTT of every entropy src port towards a destination VTEP
+ * @version 1.0
+ * @date 2024-01-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "doca_ar_path.h"
+#include "doca_ar_stats.h"
+#include <rte_hash.h>
+#include <rte_hash_crc.h>
+#include <rte_malloc.h>
+#include <arpa/inet.h>
+DOCA_LOG_REGISTER(DOCA_AR_PATH);
+
+struct rte_hash *PATH_TABLE = NULL;             ///< VTEP pair ==> index of PATH_ENTRIES
+struct doca_ar_path_entry *PATH_ENTRIES = NULL; ///< path entries indexed by the key position in PATH_TABLE
+int maxPathDst = 0;
+static rte_spinlock_t evictLock = RTE_SPINLOCK_INITIALIZER; ///< one lcore scans for stale destinations at a time
+static uint64_t nextEvict = 0;                              ///< tsc of the next scan
+static int32_t retiredPos[PATH_EVICT_BURST];                ///< slots of the keys deleted by the latest scan, released by the next one
+static uint32_t nbRetired = 0;
+
+int doca_ar_path_init_env(int _maxDst)
+{
+    maxPathDst = _maxDst;
+    PATH_ENTRIES = rte_zmalloc("PATH_ENTRIES", maxPathDst * sizeof(struct doca_ar_path_entry), RTE_CACHE_LINE_SIZE);
+    if (PATH_ENTRIES == NULL)
+    {
+        DOCA_LOG_ERR("Alloc PATH_ENTRIES fail");
+        return -1;
+    }
+
+    const struct rte_hash_parameters PathTable =
+        {
+            .name = "PATH_TABLE",
+            .entries = maxPathDst,
+            .reserved = 0,
+            .key_len = sizeof(struct doca_ar_path_key),
+            .hash_func = rte_hash_crc,
+            .hash_func_init_val = 0,
+            .socket_id = rte_socket_id(),
+            .extra_flag = RTE_HASH_EXTRA_FLAGS_RW_CONCURRENCY_LF | RTE_HASH_EXTRA_FLAGS_MULTI_WRITER_ADD, // workers may add concurrently, lock-free readers
+        };
+    PATH_TABLE = rte_hash_create(&PathTable);
+    if (!PATH_TABLE)
+    {
+        DOCA_LOG_ERR("Create PathTable fail!");
+        return -1;
+    }
+    DOCA_LOG_INFO("Create PATH_TABLE[%d] success", maxPathDst);
+    return 0;
+}
+
+struct doca_ar_path_entry *doca_ar_path_lookup(const struct doca_ar_path_key *key)
+{
+    int pos = rte_hash_lookup(PATH_TABLE, key);
+    return pos >= 0 && pos < maxPathDst ? &PATH_ENTRIES[pos] : NULL;
+}
+
+/**
+ * @brief copy the paths towards the destination of a conn if every one of them is fresher than the TTL
+ *
+ * @param conn
+ * @param paths
+ * @return int amount of paths, 0 if the destination should be probed
+ */
+static int path_read_fresh(struct doca_ar_conn *conn, struct doca_ar_path *paths)
+{
+    struct doca_ar_path_key key = {.sip = conn->match.sip, .dip = conn->match.dip, .ipv6 = conn->match.ipv6};
+    uint64_t now = rte_rdtsc(), ttl = (uint64_t)ar_config.pathTtlMs * rte_get_tsc_hz() / 1000;
+    uint32_t seq;
+    int nb_paths;
+
+    if (ttl == 0)
+        return 0;
+    struct doca_ar_path_entry *entry = doca_ar_path_lookup(&key);
+    if (entry == NULL)
+        return 0;
+    do
+    {
+        seq = entry->seq;
+        rte_smp_rmb();
+        nb_paths = entry->nb_paths;
+        rte_memcpy(paths, entry->paths, sizeof(struct doca_ar_path) * PROBE_PATH_AMOUNT);
+        rte_smp_rmb();
+    } while ((seq & 1) || seq != entry->seq);
+
+    for (int p = 0; p < nb_paths; p++)
+    {
+        if (now - paths[p].updated >= ttl)
+            return 0;
+    }
+    return nb_paths;
+}
+
+int doca_ar_path_choose(struct doca_ar_conn *conn)
+{
+    struct doca_ar_path paths[PROBE_PATH_AMOUNT];
+    uint32_t bestRtt = UINT32_MAX;
+    int nb_paths = path_read_fresh(conn, paths);
+
+    if (nb_paths == 0)
+        return 0;
+
+    memset(conn->probePort, 0, sizeof(conn->probePort));
+    for (int p = 0; p < nb_paths; p++)
+    {
+        conn->probePort[p] = paths[p].sport;
+        conn->probeRtt[p] = paths[p].rtt;
+        if (paths[p].rtt < bestRtt)
+        {
+            bestRtt = paths[p].rtt;
+            conn->bestPath = paths[p].sport;
+        }
+    }
+    if (bestRtt != UINT32_MAX && conn->bestPath != conn->match.sport)
+        doca_ar_stats()->pathSwitch++;
+    return bestRtt != UINT32_MAX;
+}
+
+uint16_t doca_ar_path_better(struct doca_ar_conn *conn, uint32_t hysteresis)
+{
+    struct doca_ar_path paths[PROBE_PATH_AMOUNT];
+    uint32_t curRtt = 0, bestRtt = UINT32_MAX;
+    uint16_t best = 0;
+    int nb_paths = path_read_fresh(conn, paths), cur = -1;
+
+    for (int p = 0; p < nb_paths; p++)
+    {
+        if (paths[p].sport == conn->bestPath)
+        {
+            cur = p;
+            curRtt = paths[p].rtt;
+        }
+        else if (paths[p].rtt < bestRtt)
+        {
+            bestRtt = paths[p].rtt;
+            best = paths[p].sport;
+        }
+    }
+    // a conn on a path the table does not know cannot be compared
+    if (cur < 0 || bestRtt == UINT32_MAX)
+        return 0;
+    if (curRtt != UINT32_MAX && (curRtt - RTE_MIN(curRtt, bestRtt) < PATH_MIN_GAIN_NS ||
+                                 (uint64_t)bestRtt * (100 + hysteresis) >= (uint64_t)curRtt * 100))
+        return 0;
+    return best;
+}
+
+/**
+ * @brief keep the least delayed offset sample within PATH_OFFSET_WINDOW_MS
+ *
+ * @param entry locked by the caller
+ * @param owd
+ * @param now
+ */
+static void path_update_offset(struct doca_ar_path_entry *entry, const struct doca_ar_path_owd *owd, uint64_t now)
+{
+    if (owd->delay == UINT32_MAX)
+        return;
+    if (entry->offsetUpdated == 0)
+    {
+        // the floors so far still carry the offset
+        for (int p = 0; p < PROBE_PATH_AMOUNT; p++)
+            entry->paths[p].floorUpdated = 0;
+    }
+    else if (owd->delay > entry->offsetDelay && now - entry->offsetUpdated < (uint64_t)PATH_OFFSET_WINDOW_MS * rte_get_tsc_hz() / 1000)
+        return;
+    entry->offset = owd->offset;
+    entry->offsetDelay = owd->delay;
+    entry->offsetUpdated = now;
+}
+
+/**
+ * @brief lower the forward delay floor of every path, and turn the delays into forward delay variation with --probe-metric fwdvar
+ *
+ * @param entry locked by the caller, fwd of its first nb paths is up to date
+ * @param rtt
+ * @param nb
+ * @param now
+ */
+static void path_update_floor(struct doca_ar_path_entry *entry, uint32_t *rtt, int nb, uint64_t now)
+{
+    uint64_t window = (uint64_t)PATH_FLOOR_WINDOW_MS * rte_get_tsc_hz() / 1000;
+    int64_t dstFloor = INT64_MAX;
+
+    for (int p = 0; p < nb; p++)
+    {
+        struct doca_ar_path *path = &entry->paths[p];
+        if (path->floorUpdated && now - path->floorUpdated >= window)
+            path->floorUpdated = 0;
+        if (path->floorUpdated)
+            dstFloor = RTE_MIN(dstFloor, path->floor);
+        dstFloor = RTE_MIN(dstFloor, path->fwd);
+    }
+    for (int p = 0; p < nb; p++)
+    {
+        struct doca_ar_path *path = &entry->paths[p];
+        if (path->fwd == INT64_MAX)
+            continue;
+        if (path->floorUpdated == 0)
+        {
+            path->floor = dstFloor;
+            path->floorUpdated = now;
+        }
+        path->floor = RTE_MIN(path->floor, path->fwd);
+        if (ar_config.probeMetric == PROBE_METRIC_FWDVAR && rtt[p] != UINT32_MAX)
+            rtt[p] = (uint32_t)RTE_MIN(path->fwd - path->floor, (int64_t)UINT32_MAX - 1);
+    }
+}
+
+/**
+ * @brief whether a destination was neither measured nor used by a new conn within the window
+ *
+ * @param entry
+ * @param now
+ * @param window[tsc]
+ * @return true
+ * @return false
+ */
+static bool path_stale(const struct doca_ar_path_entry *entry, uint64_t now, uint64_t window)
+{
+    if (entry->nb_paths == 0) // added and not written yet
+        return false;
+    if (entry->lastUsed != 0 && now - entry->lastUsed < window)
+        return false;
+    for (int p = 0; p < entry->nb_paths; p++)
+    {
+        if (now - entry->paths[p].updated < window)
+            return false;
+    }
+    return true;
+}
+
+int doca_ar_path_evict(uint64_t now)
+{
+    uint64_t hz = rte_get_tsc_hz(), window = (uint64_t)PATH_EVICT_MS * hz / 1000;
+    struct doca_ar_path_key *key;
+    void *data;
+    uint32_t iter = 0, nb = 0;
+    int32_t pos, stale[PATH_EVICT_BURST];
+
+    if (now < nextEvict || !rte_spinlock_trylock(&evictLock))
+        return 0;
+    if (now < nextEvict)
+    {
+        rte_spinlock_unlock(&evictLock);
+        return 0;
+    }
+    nextEvict = now + (uint64_t)PATH_EVICT_INTERVAL_MS * hz / 1000;
+    // nobody looked the keys deleted by the previous scan up since, their slots can be reused
+    for (uint32_t i = 0; i < nbRetired; i++)
+        rte_hash_free_key_with_position(PATH_TABLE, retiredPos[i]);
+    nbRetired = 0;
+    // keys are not deleted while iterating
+    while (nb < PATH_EVICT_BURST && (pos = rte_hash_iterate(PATH_TABLE, (const void **)&key, &data, &iter)) >= 0)
+    {
+        if (pos < maxPathDst && path_stale(&PATH_ENTRIES[pos], now, window))
+            stale[nb++] = pos;
+    }
+    for (uint32_t i = 0; i < nb; i++)
+    {
+        struct doca_ar_path_entry *entry = &PATH_ENTRIES[stale[i]];
+        rte_spinlock_lock(&entry->lock);
+        // skipped if it was measured again since the scan
+        if (path_stale(entry, now, window) && rte_hash_del_key(PATH_TABLE, &entry->key) == stale[i])
+        {
+            entry->seq++;
+            rte_smp_wmb();
+            entry->nb_paths = 0;
+            entry->lastUsed = 0;
+            entry->offsetUpdated = 0;
+            rte_smp_wmb();
+            entry->seq++;
+            retiredPos[nbRetired++] = stale[i];
+        }
+        rte_spinlock_unlock(&entry->lock);
+    }
+    nb = nbRetired;
+    rte_spinlock_unlock(&evictLock);
+    return nb;
+}
+
+void doca_ar_path_update(const struct doca_ar_path_key *key, const uint16_t *ports, uint32_t *rtt, int nb, const struct doca_ar_path_owd *owd)
+{
+    uint64_t now = rte_rdtsc();
+
+    doca_ar_path_evict(now);
+    struct doca_ar_path_entry *entry = doca_ar_path_lookup(key);
+    if (entry == NULL)
+    {
+        int pos = rte_hash_add_key(PATH_TABLE, key);
+        if (pos < 0 || pos >= maxPathDst)
+        {
+            DOCA_LOG_ERR("No space in PATH_TABLE.....");
+            return;
+        }
+        entry = &PATH_ENTRIES[pos];
+    }
+    nb = RTE_MIN(nb, PROBE_PATH_AMOUNT);
+
+    rte_spinlock_lock(&entry->lock);
+    entry->seq++;
+    rte_smp_wmb();
+    if (entry->nb_paths == 0)
+        entry->key = *key;
+    if (owd != NULL)
+        path_update_offset(entry, owd, now);
+    for (int p = 0; p < nb; p++)
+    {
+        struct doca_ar_path *path = &entry->paths[p];
+        if (p >= entry->nb_paths || path->sport != ports[p])
+        {
+            path->loss = 0; // a new path
+            path->floorUpdated = 0;
+        }
+        path->loss = path->loss - path->loss / 8 + (rtt[p] == UINT32_MAX ? PATH_LOSS_SCALE / 8 : 0);
+        path->sport = ports[p];
+        path->fwd = INT64_MAX;
+        if (owd != NULL && owd->fwd[p] != INT64_MAX)
+            path->fwd = owd->fwd[p] - (entry->offsetUpdated ? entry->offset : 0);
+        path->updated = now;
+    }
+    path_update_floor(entry, rtt, nb, now);
+    for (int p = 0; p < nb; p++)
+        entry->paths[p].rtt = rtt[p];
+    entry->nb_paths = nb;
+    rte_smp_wmb();
+    entry->seq++;
+    rte_spinlock_unlock(&entry->lock);
+}
+
+void doca_ar_dump_path(struct cmdline *cl)
+{
+    struct doca_ar_path_key *key;
+    void *data;
+    uint32_t iter = 0;
+    uint64_t now = rte_rdtsc(), hz = rte_get_tsc_hz();
+    while (1)
+    {
+        int pos = rte_hash_iterate(PATH_TABLE, (const void **)&key, &data, &iter);
+        if (pos < 0)
+            break;
+        struct doca_ar_path_entry *entry = &PATH_ENTRIES[pos];
+        char sip[INET6_ADDRSTRLEN], dip[INET6_ADDRSTRLEN];
+        doca_ar_sprint_addr(sip, sizeof(sip), key->sip, key->ipv6);
+        doca_ar_sprint_addr(dip, sizeof(dip), key->dip, key->ipv6);
+        if (entry->offsetUpdated)
+            cmdline_printf(cl, "(SIP=%s,DIP=%s) Offset=%ldns(delay %u.%03uus, %lums ago)\n", sip, dip, entry->offset,
+                           entry->offsetDelay / 1000, entry->offsetDelay % 1000, (now - entry->offsetUpdated) * 1000 / hz);
+        else
+            cmdline_printf(cl, "(SIP=%s,DIP=%s)\n", sip, dip);
+        for (int p = 0; p < entry->nb_paths; p++)
+        {
+            struct doca_ar_path *path = &entry->paths[p];
+            if (path->rtt == UINT32_MAX)
+                cmdline_printf(cl, "    SPORT=%u RTT=lost", rte_be_to_cpu_16(path->sport));
+            else
+                cmdline_printf(cl, "    SPORT=%u RTT=%u.%03uus", rte_be_to_cpu_16(path->sport), path->rtt / 1000, path->rtt % 1000);
+            if (path->fwd != INT64_MAX)
+                cmdline_printf(cl, " Forward=%ldns Floor=%ldns", path->fwd, path->floor);
+            cmdline_printf(cl, " Loss=%u.%u%% Age=%lums\n", path->loss * 100 / PATH_LOSS_SCALE, path->loss * 1000 / PATH_LOSS_SCALE % 10,
+                           (now - path->updated) * 1000 / hz);
+        }
+    }
+    cmdline_printf(cl, "Total Destinations: %d\n", rte_hash_count(PATH_TABLE));
+}
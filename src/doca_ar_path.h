@@ -0,0 +1,148 @@
+/**
+ * @file doca_ar_path.h
+ * @author Mark Chen (markchen77888@gmail.com)
+ * @brief path quality table: recent RTT of every entropy src port towards a destination VTEP
+ * @version 1.0
+ * @date 2024-01-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef DOCA_AR_PATH_H_
+#define DOCA_AR_PATH_H_
+#include "doca_ar_env.h"
+#include "doca_ar_conntrack.h"
+#include <cmdline.h>
+#include <rte_spinlock.h>
+
+#define MAX_PATH_DST 4096 ///< maximum VTEP pairs recorded in the path table
+
+/**
+ * @brief key of the path table: the outer ip pair of a VTEP pair
+ *
+ */
+struct doca_ar_path_key
+{
+    uint32_t sip;  ///< ipv4 address, or id of the ipv6 address on an ipv6 underlay
+    uint32_t dip;
+    uint32_t ipv6; ///< same as doca_ar_conn_match.ipv6
+};
+
+#define PATH_LOSS_SCALE 1024 ///< loss rate of a path is kept as an EWMA in [0, PATH_LOSS_SCALE]
+#define PATH_MIN_GAIN_NS 2000 ///< a conn is only moved onto a path at least this much faster, whatever the hysteresis[ns]
+#define PATH_OFFSET_WINDOW_MS 250  ///< the clock offset is taken from the least delayed sample within this window, the clocks drift apart meanwhile
+#define PATH_FLOOR_WINDOW_MS 10000 ///< the forward delay floor of a path is forgotten after this long, routes and the offset estimate change
+#define PATH_EVICT_MS 10000          ///< a destination neither measured nor used for this long is evicted from the path table[ms]
+#define PATH_EVICT_INTERVAL_MS 1000  ///< the path table is scanned for stale destinations this often[ms]
+#define PATH_EVICT_BURST 256         ///< destinations evicted per scan at most
+
+/**
+ * @brief one-way delays measured by a probe round, from replies stamped by a reflector
+ *
+ * A reply stamped on both ways gives an offset sample like NTP: the reflector clock runs offset = (fwd - rev) / 2 ahead,
+ * exact when both directions are equally delayed, so only the least delayed sample is trusted.
+ */
+struct doca_ar_path_owd
+{
+    int64_t fwd[PROBE_PATH_AMOUNT]; ///< least forward delay plus clock offset[ns] of every path, INT64_MAX without a stamped reply
+    int64_t offset;                 ///< offset sample of the round: reflector clock minus sender clock[ns]
+    uint32_t delay;                 ///< fwd + rev of the reply giving offset[ns], UINT32_MAX if no reply was stamped both ways
+};
+
+/**
+ * @brief quality of one path, the path is addressed by the outer src port leading onto it
+ *
+ */
+struct doca_ar_path
+{
+    uint16_t sport;   ///< entropy src port (big endian)
+    uint16_t loss;    ///< EWMA of the probe loss rate[1/PATH_LOSS_SCALE]
+    uint32_t rtt;     ///< latest measured RTT[ns], UINT32_MAX if the probe was lost, the forward delay variation with --probe-metric fwdvar
+    uint64_t updated; ///< tsc of the latest measurement
+    int64_t fwd;      ///< latest forward delay[ns], less the clock offset once it is estimated, INT64_MAX if not stamped
+    int64_t floor;    ///< least forward delay within PATH_FLOOR_WINDOW_MS[ns], same clock as fwd
+    uint64_t floorUpdated; ///< tsc when floor was set from scratch, 0 if unknown
+};
+
+/**
+ * @brief all the known paths towards a destination VTEP
+ *
+ * Writers (the prober lcore, or the workers when probing on demand) serialize on lock, readers are lock-free:
+ * the writer makes seq odd while updating the paths, readers retry until they see the same even seq before and after reading.
+ */
+struct doca_ar_path_entry
+{
+    volatile uint32_t seq;       ///< sequence counter guarding nb_paths and paths
+    rte_spinlock_t lock;         ///< taken by writers only
+    struct doca_ar_path_key key;
+    uint16_t nb_paths;
+    struct doca_ar_path paths[PROBE_PATH_AMOUNT];
+    volatile uint64_t lastUsed;  ///< tsc of the latest new conn towards this destination, 0 if the prober dropped it
+    int64_t offset;              ///< estimated reflector clock minus sender clock[ns]
+    uint32_t offsetDelay;        ///< fwd + rev of the sample giving offset[ns]
+    uint64_t offsetUpdated;      ///< tsc of the sample giving offset, 0 if not estimated yet
+} __rte_cache_aligned;
+
+/**
+ * @brief init the path table
+ *
+ * @param maxDst
+ * @return int
+ */
+int doca_ar_path_init_env(int maxDst);
+/**
+ * @brief choose the best path of a new conn from the path table without probing
+ *
+ * @param conn bestPath, probePort and probeRtt are filled on success
+ * @return int 1 if every known path towards the destination is fresher than the TTL, 0 if it should be probed
+ */
+int doca_ar_path_choose(struct doca_ar_conn *conn);
+/**
+ * @brief find a path clearly faster than the current path of a conn
+ *
+ * Only fresh RTT in the path table is compared, the conn's path must be one of the known paths.
+ * A lost current path loses against any measured path.
+ *
+ * @param conn
+ * @param hysteresis the new path must be this much faster than the current one[%]
+ * @return uint16_t src port of the faster path (big endian), 0 if the conn should stay
+ */
+uint16_t doca_ar_path_better(struct doca_ar_conn *conn, uint32_t hysteresis);
+/**
+ * @brief record the RTT measured by a probe, and fold its one-way delays into the clock offset and the forward delay floors
+ *
+ * With --probe-metric fwdvar the delay of every path with a stamped reply is replaced by its forward delay above the floor.
+ * A path without a floor yet is compared against the least floor of the destination, as if it were equally long.
+ *
+ * @param key VTEP pair of the probed paths
+ * @param ports src port of every probed path
+ * @param rtt delay[ns] of every probed path, UINT32_MAX if lost, replaced by the forward delay variation with --probe-metric fwdvar
+ * @param nb amount of probed paths
+ * @param owd one-way delays of the probed paths, NULL if none
+ */
+void doca_ar_path_update(const struct doca_ar_path_key *key, const uint16_t *ports, uint32_t *rtt, int nb, const struct doca_ar_path_owd *owd);
+/**
+ * @brief evict the destinations neither measured nor used within PATH_EVICT_MS, at most once per PATH_EVICT_INTERVAL_MS
+ *
+ * Called by whichever lcore updates the path table. An evicted key is deleted from PATH_TABLE at once, but its slot is only
+ * released by the next scan, so a writer or reader still holding the entry never sees it taken by another destination.
+ *
+ * @param now tsc
+ * @return int amount of destinations evicted
+ */
+int doca_ar_path_evict(uint64_t now);
+/**
+ * @brief find the path entry of a VTEP pair
+ *
+ * @param key
+ * @return struct doca_ar_path_entry* NULL if the destination has never been probed
+ */
+struct doca_ar_path_entry *doca_ar_path_lookup(const struct doca_ar_path_key *key);
+/**
+ * @brief print the whole path table onto cmdline
+ *
+ * @param cl
+ */
+void doca_ar_dump_path(struct cmdline *cl);
+
+#endif /* DOCA_AR_PATH_H_ */
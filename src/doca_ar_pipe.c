@@ -9,20 +9,44 @@
  *
  */
 #include "doca_ar_pipe.h"
+#include "doca_ar_probe.h"
+#include "doca_ar_stats.h"
+#include <rte_cycles.h>
 DOCA_LOG_REGISTER(DOCA_AR_PIPE);
 
-struct doca_flow_pipe *upstream_vxlanPipe = NULL;     ///< critical doca-flow pipe used to fwd vxlan connection from host and routing them onto the best path
+struct doca_flow_pipe *upstream_vxlanPipe = NULL;     ///< critical doca-flow pipe used to fwd vxlan connection from host and routing them onto the best path, the root of upstream_vxlanPipes
+struct doca_flow_pipe *upstream_vxlanPipes[2][NB_VXLAN_PIPES] = {{NULL}}; ///< one pipe per underlay (ipv4, ipv6) and inner class, chained by their miss
 struct doca_flow_pipe *upstream_rssPipe = NULL;       ///< fwd the new flow from host onto the control plane (ARM)
+struct doca_flow_pipe *upstream_rss6Pipe = NULL;      ///< upstream_rssPipe of the ipv6 underlay, chained behind it
 struct doca_flow_pipe *downstream_rssPipe = NULL;     ///< fwd the probe packets from network onto the control plane
+struct doca_flow_pipe *downstream_rss6Pipe = NULL;    ///< downstream_rssPipe of the ipv6 underlay, chained behind it
 struct doca_flow_pipe *downstream_hairpinPipe = NULL; ///< fwd other traffic from network to host
+struct doca_flow_pipe *downstream_icmpPipe = NULL;    ///< fwd icmp from network onto the prober for path discovery, see --path-discovery
+struct doca_flow_pipe *downstream_icmp6Pipe = NULL;   ///< downstream_icmpPipe of the ipv6 underlay, chained behind it
+struct doca_flow_pipe *reflectorPipe = NULL;          ///< --role reflector: send probes from network back to their sender
+struct doca_flow_pipe *reflector6Pipe = NULL;         ///< reflectorPipe of the ipv6 underlay, chained behind it
+struct doca_flow_pipe *upstream_hairpinPipe = NULL;   ///< --role reflector: fwd all traffic from host to network
+static uint32_t nbPendingEntries[MAX_WORKERS] = {0};  ///< entry operations queued on every pipe queue but not completed yet
+static struct doca_ar_aging_stats agingStats[MAX_WORKERS] = {0}; ///< aging counters of every worker
+static uint64_t nextAging[MAX_WORKERS] = {0};          ///< timer cycles of the next aging round of every worker
 
 /**
- * @brief build critical doca-flow pipe used to fwd vxlan connection from host and routing them onto the best path
+ * @brief build a doca-flow pipe used to fwd vxlan connection from host and routing them onto the best path
  *
- * @return int
+ * The outer ip type and the inner l4 type are fixed per pipe, so every underlay gets a pipe for conns of inner tcp, inner udp
+ * and the others, all chained by their miss.
+ *
+ * @param name
+ * @param ipType DOCA_FLOW_IP4_ADDR or DOCA_FLOW_IP6_ADDR of the underlay
+ * @param inProto DOCA_PROTO_TCP or DOCA_PROTO_UDP to match the inner 5-tuple, 0 to match the outer 4-tuple and the vni only
+ * @param is_root
+ * @param next_pipe where misses go
+ * @return struct doca_flow_pipe*
  */
-int build_upstream_vxlanPipe()
+static struct doca_flow_pipe *build_vxlan_pipe(const char *name, enum doca_flow_ip_type ipType, uint8_t inProto, bool is_root,
+                                               struct doca_flow_pipe *next_pipe)
 {
+    struct doca_flow_pipe *pipe;
     struct doca_flow_match match;
     struct doca_flow_monitor monitor;
     struct doca_flow_actions actions, *actions_arr[1];
@@ -42,7 +66,7 @@ int build_upstream_vxlanPipe()
     memset(&pipe_cfg, 0, sizeof(pipe_cfg));
     memset(&descs, 0, sizeof(descs));
 
-    pipe_cfg.attr.name = "upstream_vxlanPipe";
+    pipe_cfg.attr.name = name;
     pipe_cfg.attr.type = DOCA_FLOW_PIPE_BASIC;
     pipe_cfg.match = &match;
     actions_arr[0] = &actions;
@@ -50,47 +74,101 @@ int build_upstream_vxlanPipe()
     descs_arr[0] = &descs;
     pipe_cfg.action_descs = descs_arr;
     pipe_cfg.attr.nb_actions = 1;
-    pipe_cfg.attr.is_root = true;
+    pipe_cfg.attr.is_root = is_root;
     pipe_cfg.port = port;
     pipe_cfg.monitor = &monitor;
-    pipe_cfg.attr.nb_flows = MAX_CONNTRACK;
+    pipe_cfg.attr.nb_flows = ar_config.maxConnsLimit; // conntrack may grow up to it at runtime
 
     monitor.flags = DOCA_FLOW_MONITOR_AGING;
+    if (ar_config.rerouteIntervalMs)
+        monitor.flags |= DOCA_FLOW_MONITOR_COUNT; // flowlet gaps are found by sampling the counters
 
     // 5-tuple match (sip,dip,udp,sport,dport)
     match.out_l4_type = DOCA_PROTO_UDP;
-    match.out_src_ip.type = DOCA_FLOW_IP4_ADDR;
-    match.out_src_ip.ipv4_addr = 0xffffffff;
-    match.out_dst_ip.type = DOCA_FLOW_IP4_ADDR;
-    match.out_dst_ip.ipv4_addr = 0xffffffff;
+    match.out_src_ip.type = ipType;
+    match.out_dst_ip.type = ipType;
+    if (ipType == DOCA_FLOW_IP6_ADDR)
+    {
+        memset(match.out_src_ip.ipv6_addr, 0xff, sizeof(match.out_src_ip.ipv6_addr));
+        memset(match.out_dst_ip.ipv6_addr, 0xff, sizeof(match.out_dst_ip.ipv6_addr));
+    }
+    else
+    {
+        match.out_src_ip.ipv4_addr = 0xffffffff;
+        match.out_dst_ip.ipv4_addr = 0xffffffff;
+    }
     match.out_src_port = 0xffff;
     match.out_dst_port = 0xffff;
+    match.tun.type = DOCA_FLOW_TUN_VXLAN;
+    match.tun.vxlan_tun_id = 0xffffffff;
+    if (inProto)
+    {
+        // inner 5-tuple, overlay conns between the same VTEPs are routed apart
+        match.in_src_ip.type = DOCA_FLOW_IP4_ADDR;
+        match.in_src_ip.ipv4_addr = 0xffffffff;
+        match.in_dst_ip.type = DOCA_FLOW_IP4_ADDR;
+        match.in_dst_ip.ipv4_addr = 0xffffffff;
+        match.in_l4_type = inProto;
+        match.in_src_port = 0xffff;
+        match.in_dst_port = 0xffff;
+    }
 
     fwd.type = DOCA_FLOW_FWD_PORT;
     fwd.port_id = port_id ^ 1;
 
     miss_fwd.type = DOCA_FLOW_FWD_PIPE;
-    miss_fwd.next_pipe = upstream_rssPipe;
+    miss_fwd.next_pipe = next_pipe;
 
     // only modify sport for Adaptive Routing
     actions.mod_src_port = 0xffff;
 
-    upstream_vxlanPipe = doca_flow_pipe_create(&pipe_cfg, &fwd, &miss_fwd, &error);
-    if (upstream_vxlanPipe == NULL)
+    pipe = doca_flow_pipe_create(&pipe_cfg, &fwd, &miss_fwd, &error);
+    if (pipe == NULL)
     {
-        DOCA_LOG_ERR("build_upstream_vxlanPipe ERR,  - %s (%u)", error.message, error.type);
-        return -1;
+        DOCA_LOG_ERR("build %s ERR,  - %s (%u)", name, error.message, error.type);
+        return NULL;
+    }
+    DOCA_LOG_INFO("build %s success", name);
+    return pipe;
+}
+/**
+ * @brief build critical doca-flow pipes used to fwd vxlan connection from host and routing them onto the best path
+ *
+ * @return int
+ */
+int build_upstream_vxlanPipe()
+{
+    static const char *names[2][NB_VXLAN_PIPES] = {
+        {"upstream_vxlanPipe", "upstream_vxlanUdpPipe", "upstream_vxlanOuterPipe"},
+        {"upstream_vxlan6Pipe", "upstream_vxlan6UdpPipe", "upstream_vxlan6OuterPipe"},
+    };
+    static const uint8_t inProtos[NB_VXLAN_PIPES] = {DOCA_PROTO_TCP, DOCA_PROTO_UDP, 0};
+    struct doca_flow_pipe *next = upstream_rssPipe;
+    // built from the tail of the chain: ipv6 outer, ..., ipv4 udp, then the root ipv4 tcp
+    for (int v6 = 1; v6 >= 0; v6--)
+    {
+        for (int i = NB_VXLAN_PIPES - 1; i >= 0; i--)
+        {
+            next = build_vxlan_pipe(names[v6][i], v6 ? DOCA_FLOW_IP6_ADDR : DOCA_FLOW_IP4_ADDR, inProtos[i], !v6 && i == 0, next);
+            if (next == NULL)
+                return -1;
+            upstream_vxlanPipes[v6][i] = next;
+        }
     }
-    DOCA_LOG_INFO("build_upstream_vxlanPipe success");
+    upstream_vxlanPipe = upstream_vxlanPipes[0][VXLAN_PIPE_TCP];
     return 0;
 }
 /**
  * @brief  fwd the new flow from host onto the control plane (ARM)
  *
- * @return int
+ * @param name
+ * @param ipType DOCA_FLOW_IP4_ADDR or DOCA_FLOW_IP6_ADDR of the underlay
+ * @param next_pipe where misses go, NULL to drop them
+ * @return struct doca_flow_pipe*
  */
-int build_upstream_rssPipe()
+static struct doca_flow_pipe *build_upstream_rssPipe(const char *name, enum doca_flow_ip_type ipType, struct doca_flow_pipe *next_pipe)
 {
+    struct doca_flow_pipe *pipe;
     struct doca_flow_match match, entryMatch;
     struct doca_flow_fwd fwd, miss_fwd;
     struct doca_flow_pipe_cfg pipe_cfg = {0};
@@ -105,56 +183,70 @@ int build_upstream_rssPipe()
     memset(&miss_fwd, 0, sizeof(miss_fwd));
     memset(&pipe_cfg, 0, sizeof(pipe_cfg));
 
-    pipe_cfg.attr.name = "upstream_rssPipe";
+    pipe_cfg.attr.name = name;
     pipe_cfg.attr.type = DOCA_FLOW_PIPE_BASIC;
     pipe_cfg.match = &match;
     pipe_cfg.port = port;
 
     match.out_l4_type = DOCA_PROTO_UDP;
-    match.out_src_ip.type = DOCA_FLOW_IP4_ADDR;
-    match.out_dst_ip.type = DOCA_FLOW_IP4_ADDR;
+    match.out_src_ip.type = ipType;
+    match.out_dst_ip.type = ipType;
     match.out_dst_port = 0xffff;
 
-    uint16_t rss_queues[1] = {0};
+    // new flows are sharded over the workers, packets of a flow always hit the same worker
+    uint16_t rss_queues[MAX_WORKERS];
+    for (int q = 0; q < nb_workers; q++)
+        rss_queues[q] = q;
     fwd.type = DOCA_FLOW_FWD_RSS;
     fwd.rss_queues = rss_queues;
-    fwd.rss_flags = DOCA_FLOW_RSS_UDP;
-    fwd.num_of_queues = 1;
+    fwd.rss_flags = DOCA_FLOW_RSS_IP | DOCA_FLOW_RSS_UDP;
+    fwd.num_of_queues = nb_workers;
 
-    miss_fwd.type = DOCA_FLOW_FWD_DROP;
+    if (next_pipe != NULL)
+    {
+        miss_fwd.type = DOCA_FLOW_FWD_PIPE;
+        miss_fwd.next_pipe = next_pipe;
+    }
+    else
+        miss_fwd.type = DOCA_FLOW_FWD_DROP;
 
-    upstream_rssPipe = doca_flow_pipe_create(&pipe_cfg, &fwd, &miss_fwd, &error);
-    if (upstream_rssPipe == NULL)
+    pipe = doca_flow_pipe_create(&pipe_cfg, &fwd, &miss_fwd, &error);
+    if (pipe == NULL)
     {
-        DOCA_LOG_ERR("build_upstream_rssPipe ERR,  - %s (%u)", error.message, error.type);
-        return -1;
+        DOCA_LOG_ERR("build %s ERR,  - %s (%u)", name, error.message, error.type);
+        return NULL;
     }
-    DOCA_LOG_INFO("build_upstream_rssPipe success");
+    DOCA_LOG_INFO("build %s success", name);
 
     entryMatch.out_dst_port = rte_cpu_to_be_16(4789);
 
-    entry = doca_flow_pipe_add_entry(0, upstream_rssPipe, &entryMatch, NULL, NULL, NULL, 0, NULL, &error);
+    entry = doca_flow_pipe_add_entry(0, pipe, &entryMatch, NULL, NULL, NULL, 0, NULL, &error);
     if (entry == NULL)
     {
         DOCA_LOG_ERR("Entry is NULL - %s (%u)", error.message, error.type);
-        return -1;
+        return NULL;
     }
     int result = doca_flow_entries_process(port, 0, DEFAULT_TIMEOUT_US, num_of_entries);
     if (result != num_of_entries || doca_flow_pipe_entry_get_status(entry) != DOCA_FLOW_ENTRY_STATUS_SUCCESS)
     {
-        DOCA_LOG_ERR("add entry into upstream_rssPipe ERR,  - %s (%u)", error.message, error.type);
-        return -1;
+        DOCA_LOG_ERR("add entry into %s ERR,  - %s (%u)", name, error.message, error.type);
+        return NULL;
     }
-    DOCA_LOG_INFO("add entry into upstream_rssPipe success");
-    return 0;
+    DOCA_LOG_INFO("add entry into %s success", name);
+    return pipe;
 }
 /**
- * @brief fwd the probe packets from network onto the control plane
+ * @brief fwd the probe replies from network onto probe_queue
  *
- * @return int
+ * @param name
+ * @param ipType DOCA_FLOW_IP4_ADDR or DOCA_FLOW_IP6_ADDR of the underlay
+ * @param is_root
+ * @param next_pipe where misses go
+ * @return struct doca_flow_pipe*
  */
-int build_downstream_rssPipe()
+static struct doca_flow_pipe *build_downstream_rssPipe(const char *name, enum doca_flow_ip_type ipType, bool is_root, struct doca_flow_pipe *next_pipe)
 {
+    struct doca_flow_pipe *pipe;
     struct doca_flow_match match, entryMatch;
     struct doca_flow_fwd fwd, miss_fwd;
     struct doca_flow_pipe_cfg pipe_cfg = {0};
@@ -168,50 +260,117 @@ int build_downstream_rssPipe()
     memset(&miss_fwd, 0, sizeof(miss_fwd));
     memset(&pipe_cfg, 0, sizeof(pipe_cfg));
 
-    pipe_cfg.attr.name = "downstream_rssPipe";
+    pipe_cfg.attr.name = name;
     pipe_cfg.attr.type = DOCA_FLOW_PIPE_BASIC;
     pipe_cfg.match = &match;
-    pipe_cfg.attr.is_root = true;
+    pipe_cfg.attr.is_root = is_root;
     pipe_cfg.port = port;
 
     match.out_l4_type = DOCA_PROTO_UDP;
-    match.out_src_ip.type = DOCA_FLOW_IP4_ADDR;
-    match.out_dst_ip.type = DOCA_FLOW_IP4_ADDR;
+    match.out_src_ip.type = ipType;
+    match.out_dst_ip.type = ipType;
     match.out_dst_port = 0xffff;
 
-    uint16_t rss_queues[1] = {0};
+    // probe replies have a queue of their own, polled by the prober if it is running, otherwise by the workers in turn
+    uint16_t rss_queues[1] = {probe_queue};
     fwd.type = DOCA_FLOW_FWD_RSS;
     fwd.rss_queues = rss_queues;
-    fwd.rss_flags = DOCA_FLOW_RSS_UDP;
+    fwd.rss_flags = DOCA_FLOW_RSS_IP | DOCA_FLOW_RSS_UDP;
     fwd.num_of_queues = 1;
 
     miss_fwd.type = DOCA_FLOW_FWD_PIPE;
-    miss_fwd.next_pipe = downstream_hairpinPipe;
+    miss_fwd.next_pipe = next_pipe;
 
-    downstream_rssPipe = doca_flow_pipe_create(&pipe_cfg, &fwd, &miss_fwd, &error);
-    if (downstream_rssPipe == NULL)
+    pipe = doca_flow_pipe_create(&pipe_cfg, &fwd, &miss_fwd, &error);
+    if (pipe == NULL)
     {
-        DOCA_LOG_ERR("build_downstream_rssPipe ERR,  - %s (%u)", error.message, error.type);
-        return -1;
+        DOCA_LOG_ERR("build %s ERR,  - %s (%u)", name, error.message, error.type);
+        return NULL;
     }
-    DOCA_LOG_INFO("build_downstream_rssPipe success");
+    DOCA_LOG_INFO("build %s success", name);
 
     entryMatch.out_dst_port = rte_cpu_to_be_16(4788);
 
-    entry = doca_flow_pipe_add_entry(0, downstream_rssPipe, &entryMatch, NULL, NULL, NULL, 0, NULL, &error);
+    entry = doca_flow_pipe_add_entry(0, pipe, &entryMatch, NULL, NULL, NULL, 0, NULL, &error);
     if (entry == NULL)
     {
         DOCA_LOG_ERR("Entry is NULL - %s (%u)", error.message, error.type);
-        return -1;
+        return NULL;
     }
     int result = doca_flow_entries_process(port, 0, DEFAULT_TIMEOUT_US, num_of_entries);
     if (result != num_of_entries || doca_flow_pipe_entry_get_status(entry) != DOCA_FLOW_ENTRY_STATUS_SUCCESS)
     {
-        DOCA_LOG_ERR("add entry into downstream_rssPipe ERR,  - %s (%u)", error.message, error.type);
-        return -1;
+        DOCA_LOG_ERR("add entry into %s ERR,  - %s (%u)", name, error.message, error.type);
+        return NULL;
     }
-    DOCA_LOG_INFO("add entry into downstream_rssPipe success");
-    return 0;
+    DOCA_LOG_INFO("add entry into %s success", name);
+    return pipe;
+}
+/**
+ * @brief fwd icmp from network onto the prober, time exceeded messages answer its ttl-limited probes and it passes the rest on to host
+ *
+ * @param name
+ * @param ipType DOCA_FLOW_IP4_ADDR or DOCA_FLOW_IP6_ADDR of the underlay
+ * @param l4Type DOCA_PROTO_ICMP or DOCA_PROTO_ICMP6
+ * @param next_pipe where misses go
+ * @return struct doca_flow_pipe*
+ */
+static struct doca_flow_pipe *build_downstream_icmpPipe(const char *name, enum doca_flow_ip_type ipType, uint8_t l4Type, struct doca_flow_pipe *next_pipe)
+{
+    struct doca_flow_pipe *pipe;
+    struct doca_flow_match match;
+    struct doca_flow_fwd fwd, miss_fwd;
+    struct doca_flow_pipe_cfg pipe_cfg = {0};
+    struct doca_flow_error error;
+    struct doca_flow_pipe_entry *entry;
+    int port_id = to_net_port, num_of_entries = 1;
+    struct doca_flow_port *port = ports[port_id];
+    uint16_t rss_queues[1] = {probe_queue};
+
+    memset(&match, 0, sizeof(match));
+    memset(&fwd, 0, sizeof(fwd));
+    memset(&miss_fwd, 0, sizeof(miss_fwd));
+    memset(&pipe_cfg, 0, sizeof(pipe_cfg));
+
+    pipe_cfg.attr.name = name;
+    pipe_cfg.attr.type = DOCA_FLOW_PIPE_BASIC;
+    pipe_cfg.match = &match;
+    pipe_cfg.port = port;
+
+    match.out_l4_type = l4Type;
+    match.out_src_ip.type = ipType;
+    match.out_dst_ip.type = ipType;
+
+    fwd.type = DOCA_FLOW_FWD_RSS;
+    fwd.rss_queues = rss_queues;
+    fwd.rss_flags = DOCA_FLOW_RSS_IP;
+    fwd.num_of_queues = 1;
+
+    miss_fwd.type = DOCA_FLOW_FWD_PIPE;
+    miss_fwd.next_pipe = next_pipe;
+
+    pipe = doca_flow_pipe_create(&pipe_cfg, &fwd, &miss_fwd, &error);
+    if (pipe == NULL)
+    {
+        DOCA_LOG_ERR("build %s ERR,  - %s (%u)", name, error.message, error.type);
+        return NULL;
+    }
+    DOCA_LOG_INFO("build %s success", name);
+
+    entry = doca_flow_pipe_add_entry(0, pipe, &match, NULL, NULL, NULL, 0, NULL, &error);
+    if (entry == NULL)
+    {
+        DOCA_LOG_ERR("Entry is NULL - %s (%u)", error.message, error.type);
+        return NULL;
+    }
+    int result = doca_flow_entries_process(port, 0, DEFAULT_TIMEOUT_US, num_of_entries);
+    if (result != num_of_entries || doca_flow_pipe_entry_get_status(entry) != DOCA_FLOW_ENTRY_STATUS_SUCCESS)
+    {
+        DOCA_LOG_ERR("add entry into %s ERR,  - %s (%u)", name, error.message, error.type);
+        return NULL;
+    }
+    DOCA_LOG_INFO("add entry into %s success", name);
+    return pipe;
 }
 /**
  * @brief  fwd other traffic from network to host
@@ -268,34 +427,238 @@ int build_downstream_hairpinPipe()
 
     return 0;
 }
-int doca_ar_pipe_init()
+/**
+ * @brief --role reflector: match probes by the vni in front of their payload, and send them back out of the network port,
+ * or onto the workers if they are reflected in software
+ *
+ * @param name
+ * @param ipType DOCA_FLOW_IP4_ADDR or DOCA_FLOW_IP6_ADDR of the underlay
+ * @param is_root
+ * @param next_pipe where misses go
+ * @return struct doca_flow_pipe*
+ */
+static struct doca_flow_pipe *build_reflectorPipe(const char *name, enum doca_flow_ip_type ipType, bool is_root, struct doca_flow_pipe *next_pipe)
+{
+    struct doca_flow_pipe *pipe;
+    struct doca_flow_match match, entryMatch;
+    struct doca_flow_actions actions, entryActions, *actions_arr[1];
+    struct doca_flow_fwd fwd, miss_fwd;
+    struct doca_flow_pipe_cfg pipe_cfg = {0};
+    struct doca_flow_error error;
+    struct doca_flow_pipe_entry *entry;
+    int port_id = to_net_port, num_of_entries = 1;
+    struct doca_flow_port *port = ports[port_id];
+    bool inHw = ar_config.hasReflectorMac && !ar_config.reflectorStamp;
+    uint16_t rss_queues[MAX_WORKERS];
+
+    memset(&match, 0, sizeof(match));
+    memset(&entryMatch, 0, sizeof(entryMatch));
+    memset(&actions, 0, sizeof(actions));
+    memset(&entryActions, 0, sizeof(entryActions));
+    memset(&fwd, 0, sizeof(fwd));
+    memset(&miss_fwd, 0, sizeof(miss_fwd));
+    memset(&pipe_cfg, 0, sizeof(pipe_cfg));
+
+    pipe_cfg.attr.name = name;
+    pipe_cfg.attr.type = DOCA_FLOW_PIPE_BASIC;
+    pipe_cfg.match = &match;
+    pipe_cfg.attr.is_root = is_root;
+    pipe_cfg.port = port;
+
+    match.out_l4_type = DOCA_PROTO_UDP;
+    match.out_src_ip.type = ipType;
+    match.out_dst_ip.type = ipType;
+    match.out_dst_port = 0xffff;
+    match.tun.type = DOCA_FLOW_TUN_VXLAN;
+    match.tun.vxlan_tun_id = 0xffffffff;
+
+    if (inHw)
+    {
+        // like the OvS rule: mod_dl_dst, mod_tp_dst:4788, output:IN_PORT
+        actions_arr[0] = &actions;
+        pipe_cfg.actions = actions_arr;
+        pipe_cfg.attr.nb_actions = 1;
+        memset(actions.mod_dst_mac, 0xff, sizeof(actions.mod_dst_mac));
+        actions.mod_dst_port = 0xffff;
+        fwd.type = DOCA_FLOW_FWD_PORT;
+        fwd.port_id = port_id;
+    }
+    else
+    {
+        for (int q = 0; q < nb_workers; q++)
+            rss_queues[q] = q;
+        fwd.type = DOCA_FLOW_FWD_RSS;
+        fwd.rss_queues = rss_queues;
+        fwd.rss_flags = DOCA_FLOW_RSS_IP | DOCA_FLOW_RSS_UDP;
+        fwd.num_of_queues = nb_workers;
+    }
+
+    miss_fwd.type = DOCA_FLOW_FWD_PIPE;
+    miss_fwd.next_pipe = next_pipe;
+
+    pipe = doca_flow_pipe_create(&pipe_cfg, &fwd, &miss_fwd, &error);
+    if (pipe == NULL)
+    {
+        DOCA_LOG_ERR("build %s ERR,  - %s (%u)", name, error.message, error.type);
+        return NULL;
+    }
+    DOCA_LOG_INFO("build %s success", name);
+
+    entryMatch.out_dst_port = rte_cpu_to_be_16(4789);
+    entryMatch.tun.vxlan_tun_id = rte_cpu_to_be_32(PROBE_VNI << 8);
+    rte_memcpy(entryActions.mod_dst_mac, ar_config.reflectorMac.addr_bytes, sizeof(entryActions.mod_dst_mac));
+    entryActions.mod_dst_port = rte_cpu_to_be_16(PROBE_REPLY_PORT);
+
+    entry = doca_flow_pipe_add_entry(0, pipe, &entryMatch, inHw ? &entryActions : NULL, NULL, NULL, 0, NULL, &error);
+    if (entry == NULL)
+    {
+        DOCA_LOG_ERR("Entry is NULL - %s (%u)", error.message, error.type);
+        return NULL;
+    }
+    int result = doca_flow_entries_process(port, 0, DEFAULT_TIMEOUT_US, num_of_entries);
+    if (result != num_of_entries || doca_flow_pipe_entry_get_status(entry) != DOCA_FLOW_ENTRY_STATUS_SUCCESS)
+    {
+        DOCA_LOG_ERR("add entry into %s ERR,  - %s (%u)", name, error.message, error.type);
+        return NULL;
+    }
+    DOCA_LOG_INFO("add entry into %s success", name);
+    return pipe;
+}
+/**
+ * @brief --role reflector: fwd all traffic from host to network
+ *
+ * @return int
+ */
+static int build_upstream_hairpinPipe()
+{
+    struct doca_flow_match match;
+    struct doca_flow_fwd fwd;
+    struct doca_flow_fwd fwd_miss;
+    struct doca_flow_pipe_cfg pipe_cfg = {0};
+    struct doca_flow_pipe_entry *entry;
+    int port_id = to_host_port, num_of_entries = 1, result = 0;
+    struct doca_flow_port *port = ports[port_id];
+    struct doca_flow_error error;
+
+    memset(&match, 0, sizeof(match));
+    memset(&fwd, 0, sizeof(fwd));
+    memset(&fwd_miss, 0, sizeof(fwd_miss));
+    memset(&pipe_cfg, 0, sizeof(pipe_cfg));
+
+    pipe_cfg.attr.name = "upstream_hairpinPipe";
+    pipe_cfg.attr.type = DOCA_FLOW_PIPE_BASIC;
+    pipe_cfg.attr.is_root = true;
+    pipe_cfg.match = &match;
+    pipe_cfg.port = port;
+
+    fwd.type = DOCA_FLOW_FWD_PORT;
+    fwd.port_id = port_id ^ 1;
+    fwd_miss.type = DOCA_FLOW_FWD_DROP;
+
+    upstream_hairpinPipe = doca_flow_pipe_create(&pipe_cfg, &fwd, &fwd_miss, &error);
+    if (upstream_hairpinPipe == NULL)
+    {
+        DOCA_LOG_ERR("build_upstream_hairpinPipe ERR,  - %s (%u)", error.message, error.type);
+        return -1;
+    }
+    DOCA_LOG_INFO("build_upstream_hairpinPipe success");
+
+    entry = doca_flow_pipe_add_entry(0, upstream_hairpinPipe, &match, NULL, NULL, NULL, 0, NULL, &error);
+    if (entry == NULL)
+    {
+        DOCA_LOG_ERR("Entry is NULL - %s (%u)", error.message, error.type);
+        return -1;
+    }
+    result = doca_flow_entries_process(port, 0, DEFAULT_TIMEOUT_US, num_of_entries);
+    if (result != num_of_entries || doca_flow_pipe_entry_get_status(entry) != DOCA_FLOW_ENTRY_STATUS_SUCCESS)
+    {
+        DOCA_LOG_ERR("add entry into upstream_hairpinPipe ERR,  - %s (%u)", error.message, error.type);
+        return -1;
+    }
+    DOCA_LOG_INFO("add entry into upstream_hairpinPipe success");
+
+    return 0;
+}
+/**
+ * @brief --role reflector: probes are reflected, everything else is hairpinned between host and network
+ *
+ * @return int
+ */
+static int hw_reflector_pipe_init()
 {
-    if (build_upstream_rssPipe())
+    if (build_upstream_hairpinPipe())
+        return -1;
+    if (build_downstream_hairpinPipe())
+        return -1;
+    reflector6Pipe = build_reflectorPipe("reflector6Pipe", DOCA_FLOW_IP6_ADDR, false, downstream_hairpinPipe);
+    if (reflector6Pipe == NULL)
+        return -1;
+    reflectorPipe = build_reflectorPipe("reflectorPipe", DOCA_FLOW_IP4_ADDR, true, reflector6Pipe);
+    if (reflectorPipe == NULL)
+        return -1;
+    return 0;
+}
+/**
+ * @brief build the four doca-flow pipes
+ *
+ * @return int
+ */
+static int hw_pipe_init()
+{
+    if (ar_config.role == ROLE_REFLECTOR)
+        return hw_reflector_pipe_init();
+    // every pipe matching the underlay has an ipv6 twin chained behind it
+    upstream_rss6Pipe = build_upstream_rssPipe("upstream_rss6Pipe", DOCA_FLOW_IP6_ADDR, NULL);
+    if (upstream_rss6Pipe == NULL)
+        return -1;
+    upstream_rssPipe = build_upstream_rssPipe("upstream_rssPipe", DOCA_FLOW_IP4_ADDR, upstream_rss6Pipe);
+    if (upstream_rssPipe == NULL)
         return -1;
     if (build_upstream_vxlanPipe())
         return -1;
     if (build_downstream_hairpinPipe())
         return -1;
-    if (build_downstream_rssPipe())
+    struct doca_flow_pipe *downstream_next = downstream_hairpinPipe;
+    if (ar_config.discoveryHops)
+    {
+        downstream_icmp6Pipe = build_downstream_icmpPipe("downstream_icmp6Pipe", DOCA_FLOW_IP6_ADDR, DOCA_PROTO_ICMP6, downstream_hairpinPipe);
+        if (downstream_icmp6Pipe == NULL)
+            return -1;
+        downstream_icmpPipe = build_downstream_icmpPipe("downstream_icmpPipe", DOCA_FLOW_IP4_ADDR, DOCA_PROTO_ICMP, downstream_icmp6Pipe);
+        if (downstream_icmpPipe == NULL)
+            return -1;
+        downstream_next = downstream_icmpPipe;
+    }
+    downstream_rss6Pipe = build_downstream_rssPipe("downstream_rss6Pipe", DOCA_FLOW_IP6_ADDR, false, downstream_next);
+    if (downstream_rss6Pipe == NULL)
+        return -1;
+    downstream_rssPipe = build_downstream_rssPipe("downstream_rssPipe", DOCA_FLOW_IP4_ADDR, true, downstream_rss6Pipe);
+    if (downstream_rssPipe == NULL)
         return -1;
     return 0;
 }
-int doca_ar_add_new_flow(struct doca_ar_conn *conn)
+/**
+ * @brief queue an entry of a conn to upstream_vxlanPipe, completed by doca_ar_flow_process_cb
+ *
+ * @param conn
+ * @return int
+ */
+static int hw_add_entry(struct doca_ar_conn *conn)
 {
+    struct doca_flow_pipe *pipe;
     struct doca_flow_match match;
     struct doca_flow_actions actions;
     struct doca_flow_pipe_entry *entry;
     struct doca_flow_error error;
     struct doca_flow_monitor monitor;
 
-    int result;
-    int num_of_entries = 1;
-
     memset(&match, 0, sizeof(match));
     memset(&actions, 0, sizeof(actions));
     memset(&monitor, 0, sizeof(monitor));
 
     monitor.flags |= DOCA_FLOW_MONITOR_AGING;
+    if (ar_config.rerouteIntervalMs)
+        monitor.flags |= DOCA_FLOW_MONITOR_COUNT;
     monitor.user_data = (uint64_t)(conn);
     monitor.aging = conn->expireTime;
 
@@ -303,44 +666,260 @@ int doca_ar_add_new_flow(struct doca_ar_conn *conn)
     match.out_dst_ip.ipv4_addr = conn->match.dip;
     match.out_src_port = conn->match.sport;
     match.out_dst_port = conn->match.dport;
+    match.tun.vxlan_tun_id = conn->match.vni;
+    if (conn->match.ipv6)
+    {
+        rte_memcpy(match.out_src_ip.ipv6_addr, doca_ar_addr6(conn->match.sip), sizeof(match.out_src_ip.ipv6_addr));
+        rte_memcpy(match.out_dst_ip.ipv6_addr, doca_ar_addr6(conn->match.dip), sizeof(match.out_dst_ip.ipv6_addr));
+    }
+    switch (conn->match.inProto)
+    {
+    case IPPROTO_TCP:
+        pipe = upstream_vxlanPipes[conn->match.ipv6][VXLAN_PIPE_TCP];
+        break;
+    case IPPROTO_UDP:
+        pipe = upstream_vxlanPipes[conn->match.ipv6][VXLAN_PIPE_UDP];
+        break;
+    default:
+        pipe = upstream_vxlanPipes[conn->match.ipv6][VXLAN_PIPE_OUTER];
+        break;
+    }
+    if (pipe != upstream_vxlanPipes[conn->match.ipv6][VXLAN_PIPE_OUTER])
+    {
+        match.in_src_ip.ipv4_addr = conn->match.inSip;
+        match.in_dst_ip.ipv4_addr = conn->match.inDip;
+        match.in_src_port = conn->match.inSport;
+        match.in_dst_port = conn->match.inDport;
+    }
 
     actions.action_idx = 0;
     /* modify destination mac address */
     actions.mod_src_port = conn->bestPath;
 
-    entry = doca_flow_pipe_add_entry(0, upstream_vxlanPipe, &match, &actions, &monitor, NULL, 0, NULL, &error);
+    if (nbPendingEntries[conn->queue] >= MAX_PENDING_ENTRIES)
+        doca_ar_flow_commit(conn->queue); // the pipe queue is full, make room before queuing more
+
+    // batched: the whole rx burst is pushed by one doca_ar_flow_commit
+    entry = doca_flow_pipe_add_entry(conn->queue, pipe, &match, &actions, &monitor, NULL, DOCA_FLOW_WAIT_FOR_BATCH, conn, &error);
     if (entry == NULL)
     {
         DOCA_LOG_ERR("Entry is NULL - %s (%u)", error.message, error.type);
+        doca_ar_stats()->offloadFail++;
         return 0;
     }
-    result = doca_flow_entries_process(ports[to_host_port], 0, DEFAULT_TIMEOUT_US, num_of_entries);
-    if (result != num_of_entries || doca_flow_pipe_entry_get_status(entry) != DOCA_FLOW_ENTRY_STATUS_SUCCESS)
+    nbPendingEntries[conn->queue]++;
+    conn->entryPending = 1;
+    conn->offloadTsc = rte_rdtsc();
+    return 1;
+}
+/**
+ * @brief queue the removal of the entry of a conn, pushed by the next doca_ar_flow_commit
+ *
+ * @param conn
+ * @return int
+ */
+static int hw_rm_entry(struct doca_ar_conn *conn)
+{
+    if (doca_flow_pipe_rm_entry(conn->queue, NULL, conn->entry) < 0)
+        return -1;
+    nbPendingEntries[conn->queue]++;
+    return 0;
+}
+/**
+ * @brief replace the entry of a conn by one with the new mod_src_port, both are pushed by the next doca_ar_flow_commit
+ *
+ * doca-flow 1.5 cannot update the actions of an entry in place. The conn stays pending from the removal to the completion
+ * of the new entry, so neither the datapath nor the aging re-offloads or ages it in between. If the new entry cannot be
+ * queued the conn falls back to software like a failed offload, and its next packet offloads it again.
+ *
+ * @param conn
+ * @return int
+ */
+static int hw_mod_entry(struct doca_ar_conn *conn)
+{
+    if (hw_rm_entry(conn) < 0)
+        return 0;
+    conn->entryPending = 1;
+    conn->entry = NULL; // forwarded by the control plane until the new entry completes
+    if (hw_add_entry(conn))
+        return 1;
+    conn->entryPending = 0; // back in software, the datapath retries the offload
+    return 0;
+}
+/**
+ * @brief read the counter of the entry of a conn
+ *
+ * @param conn
+ * @param pkts
+ * @return int
+ */
+static int hw_query(struct doca_ar_conn *conn, uint64_t *pkts)
+{
+    struct doca_flow_query query;
+    if (conn->entry == NULL || doca_flow_query(conn->entry, &query) < 0)
+        return -1;
+    *pkts = query.total_pkts;
+    return 0;
+}
+/**
+ * @brief push queued entry operations and collect completed ones without waiting
+ *
+ * @param queue
+ * @return int
+ */
+static int hw_commit(uint16_t queue)
+{
+    if (nbPendingEntries[queue] == 0)
+        return 0;
+    int result = doca_flow_entries_process(ports[to_host_port], queue, 0, nbPendingEntries[queue]);
+    if (result < 0)
     {
-        conn->entry = NULL;
+        DOCA_LOG_ERR("Process entries of queue %u fail", queue);
         return 0;
     }
-    conn->entry = entry;
-    return 1;
+    nbPendingEntries[queue] -= RTE_MIN((uint32_t)result, nbPendingEntries[queue]);
+    return result;
 }
-int doca_ar_flow_aging()
+void doca_ar_flow_process_cb(struct doca_flow_pipe_entry *entry, enum doca_flow_entry_status status,
+                             enum doca_flow_entry_op op, void *user_ctx)
+{
+    struct doca_ar_conn *conn = user_ctx;
+    if (op != DOCA_FLOW_ENTRY_OP_ADD || conn == NULL)
+        return;
+    uint64_t queued = conn->offloadTsc;
+    conn->offloadTsc = 0; // probe is NULL again
+    conn->entryPending = 0;
+    // on failure the conn stays in software and the next packet retries
+    conn->entry = status == DOCA_FLOW_ENTRY_STATUS_SUCCESS ? entry : NULL;
+    if (conn->entry != NULL)
+    {
+        doca_ar_stats()->offloadOk++;
+        doca_ar_hist_record(HIST_OFFLOAD, doca_ar_stats_ns(rte_rdtsc() - queued));
+    }
+    else
+        doca_ar_stats()->offloadFail++;
+}
+/**
+ * @brief collect conns whose entry has been aged by the eSwitch
+ *
+ * @param queue
+ * @param aged
+ * @param max
+ * @return int
+ */
+static int hw_aging(uint16_t queue, struct doca_ar_conn **aged, int max)
 {
     struct doca_flow_aged_query aged_entries[MAX_AGED_CT_PER_POLL];
-    int num_of_aged_entries = doca_flow_aging_handle(ports[to_host_port], 0, 20 /*us*/,
-                                                     aged_entries, MAX_AGED_CT_PER_POLL);
-    /* call handle aging until full cycle complete */
+    int num_of_aged_entries = doca_flow_aging_handle(ports[to_host_port], queue, 20 /*us*/,
+                                                     aged_entries, RTE_MIN(max, MAX_AGED_CT_PER_POLL));
     for (int i = 0; i < num_of_aged_entries; i++)
+        aged[i] = (struct doca_ar_conn *)aged_entries[i].user_data;
+    return num_of_aged_entries > 0 ? num_of_aged_entries : 0;
+}
+/**
+ * @brief dump the doca-flow pipes of both ports
+ *
+ * @param f
+ */
+static void hw_dump(FILE *f)
+{
+    for (int i = 0; i < NB_PORTS; i++)
+        doca_flow_port_pipes_dump(ports[i], f);
+}
+
+const struct doca_ar_flow_ops doca_ar_flow_hw_ops = {
+    .name = "hw",
+    .init = doca_ar_doca_flow_init,
+    .destroy = doca_ar_doca_flow_destroy,
+    .pipe_init = hw_pipe_init,
+    .add_entry = hw_add_entry,
+    .rm_entry = hw_rm_entry,
+    .mod_entry = hw_mod_entry,
+    .query = hw_query,
+    .commit = hw_commit,
+    .aging = hw_aging,
+    .dump = hw_dump,
+};
+const struct doca_ar_flow_ops *flow_ops = &doca_ar_flow_hw_ops;
+
+int doca_ar_pipe_init()
+{
+    return flow_ops->pipe_init();
+}
+int doca_ar_add_new_flow(struct doca_ar_conn *conn)
+{
+    return flow_ops->add_entry(conn);
+}
+int doca_ar_rm_flow(struct doca_ar_conn *conn)
+{
+    return flow_ops->rm_entry(conn);
+}
+int doca_ar_mod_flow(struct doca_ar_conn *conn)
+{
+    return flow_ops->mod_entry(conn);
+}
+int doca_ar_flow_query(struct doca_ar_conn *conn, uint64_t *pkts)
+{
+    return flow_ops->query(conn, pkts);
+}
+int doca_ar_flow_commit(uint16_t queue)
+{
+    return flow_ops->commit(queue);
+}
+int doca_ar_flow_aging(uint16_t queue)
+{
+    struct doca_ar_aging_stats *stats = &agingStats[queue];
+    struct doca_ar_conn *aged[MAX_AGED_CT_PER_POLL];
+    uint64_t now = rte_get_timer_cycles();
+    int hwAged = 0, swExpired, num_of_aged_entries;
+    uint32_t budget = RTE_MAX(stats->budget, (uint32_t)MAX_AGED_CT_PER_POLL);
+
+    if (now < nextAging[queue])
+        return 0;
+    nextAging[queue] = now + AGING_INTERVAL_US * rte_get_timer_hz() / 1000000;
+    uint64_t start = rte_rdtsc();
+
+    /* call handle aging until full cycle complete or the budget is used up */
+    do
     {
-        struct doca_ar_conn *conn = (struct doca_ar_conn *)aged_entries[i].user_data;
-        if (doca_flow_pipe_rm_entry(0, NULL, conn->entry) < 0)
+        num_of_aged_entries = flow_ops->aging(queue, aged, RTE_MIN(budget - hwAged, (uint32_t)MAX_AGED_CT_PER_POLL));
+        for (int i = 0; i < num_of_aged_entries; i++)
         {
-            DOCA_LOG_INFO("failed to remove aged entry");
-            continue;
-        }
-        else if (conn->expireCallback)
-        {
-            conn->expireCallback(conn->expireCallbackArgs); // Revoke user_defined callback
+            struct doca_ar_conn *conn = aged[i];
+            if (flow_ops->rm_entry(conn) < 0)
+            {
+                DOCA_LOG_INFO("failed to remove aged entry");
+                continue;
+            }
+            doca_ar_del_conn(conn);
         }
+        hwAged += num_of_aged_entries;
+    } while (num_of_aged_entries == MAX_AGED_CT_PER_POLL && (uint32_t)hwAged < budget);
+    // conns never offloaded, and offloaded ones rechecked, share what is left of the budget
+    swExpired = doca_ar_conntrack_expire(queue, budget - hwAged);
+
+    stats->rounds++;
+    stats->hwAged += hwAged;
+    stats->swExpired += swExpired;
+    doca_ar_stats()->aged += hwAged + swExpired;
+    stats->backlog = doca_ar_conntrack_backlog(queue);
+    if ((uint32_t)hwAged >= budget || stats->backlog)
+    {
+        stats->fullRounds++;
+        budget = RTE_MIN(budget * 2, (uint32_t)MAX_AGING_BUDGET);
     }
-    return num_of_aged_entries > 0 ? num_of_aged_entries : 0;
+    else if ((uint32_t)(hwAged + swExpired) < budget / 4)
+        budget = RTE_MAX(budget / 2, (uint32_t)MAX_AGED_CT_PER_POLL);
+    stats->budget = budget;
+    doca_ar_hist_record(HIST_AGING, doca_ar_stats_ns(rte_rdtsc() - start));
+    return hwAged + swExpired;
+}
+
+const struct doca_ar_aging_stats *doca_ar_flow_aging_stats(uint16_t queue)
+{
+    return &agingStats[queue];
+}
+void doca_ar_flow_dump(FILE *f)
+{
+    flow_ops->dump(f);
 }
\ No newline at end of file
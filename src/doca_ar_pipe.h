@@ -1,7 +1,7 @@
 /**
  * @file doca_ar_pipe.h
  * @author Mark Chen (markchen77888@gmail.com)
- * @brief build needed doca-flow pipe
+ * @brief build needed doca-flow pipe, through the doca-flow backend or its software emulation
  * @version 1.0
  * @date 2024-01-07
  *
@@ -23,6 +23,71 @@
  *
  */
 #define MAX_AGED_CT_PER_POLL 16
+/**
+ * @brief period of the aging round of a worker[us], aging is not run on every rx burst
+ *
+ */
+#define AGING_INTERVAL_US 1000
+/**
+ * @brief the max amount of conns aged in one aging round, the budget doubles from MAX_AGED_CT_PER_POLL up to it while aging lags behind
+ *
+ */
+#define MAX_AGING_BUDGET 1024
+/**
+ * @brief the max amount of entries queued on a pipe queue before they have to be processed, doca-flow default queue depth
+ *
+ */
+#define MAX_PENDING_ENTRIES 128
+
+/**
+ * @brief upstream_vxlanPipes of an underlay, the inner l4 type is fixed per pipe
+ *
+ */
+enum VXLAN_PIPE
+{
+    VXLAN_PIPE_TCP,   ///< conns of inner tcp, matched by the inner 5-tuple
+    VXLAN_PIPE_UDP,   ///< conns of inner udp, matched by the inner 5-tuple
+    VXLAN_PIPE_OUTER, ///< other conns, matched by the outer 4-tuple and the vni
+    NB_VXLAN_PIPES
+};
+
+/**
+ * @brief operations of a flow backend implementing upstream_vxlanPipe, upstream_rssPipe, downstream_rssPipe and downstream_hairpinPipe
+ *
+ */
+struct doca_ar_flow_ops
+{
+    const char *name;
+    int (*init)(int nbQueues);                                      ///< bring up the flow engine on the started dpdk ports
+    void (*destroy)();                                              ///< release the flow engine
+    int (*pipe_init)();                                             ///< build the four pipes
+    int (*add_entry)(struct doca_ar_conn *conn);                    ///< queue the upstream_vxlanPipe entry of a conn
+    int (*rm_entry)(struct doca_ar_conn *conn);                     ///< remove the upstream_vxlanPipe entry of a conn
+    int (*mod_entry)(struct doca_ar_conn *conn);                    ///< point the entry of an offloaded conn onto its bestPath
+    int (*query)(struct doca_ar_conn *conn, uint64_t *pkts);        ///< packets which hit the entry of a conn
+    int (*commit)(uint16_t queue);                                  ///< push queued entry operations of a pipe queue
+    int (*aging)(uint16_t queue, struct doca_ar_conn **aged, int max); ///< collect conns whose entry expired
+    void (*dump)(FILE *f);                                          ///< dump the pipes
+};
+
+/**
+ * @brief aging counters of a worker
+ *
+ */
+struct doca_ar_aging_stats
+{
+    uint64_t rounds;     ///< aging rounds run
+    uint64_t fullRounds; ///< rounds which used up the whole budget, i.e. aging lags behind
+    uint64_t hwAged;     ///< offloaded conns aged by the flow backend
+    uint64_t swExpired;  ///< conns never offloaded and expired by the timer wheel
+    uint32_t backlog;    ///< expired lifetime timers not handled yet
+    uint32_t budget;     ///< conns handled per round, adapted to the backlog
+} __rte_cache_aligned;
+
+extern const struct doca_ar_flow_ops doca_ar_flow_hw_ops; ///< doca-flow on the eSwitch of the DPU
+extern const struct doca_ar_flow_ops doca_ar_flow_sw_ops; ///< software emulation on any dpdk port, see doca_ar_pipe_sw.c
+extern const struct doca_ar_flow_ops *flow_ops;           ///< backend in use, chosen by --flow-backend
+
 /**
  * @brief build needed pipe
  *
@@ -30,17 +95,77 @@
  */
 int doca_ar_pipe_init();
 /**
- * @brief add entry to the vxlan pipe so that ar can come into effect
+ * @brief queue an entry to the vxlan pipe so that ar can come into effect, it is pushed by doca_ar_flow_commit
  *
- * @param conn
- * @return int
+ * conn->entry is set once the backend completes the insertion, by doca_ar_flow_process_cb for doca-flow.
+ *
+ * @param conn the entry is added through the doca-flow pipe queue of the worker owning it
+ * @return int 1 if the entry is queued
  */
 int doca_ar_add_new_flow(struct doca_ar_conn *conn);
 /**
- * @brief aged expired conns from doca-flow table(FDB) and del them from conntrack table
+ * @brief remove the vxlan pipe entry of a conn, following packets of the conn come back to the control plane
  *
+ * @param conn
+ * @return int 0 on success
+ */
+int doca_ar_rm_flow(struct doca_ar_conn *conn);
+/**
+ * @brief move an offloaded conn onto its bestPath by updating mod_src_port of its vxlan pipe entry
+ *
+ * The software backend updates the entry in place. doca-flow has no update of basic pipe entries, so the entry is removed
+ * and re-added in the same batch, the few packets in between are forwarded by the control plane on the new path.
+ *
+ * @param conn
+ * @return int 1 if the update is done or queued
+ */
+int doca_ar_mod_flow(struct doca_ar_conn *conn);
+/**
+ * @brief packets which hit the vxlan pipe entry of an offloaded conn, counted with DOCA_FLOW_MONITOR_COUNT when rerouting is on
+ *
+ * @param conn
+ * @param pkts
+ * @return int 0 on success
+ */
+int doca_ar_flow_query(struct doca_ar_conn *conn, uint64_t *pkts);
+/**
+ * @brief push the entries queued on a pipe queue to the hardware and collect completed ones, never waits for the hardware
+ *
+ * @param queue doca-flow pipe queue of the calling worker
+ * @return int the amount of completed entries
+ */
+int doca_ar_flow_commit(uint16_t queue);
+/**
+ * @brief completion callback of doca-flow entry operations, registered in doca_flow_cfg
+ *
+ * @param entry
+ * @param status
+ * @param op
+ * @param user_ctx the conn of an added entry, NULL for static entries
+ */
+void doca_ar_flow_process_cb(struct doca_flow_pipe_entry *entry, enum doca_flow_entry_status status,
+                             enum doca_flow_entry_op op, void *user_ctx);
+/**
+ * @brief aged expired conns from doca-flow table(FDB) and the timer wheel, and del them from conntrack table
+ *
+ * Called in every polling loop but only runs once per AGING_INTERVAL_US, with a budget that grows while aging lags behind.
+ *
+ * @param queue doca-flow pipe queue of the calling worker, only entries added through it are aged
  * @return int the amount of aged conns
  */
-int doca_ar_flow_aging();
+int doca_ar_flow_aging(uint16_t queue);
+/**
+ * @brief aging counters of a worker
+ *
+ * @param queue
+ * @return const struct doca_ar_aging_stats*
+ */
+const struct doca_ar_aging_stats *doca_ar_flow_aging_stats(uint16_t queue);
+/**
+ * @brief dump all the pipes
+ *
+ * @param f
+ */
+void doca_ar_flow_dump(FILE *f);
 
 #endif /* DOCA_AR_PIPE_H_ */
\ No newline at end of file
@@ -0,0 +1,610 @@
+/**
+ * @file doca_ar_pipe_sw.c
+ * @author Mark Chen (markchen77888@gmail.com)
+ * @brief software emulation of the doca-flow pipes, lets the whole app run on plain dpdk ports (net_ring, net_pcap) without a DPU
+ * @version 1.0
+ * @date 2024-01-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "doca_ar_pipe.h"
+#include "doca_ar_probe.h"
+#include "doca_ar_stats.h"
+#include <rte_ethdev.h>
+#include <rte_hash.h>
+#include <rte_hash_crc.h>
+#include <rte_mempool.h>
+#include <rte_ring.h>
+#include <rte_net.h>
+DOCA_LOG_REGISTER(DOCA_AR_PIPE_SW);
+
+/*
+ * The eSwitch is emulated by rx callbacks on every queue of both ports, so the pipes run inside rte_eth_rx_burst
+ * on the lcore polling the queue and the workers see exactly what the rss pipes would have delivered to them:
+ *   to_host_port: upstream_vxlanPipe chain hit (inner 5-tuple, or the outer 4-tuple and the vni) ==> sport modified, sent out of to_net_port
+ *                 miss, udp dst 4789 ==> upstream_rssPipe, delivered to the worker picked by rss, other packets dropped
+ *   to_net_port:  udp dst 4788 ==> downstream_rssPipe, delivered to probe_queue
+ *                 other packets ==> downstream_hairpinPipe, sent out of to_host_port
+ * With --role reflector the pipes are replaced by those of the receiver side:
+ *   to_host_port: all packets ==> upstream_hairpinPipe, sent out of to_net_port
+ *   to_net_port:  udp dst 4789 with PROBE_VNI ==> reflectorPipe, delivered to the worker picked by rss
+ *                 other packets ==> downstream_hairpinPipe, sent out of to_host_port
+ * A packet received on another queue than its rss queue is steered through a ring and handled when that queue is polled.
+ * Ports without checksum offload get the checksums computed by a tx callback.
+ */
+
+#define SW_STEER_RING 1024 ///< packets steered onto another queue by the emulated rss
+#define SW_AGING_SCAN 64   ///< upstream_vxlanPipe entries checked for aging per poll
+
+/**
+ * @brief outer 4-tuple (sip,dip,sport,dport) giving the emulated rss
+ *
+ */
+struct doca_ar_sw_key
+{
+    uint8_t sip[16]; ///< the first 4 bytes on an ipv4 underlay
+    uint8_t dip[16];
+    uint16_t sport;
+    uint16_t dport;
+};
+
+/**
+ * @brief entry of the emulated upstream_vxlanPipe, handed to the conn as its doca-flow entry handle
+ *
+ */
+struct doca_ar_sw_entry
+{
+    struct doca_ar_conn_match key; ///< the first CT_KEY_LEN bytes are matched like the conntrack
+    uint16_t modSport;         ///< actions.mod_src_port
+    uint32_t aging;            ///< monitor.aging[s]
+    uint64_t lastHit;          ///< tsc of the latest packet hitting the entry
+    uint64_t hits;
+    struct doca_ar_conn *conn; ///< monitor.user_data
+} __rte_cache_aligned;
+
+/**
+ * @brief packets handled by the emulated pipes on one queue
+ *
+ */
+struct doca_ar_sw_stats
+{
+    uint64_t vxlanHit;   ///< upstream_vxlanPipe
+    uint64_t upRss;      ///< upstream_rssPipe
+    uint64_t upDrop;     ///< miss of upstream_rssPipe
+    uint64_t downRss;    ///< downstream_rssPipe
+    uint64_t hairpin;    ///< downstream_hairpinPipe
+    uint64_t steered;    ///< handed over to the rss queue
+} __rte_cache_aligned;
+
+/**
+ * @brief what the emulated pipes do with a packet
+ *
+ */
+enum SW_VERDICT
+{
+    SW_DELIVER, ///< give it to the lcore polling this queue
+    SW_FORWARD, ///< send it out of the peer port
+    SW_DROP,
+    SW_STOLEN   ///< steered onto another queue
+};
+
+struct rte_hash *SW_VXLAN_PIPE[MAX_WORKERS] = {NULL};     ///< entries of upstream_vxlanPipe, one table per worker queue like the conntrack
+struct rte_mempool *SW_ENTRY_POOL = NULL;                 ///< mempool of struct doca_ar_sw_entry
+struct rte_ring *SW_STEER[NB_PORTS][RTE_MAX_LCORE];        ///< packets waiting for the rx callback of their rss queue
+struct doca_ar_sw_stats SW_STATS[NB_PORTS][RTE_MAX_LCORE]; ///< packets handled on every queue
+static uint32_t swAgingIter[MAX_WORKERS] = {0};           ///< iterator of the incremental aging scan
+static int nbSwQueues = 0;
+
+/**
+ * @brief get the 4-tuple of an ipv4/udp or ipv6/udp packet and set its packet type like the NIC does
+ *
+ * @param m
+ * @param key
+ * @return struct rte_udp_hdr* NULL if the packet is not ipv4/udp without options or ipv6/udp without extension headers
+ */
+static struct rte_udp_hdr *sw_parse(struct rte_mbuf *m, struct doca_ar_sw_key *key)
+{
+    struct rte_net_hdr_lens lens = {0};
+    struct rte_udp_hdr *udp;
+    m->packet_type = rte_net_get_ptype(m, &lens, RTE_PTYPE_ALL_MASK);
+    if ((m->packet_type & RTE_PTYPE_L4_MASK) != RTE_PTYPE_L4_UDP || lens.l2_len != sizeof(struct rte_ether_hdr))
+        return NULL;
+    memset(key, 0, sizeof(*key));
+    if (RTE_ETH_IS_IPV4_HDR(m->packet_type) && lens.l3_len == sizeof(struct rte_ipv4_hdr))
+    {
+        struct rte_ipv4_hdr *ip = rte_pktmbuf_mtod_offset(m, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
+        udp = (struct rte_udp_hdr *)(ip + 1);
+        rte_memcpy(key->sip, &ip->src_addr, sizeof(ip->src_addr));
+        rte_memcpy(key->dip, &ip->dst_addr, sizeof(ip->dst_addr));
+    }
+    else if (RTE_ETH_IS_IPV6_HDR(m->packet_type) && lens.l3_len == sizeof(struct rte_ipv6_hdr))
+    {
+        struct rte_ipv6_hdr *ip6 = rte_pktmbuf_mtod_offset(m, struct rte_ipv6_hdr *, sizeof(struct rte_ether_hdr));
+        udp = (struct rte_udp_hdr *)(ip6 + 1);
+        rte_memcpy(key->sip, ip6->src_addr, sizeof(key->sip));
+        rte_memcpy(key->dip, ip6->dst_addr, sizeof(key->dip));
+    }
+    else
+        return NULL;
+    key->sport = udp->src_port;
+    key->dport = udp->dst_port;
+    // emulated rss, the same 4-tuple always lands on the same queue
+    m->hash.rss = rte_hash_crc(key, sizeof(*key), 0);
+    m->ol_flags |= PKT_RX_RSS_HASH;
+    return udp;
+}
+
+/**
+ * @brief hand a packet over to the rx callback of its rss queue
+ *
+ * @param port_id
+ * @param queue the queue the packet was received on
+ * @param owner the rss queue of the packet
+ * @param m
+ * @return enum SW_VERDICT
+ */
+static enum SW_VERDICT sw_steer(uint16_t port_id, uint16_t queue, uint16_t owner, struct rte_mbuf *m)
+{
+    if (rte_ring_enqueue(SW_STEER[port_id][owner], m) != 0)
+        return SW_DROP;
+    SW_STATS[port_id][queue].steered++;
+    return SW_STOLEN;
+}
+
+/**
+ * @brief drop the inner 5-tuple of a key, keeping the outer 4-tuple and the vni
+ *
+ * @param key
+ */
+static inline void sw_outer_key(struct doca_ar_conn_match *key)
+{
+    key->inSip = 0;
+    key->inDip = 0;
+    key->inSport = 0;
+    key->inDport = 0;
+    key->inProto = 0;
+}
+
+/**
+ * @brief the chain of upstream_vxlanPipe, upstream_vxlanUdpPipe and upstream_vxlanOuterPipe: inner 5-tuple first, then the outer 4-tuple and the vni
+ *
+ * @param m
+ * @param queue
+ * @param entry
+ * @return int 1 on hit
+ */
+static int sw_lookup(struct rte_mbuf *m, uint16_t queue, struct doca_ar_sw_entry **entry)
+{
+    struct doca_ar_conn_match key;
+    memset(&key, 0, sizeof(key));
+    if (!doca_ar_parse_conn(&key, m))
+        return 0;
+    if (rte_hash_lookup_data(SW_VXLAN_PIPE[queue], &key, (void **)entry) >= 0)
+        return 1;
+    sw_outer_key(&key);
+    return rte_hash_lookup_data(SW_VXLAN_PIPE[queue], &key, (void **)entry) >= 0;
+}
+
+/**
+ * @brief upstream_vxlanPipe and upstream_rssPipe
+ *
+ * @param m
+ * @param queue
+ * @return enum SW_VERDICT
+ */
+static enum SW_VERDICT sw_upstream(struct rte_mbuf *m, uint16_t queue)
+{
+    struct doca_ar_sw_stats *stats = &SW_STATS[to_host_port][queue];
+    struct doca_ar_sw_entry *entry = NULL;
+    struct doca_ar_sw_key key;
+    struct rte_udp_hdr *udp;
+    if (ar_config.role == ROLE_REFLECTOR)
+    {
+        stats->hairpin++;
+        return SW_FORWARD;
+    }
+    udp = sw_parse(m, &key);
+    if (udp == NULL)
+    {
+        stats->upDrop++;
+        return SW_DROP;
+    }
+    uint16_t owner = m->hash.rss % nb_workers;
+    if (owner != queue)
+        return sw_steer(to_host_port, queue, owner, m);
+
+    if (key.dport == rte_cpu_to_be_16(4789) && sw_lookup(m, queue, &entry))
+    {
+        entry->lastHit = rte_rdtsc();
+        entry->hits++;
+        stats->vxlanHit++;
+        udp->src_port = entry->modSport;
+        m->l2_len = sizeof(struct rte_ether_hdr);
+        if (RTE_ETH_IS_IPV6_HDR(m->packet_type))
+        {
+            m->l3_len = sizeof(struct rte_ipv6_hdr);
+            m->ol_flags |= PKT_TX_IPV6 | PKT_TX_UDP_CKSUM;
+            udp->dgram_cksum = rte_ipv6_phdr_cksum(rte_pktmbuf_mtod_offset(m, struct rte_ipv6_hdr *, m->l2_len), m->ol_flags);
+            return SW_FORWARD;
+        }
+        m->l3_len = sizeof(struct rte_ipv4_hdr);
+        m->ol_flags |= PKT_TX_IPV4 | PKT_TX_IP_CKSUM | PKT_TX_UDP_CKSUM;
+        return SW_FORWARD;
+    }
+    if (key.dport == rte_cpu_to_be_16(4789))
+    {
+        stats->upRss++;
+        return SW_DELIVER;
+    }
+    stats->upDrop++;
+    return SW_DROP;
+}
+
+/**
+ * @brief whether a packet left unparsed by sw_parse is icmp of the underlay, like downstream_icmpPipe
+ *
+ * @param m
+ * @return bool
+ */
+static bool sw_is_icmp(struct rte_mbuf *m)
+{
+    if (RTE_ETH_IS_IPV4_HDR(m->packet_type))
+        return rte_pktmbuf_mtod_offset(m, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr))->next_proto_id == IPPROTO_ICMP;
+    if (RTE_ETH_IS_IPV6_HDR(m->packet_type))
+        return rte_pktmbuf_mtod_offset(m, struct rte_ipv6_hdr *, sizeof(struct rte_ether_hdr))->proto == IPPROTO_ICMPV6;
+    return false;
+}
+
+/**
+ * @brief whether a vxlan packet carries PROBE_VNI, like reflectorPipe
+ *
+ * @param m
+ * @param udp
+ * @return bool
+ */
+static bool sw_is_probe(struct rte_mbuf *m, struct rte_udp_hdr *udp)
+{
+    const struct rte_vxlan_hdr *vxlan = (const struct rte_vxlan_hdr *)(udp + 1);
+    if ((const char *)(vxlan + 1) > rte_pktmbuf_mtod(m, const char *) + rte_pktmbuf_data_len(m))
+        return false;
+    return vxlan->vx_vni == rte_cpu_to_be_32(PROBE_VNI << 8);
+}
+
+/**
+ * @brief downstream_rssPipe, downstream_icmpPipe and downstream_hairpinPipe, or reflectorPipe with --role reflector
+ *
+ * @param m
+ * @param queue
+ * @return enum SW_VERDICT
+ */
+static enum SW_VERDICT sw_downstream(struct rte_mbuf *m, uint16_t queue)
+{
+    struct doca_ar_sw_stats *stats = &SW_STATS[to_net_port][queue];
+    struct doca_ar_sw_key key;
+    struct rte_udp_hdr *udp = sw_parse(m, &key);
+    if (ar_config.role == ROLE_REFLECTOR)
+    {
+        if (udp != NULL && key.dport == rte_cpu_to_be_16(4789) && sw_is_probe(m, udp))
+        {
+            uint16_t owner = m->hash.rss % nb_workers;
+            if (owner != queue)
+                return sw_steer(to_net_port, queue, owner, m);
+            stats->downRss++;
+            return SW_DELIVER;
+        }
+        stats->hairpin++;
+        return SW_FORWARD;
+    }
+    if (udp != NULL && key.dport == rte_cpu_to_be_16(4788))
+    {
+        if (probe_queue != queue)
+            return sw_steer(to_net_port, queue, probe_queue, m);
+        stats->downRss++;
+        return SW_DELIVER;
+    }
+    if (ar_config.discoveryHops && sw_is_icmp(m))
+    {
+        if (probe_queue != queue)
+            return sw_steer(to_net_port, queue, probe_queue, m);
+        stats->downRss++;
+        return SW_DELIVER;
+    }
+    stats->hairpin++;
+    return SW_FORWARD;
+}
+
+/**
+ * @brief rx callback running the emulated pipes, only packets delivered by the rss pipes are returned to the caller
+ *
+ */
+static uint16_t sw_rx_cb(uint16_t port_id, uint16_t queue, struct rte_mbuf *pkts[], uint16_t nb_pkts,
+                         uint16_t max_pkts, __rte_unused void *user_param)
+{
+    struct rte_mbuf *fwd[max_pkts];
+    uint16_t nb_deliver = 0, nb_fwd = 0, peer_port = port_id == to_host_port ? to_net_port : to_host_port;
+
+    nb_pkts += rte_ring_dequeue_burst(SW_STEER[port_id][queue], (void **)&pkts[nb_pkts], max_pkts - nb_pkts, NULL);
+    for (int i = 0; i < nb_pkts; i++)
+    {
+        struct rte_mbuf *m = pkts[i];
+        switch (port_id == to_host_port ? sw_upstream(m, queue) : sw_downstream(m, queue))
+        {
+        case SW_DELIVER:
+            pkts[nb_deliver++] = m;
+            break;
+        case SW_FORWARD:
+            fwd[nb_fwd++] = m;
+            break;
+        case SW_DROP:
+            rte_pktmbuf_free(m);
+            break;
+        case SW_STOLEN:
+            break;
+        }
+    }
+    // the lcore polling this queue is the only user of the same tx queue of the peer port
+    uint16_t nb_tx = rte_eth_tx_burst(peer_port, queue, fwd, nb_fwd);
+    if (unlikely(nb_tx < nb_fwd))
+    {
+        do
+        {
+            rte_pktmbuf_free(fwd[nb_tx]);
+        } while (++nb_tx < nb_fwd);
+    }
+    return nb_deliver;
+}
+
+/**
+ * @brief tx callback computing the checksums requested by ol_flags on ports without checksum offload
+ *
+ */
+static uint16_t sw_tx_cksum_cb(__rte_unused uint16_t port_id, __rte_unused uint16_t queue, struct rte_mbuf *pkts[],
+                               uint16_t nb_pkts, __rte_unused void *user_param)
+{
+    for (int i = 0; i < nb_pkts; i++)
+    {
+        struct rte_mbuf *m = pkts[i];
+        if (!(m->ol_flags & (PKT_TX_IP_CKSUM | PKT_TX_L4_MASK)))
+            continue;
+        if (m->ol_flags & PKT_TX_IPV6)
+        {
+            struct rte_ipv6_hdr *ip6 = rte_pktmbuf_mtod_offset(m, struct rte_ipv6_hdr *, m->l2_len);
+            if ((m->ol_flags & PKT_TX_L4_MASK) == PKT_TX_UDP_CKSUM)
+            {
+                struct rte_udp_hdr *udp6 = (struct rte_udp_hdr *)((char *)ip6 + m->l3_len);
+                udp6->dgram_cksum = 0;
+                udp6->dgram_cksum = rte_ipv6_udptcp_cksum(ip6, udp6);
+            }
+            m->ol_flags &= ~PKT_TX_L4_MASK;
+            continue;
+        }
+        struct rte_ipv4_hdr *ip = rte_pktmbuf_mtod_offset(m, struct rte_ipv4_hdr *, m->l2_len);
+        if (m->ol_flags & PKT_TX_IP_CKSUM)
+        {
+            ip->hdr_checksum = 0;
+            ip->hdr_checksum = rte_ipv4_cksum(ip);
+        }
+        if ((m->ol_flags & PKT_TX_L4_MASK) == PKT_TX_UDP_CKSUM)
+        {
+            struct rte_udp_hdr *udp = (struct rte_udp_hdr *)((char *)ip + m->l3_len);
+            udp->dgram_cksum = 0;
+            udp->dgram_cksum = rte_ipv4_udptcp_cksum(ip, udp);
+        }
+        m->ol_flags &= ~(PKT_TX_IP_CKSUM | PKT_TX_L4_MASK);
+    }
+    return nb_pkts;
+}
+
+/**
+ * @brief install the rx and tx callbacks on every queue of both ports
+ *
+ * @param nbQueues
+ * @return int
+ */
+static int sw_init(int nbQueues)
+{
+    char name[RTE_RING_NAMESIZE];
+    int port_ids[NB_PORTS] = {to_host_port, to_net_port};
+
+    nbSwQueues = nbQueues;
+    for (int i = 0; i < NB_PORTS; i++)
+    {
+        struct rte_eth_dev_info dev_info;
+        uint16_t port_id = port_ids[i];
+        if (rte_eth_dev_info_get(port_id, &dev_info) != 0)
+        {
+            DOCA_LOG_ERR("Get info of port %u fail", port_id);
+            return -1;
+        }
+        bool sw_cksum = (dev_info.tx_offload_capa & (DEV_TX_OFFLOAD_IPV4_CKSUM | DEV_TX_OFFLOAD_UDP_CKSUM)) !=
+                        (DEV_TX_OFFLOAD_IPV4_CKSUM | DEV_TX_OFFLOAD_UDP_CKSUM);
+        for (int q = 0; q < nbSwQueues; q++)
+        {
+            snprintf(name, sizeof(name), "SW_STEER_%u_%d", port_id, q);
+            // any queue may steer into it, only the lcore polling the queue dequeues
+            SW_STEER[port_id][q] = rte_ring_create(name, SW_STEER_RING, rte_socket_id(), RING_F_SC_DEQ);
+            if (SW_STEER[port_id][q] == NULL)
+            {
+                DOCA_LOG_ERR("Create %s fail", name);
+                return -1;
+            }
+            if (rte_eth_add_rx_callback(port_id, q, sw_rx_cb, NULL) == NULL ||
+                (sw_cksum && rte_eth_add_tx_callback(port_id, q, sw_tx_cksum_cb, NULL) == NULL))
+            {
+                DOCA_LOG_ERR("Add rx/tx callback of port %u queue %d fail", port_id, q);
+                return -1;
+            }
+        }
+        DOCA_LOG_INFO("Emulate eSwitch on port %u with %d queues%s", port_id, nbSwQueues, sw_cksum ? ", checksum in software" : "");
+    }
+    return 0;
+}
+
+static void sw_destroy()
+{
+    for (int q = 0; q < MAX_WORKERS; q++)
+    {
+        rte_hash_free(SW_VXLAN_PIPE[q]);
+        SW_VXLAN_PIPE[q] = NULL;
+    }
+}
+
+/**
+ * @brief build the tables of the emulated upstream_vxlanPipe, the other pipes are stateless
+ *
+ * @return int
+ */
+static int sw_pipe_init()
+{
+    char name[RTE_HASH_NAMESIZE];
+
+    SW_ENTRY_POOL = rte_mempool_create("SW_ENTRY_POOL", ar_config.maxConnsLimit,
+                                       sizeof(struct doca_ar_sw_entry), 256, 0,
+                                       NULL, NULL, NULL, NULL,
+                                       rte_socket_id(), 0);
+    if (SW_ENTRY_POOL == NULL)
+    {
+        DOCA_LOG_ERR("Create SW_ENTRY_POOL Fail");
+        return -1;
+    }
+    for (int q = 0; q < nb_workers; q++)
+    {
+        snprintf(name, sizeof(name), "SW_VXLAN_PIPE_%d", q);
+        const struct rte_hash_parameters VxlanPipe =
+            {
+                .name = name,
+                .entries = ar_config.maxConnsLimit,
+                .reserved = 0,
+                .key_len = CT_KEY_LEN,
+                .hash_func = rte_hash_crc,
+                .hash_func_init_val = 0,
+                .socket_id = rte_socket_id(),
+                .extra_flag = RTE_HASH_EXTRA_FLAGS_EXT_TABLE,
+            };
+        SW_VXLAN_PIPE[q] = rte_hash_create(&VxlanPipe);
+        if (SW_VXLAN_PIPE[q] == NULL)
+        {
+            DOCA_LOG_ERR("build_upstream_vxlanPipe (software) %d ERR", q);
+            return -1;
+        }
+    }
+    DOCA_LOG_INFO("build software pipes success");
+    return 0;
+}
+
+static int sw_add_entry(struct doca_ar_conn *conn)
+{
+    struct doca_ar_sw_entry *entry = NULL;
+    uint64_t start = rte_rdtsc();
+    if (rte_mempool_get(SW_ENTRY_POOL, (void **)&entry) != 0)
+    {
+        DOCA_LOG_ERR("Cannot get sw entry from pool.....");
+        doca_ar_stats()->offloadFail++;
+        return 0;
+    }
+    entry->key = conn->match;
+    if (conn->match.inProto != IPPROTO_TCP && conn->match.inProto != IPPROTO_UDP)
+        sw_outer_key(&entry->key); // like upstream_vxlanOuterPipe
+    entry->modSport = conn->bestPath;
+    entry->aging = conn->expireTime;
+    entry->lastHit = rte_rdtsc();
+    entry->hits = 0;
+    entry->conn = conn;
+    if (rte_hash_add_key_data(SW_VXLAN_PIPE[conn->queue], &entry->key, entry) < 0)
+    {
+        DOCA_LOG_ERR("No space in upstream_vxlanPipe (software).....");
+        rte_mempool_put(SW_ENTRY_POOL, entry);
+        doca_ar_stats()->offloadFail++;
+        return 0;
+    }
+    // the entry is live at once, nothing to commit
+    conn->entry = (struct doca_flow_pipe_entry *)entry;
+    doca_ar_stats()->offloadOk++;
+    doca_ar_hist_record(HIST_OFFLOAD, doca_ar_stats_ns(rte_rdtsc() - start));
+    return 1;
+}
+
+static int sw_rm_entry(struct doca_ar_conn *conn)
+{
+    struct doca_ar_sw_entry *entry = (struct doca_ar_sw_entry *)conn->entry;
+    if (entry == NULL || rte_hash_del_key(SW_VXLAN_PIPE[conn->queue], &entry->key) < 0)
+        return -1;
+    rte_mempool_put(SW_ENTRY_POOL, entry);
+    conn->entry = NULL;
+    return 0;
+}
+
+static int sw_mod_entry(struct doca_ar_conn *conn)
+{
+    struct doca_ar_sw_entry *entry = (struct doca_ar_sw_entry *)conn->entry;
+    if (entry == NULL)
+        return 0;
+    entry->modSport = conn->bestPath; // only the owning worker touches the entry
+    return 1;
+}
+
+static int sw_query(struct doca_ar_conn *conn, uint64_t *pkts)
+{
+    struct doca_ar_sw_entry *entry = (struct doca_ar_sw_entry *)conn->entry;
+    if (entry == NULL)
+        return -1;
+    *pkts = entry->hits;
+    return 0;
+}
+
+static int sw_commit(__rte_unused uint16_t queue)
+{
+    return 0;
+}
+
+/**
+ * @brief scan a slice of the worker's upstream_vxlanPipe table for entries idle longer than their aging time
+ *
+ */
+static int sw_aging(uint16_t queue, struct doca_ar_conn **aged, int max)
+{
+    const void *key;
+    void *data;
+    uint64_t now = rte_rdtsc(), hz = rte_get_tsc_hz();
+    int nb = 0;
+
+    for (int scanned = 0; scanned < SW_AGING_SCAN && nb < max; scanned++)
+    {
+        if (rte_hash_iterate(SW_VXLAN_PIPE[queue], &key, &data, &swAgingIter[queue]) < 0)
+        {
+            swAgingIter[queue] = 0; // a full cycle is complete
+            break;
+        }
+        struct doca_ar_sw_entry *entry = data;
+        if (now - entry->lastHit > entry->aging * hz)
+            aged[nb++] = entry->conn;
+    }
+    return nb;
+}
+
+static void sw_dump(FILE *f)
+{
+    for (int q = 0; q < nbSwQueues; q++)
+    {
+        struct doca_ar_sw_stats *up = &SW_STATS[to_host_port][q], *down = &SW_STATS[to_net_port][q];
+        fprintf(f, "Queue %d: upstream_vxlanPipe entries=%d hits=%lu upstream_rssPipe=%lu drop=%lu "
+                   "downstream_rssPipe=%lu downstream_hairpinPipe=%lu steered=%lu\n",
+                q, q < nb_workers ? rte_hash_count(SW_VXLAN_PIPE[q]) : 0, up->vxlanHit, up->upRss, up->upDrop,
+                down->downRss, down->hairpin, up->steered + down->steered);
+    }
+}
+
+const struct doca_ar_flow_ops doca_ar_flow_sw_ops = {
+    .name = "sw",
+    .init = sw_init,
+    .destroy = sw_destroy,
+    .pipe_init = sw_pipe_init,
+    .add_entry = sw_add_entry,
+    .rm_entry = sw_rm_entry,
+    .mod_entry = sw_mod_entry,
+    .query = sw_query,
+    .commit = sw_commit,
+    .aging = sw_aging,
+    .dump = sw_dump,
+};
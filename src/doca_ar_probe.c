@@ -0,0 +1,871 @@
+/**
+ * @file doca_ar_probe.c
+ * @author Mark Chen (markchen77888@gmail.com)
+ * @brief non-blocking probe engine: new conns are parked in a pending-probe table until their probe replies or timeout arrive
+ * @version 1.0
+ * @date 2024-01-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "doca_ar_probe.h"
+#include "doca_ar_pipe.h"
+#include "doca_ar_path.h"
+#include "doca_ar_stats.h"
+#include <rte_hash.h>
+#include <rte_hash_crc.h>
+#include <rte_mempool.h>
+#include <rte_memcpy.h>
+#include <rte_ring.h>
+#include <rte_ethdev.h>
+#include <rte_malloc.h>
+#include <rte_spinlock.h>
+#include <rte_mbuf_dyn.h>
+DOCA_LOG_REGISTER(DOCA_AR_PROBE);
+
+#define PROBE_TIMER_RESOLUTION_US 100 ///< interval of running rte_timer_manage in the polling loop
+
+/**
+ * @brief probing state owned by one worker
+ *
+ */
+struct doca_ar_probe_shard
+{
+    struct rte_hash *table;   ///< pending-probe table: FlowID ==> struct doca_ar_probe
+    struct rte_ring *release; ///< parked packets released by resolved probes, waiting to be sent
+    struct rte_ring *replies; ///< probe replies received by other workers
+    uint64_t lastTimerManage; ///< tsc of the last rte_timer_manage
+    struct rte_hash *tmplTable;        ///< probe template cache: VTEP pair ==> index of tmpls
+    struct doca_ar_probe_tmpl *tmpls;  ///< probe templates, indexed by the key position
+    uint16_t nb_tx;                    ///< amount of probe packets in tx
+    struct rte_mbuf *tx[PROBE_TX_BURST]; ///< probe packets held back until doca_ar_probe_flush
+    struct doca_ar_probe_noise noise;  ///< noise floor of both clocks
+} __rte_cache_aligned;
+
+struct rte_mempool *PROBE_POOL = NULL;                 ///< mempool of struct doca_ar_probe, shared by all workers
+struct rte_mempool *PROBE_MBUF_POOL = NULL;            ///< mempool of probe packets, mbufs only as large as the longest probe packet
+struct doca_ar_probe_shard PROBE_SHARDS[MAX_WORKERS]; ///< probing state of every worker
+int nbProbeShards = 0;
+static rte_spinlock_t replyLock = RTE_SPINLOCK_INITIALIZER; ///< held by the worker polling probe_queue
+static bool probeHwTs = false;  ///< hardware timestamps are in use
+static int rxTsOffset = -1;     ///< offset of the rx timestamp dynfield
+static uint64_t rxTsFlag = 0;   ///< ol_flags of mbufs carrying an rx timestamp
+static uint64_t nicHz = 0;      ///< frequency of the NIC clock
+
+/**
+ * @brief convert clock cycles into ns without overflowing
+ *
+ * @param cycles
+ * @param hz
+ * @return uint64_t
+ */
+static inline uint64_t doca_ar_probe_ns(uint64_t cycles, uint64_t hz)
+{
+    return cycles / hz * 1000000000 + cycles % hz * 1000000000 / hz;
+}
+
+void doca_ar_probe_ts_init()
+{
+    uint64_t clk0, clk1, tsc0, tsc1;
+
+    if (ar_config.probeClock != PROBE_CLOCK_HW)
+        return;
+    if (rte_mbuf_dyn_rx_timestamp_register(&rxTsOffset, &rxTsFlag) != 0 || rte_eth_read_clock(to_net_port, &clk0) != 0)
+    {
+        DOCA_LOG_WARN("Port %d cannot timestamp probes, fall back to tsc", to_net_port);
+        return;
+    }
+    // the NIC clock runs at its own rate, measure it against the tsc
+    tsc0 = rte_rdtsc();
+    rte_delay_ms(100);
+    rte_eth_read_clock(to_net_port, &clk1);
+    tsc1 = rte_rdtsc();
+    if (clk1 <= clk0)
+    {
+        DOCA_LOG_WARN("NIC clock of port %d does not run, fall back to tsc", to_net_port);
+        return;
+    }
+    nicHz = (clk1 - clk0) * rte_get_tsc_hz() / (tsc1 - tsc0);
+    probeHwTs = true;
+    DOCA_LOG_INFO("Time probes with the NIC clock of port %d at %lu Hz", to_net_port, nicHz);
+}
+
+int doca_ar_probe_init_env(int maxPending, int nbWorkers)
+{
+    char name[RTE_HASH_NAMESIZE];
+
+    if (rte_timer_subsystem_init() < 0)
+    {
+        DOCA_LOG_ERR("Init timer subsystem fail");
+        return -1;
+    }
+    PROBE_POOL = rte_mempool_create("PROBE_POOL", maxPending * nbWorkers,
+                                    sizeof(struct doca_ar_probe), maxPending / 4 > 256 ? 256 : maxPending / 4, 0,
+                                    NULL, NULL, NULL, NULL,
+                                    rte_socket_id(), 0);
+    if (PROBE_POOL == NULL)
+    {
+        DOCA_LOG_ERR("Create PROBE_POOL Fail");
+        return -1;
+    }
+    PROBE_MBUF_POOL = rte_pktmbuf_pool_create("PROBE_MBUF_POOL", PROBE_MBUF_POOL_SIZE, PROBE_MBUF_CACHE, 0,
+                                              RTE_PKTMBUF_HEADROOM + RTE_CACHE_LINE_ROUNDUP(PROBE_PKT_LEN), rte_socket_id());
+    if (PROBE_MBUF_POOL == NULL)
+    {
+        DOCA_LOG_ERR("Create PROBE_MBUF_POOL Fail");
+        return -1;
+    }
+
+    nbProbeShards = nbWorkers;
+    for (int q = 0; q < nbProbeShards; q++)
+    {
+        struct doca_ar_probe_shard *shard = &PROBE_SHARDS[q];
+        snprintf(name, sizeof(name), "PROBE_TABLE_%d", q);
+        const struct rte_hash_parameters ProbeTable =
+            {
+                .name = name,
+                .entries = maxPending,
+                .reserved = 0,
+                .key_len = sizeof(uint64_t),
+                .hash_func = rte_hash_crc,
+                .hash_func_init_val = 0,
+                .socket_id = rte_socket_id(),
+                .extra_flag = RTE_HASH_EXTRA_FLAGS_EXT_TABLE,
+            };
+        shard->table = rte_hash_create(&ProbeTable);
+        if (!shard->table)
+        {
+            DOCA_LOG_ERR("Create ProbeTable %d fail!", q);
+            return -1;
+        }
+
+        snprintf(name, sizeof(name), "PROBE_RELEASE_%d", q);
+        shard->release = rte_ring_create(name, PROBE_RELEASE_RING, rte_socket_id(), RING_F_SP_ENQ | RING_F_SC_DEQ);
+        // any worker may hand a reply over, only the owner dequeues
+        snprintf(name, sizeof(name), "PROBE_REPLY_%d", q);
+        shard->replies = rte_ring_create(name, PROBE_REPLY_RING, rte_socket_id(), RING_F_SC_DEQ);
+        if (shard->release == NULL || shard->replies == NULL)
+        {
+            DOCA_LOG_ERR("Create probe rings %d fail!", q);
+            return -1;
+        }
+        shard->lastTimerManage = 0;
+
+        snprintf(name, sizeof(name), "PROBE_TMPL_%d", q);
+        const struct rte_hash_parameters TmplTable =
+            {
+                .name = name,
+                .entries = PROBE_TMPL_CACHE,
+                .reserved = 0,
+                .key_len = sizeof(struct doca_ar_path_key),
+                .hash_func = rte_hash_crc,
+                .hash_func_init_val = 0,
+                .socket_id = rte_socket_id(),
+            };
+        shard->tmplTable = rte_hash_create(&TmplTable);
+        shard->tmpls = rte_zmalloc(NULL, sizeof(struct doca_ar_probe_tmpl) * PROBE_TMPL_CACHE, RTE_CACHE_LINE_SIZE);
+        if (!shard->tmplTable || !shard->tmpls)
+        {
+            DOCA_LOG_ERR("Create probe template cache %d fail!", q);
+            return -1;
+        }
+        shard->nb_tx = 0;
+        memset(&shard->noise, 0, sizeof(shard->noise));
+        shard->noise.tscMin = UINT32_MAX;
+        shard->noise.hwMin = UINT32_MAX;
+    }
+    doca_ar_probe_ts_init();
+    DOCA_LOG_INFO("Create PROBE_TABLE[%d] x %d workers success", maxPending, nbProbeShards);
+    return 0;
+}
+
+/**
+ * @brief the best path of a probing conn is known: offload it and release its parked packets
+ *
+ * @param probe
+ * @param bestPath
+ */
+static void doca_ar_probe_resolve(struct doca_ar_probe *probe, uint16_t bestPath)
+{
+    struct doca_ar_conn *conn = probe->conn;
+    struct doca_ar_probe_shard *shard = &PROBE_SHARDS[conn->queue];
+
+    rte_timer_stop(&probe->timer);
+    if (rte_hash_del_key(shard->table, &probe->FlowID) < 0)
+    {
+        DOCA_LOG_ERR("PROBE_TABLE Del failed");
+    }
+    conn->bestPath = bestPath;
+    conn->probe = NULL;
+    doca_ar_hist_record(HIST_SETUP, doca_ar_stats_ns(rte_rdtsc() - probe->born));
+    doca_ar_add_new_flow(conn);
+
+    for (int i = 0; i < probe->nb_parked; i++)
+    {
+        doca_ar_modify_conn(conn, probe->parked[i]);
+    }
+    unsigned int nb_enq = rte_ring_enqueue_burst(shard->release, (void *const *)probe->parked, probe->nb_parked, NULL);
+    if (unlikely(nb_enq < probe->nb_parked))
+    {
+        do
+        {
+            rte_pktmbuf_free(probe->parked[nb_enq]);
+        } while (++nb_enq < probe->nb_parked);
+    }
+    rte_mempool_put(PROBE_POOL, (void *)probe);
+}
+
+/**
+ * @brief RTT of a path used to compare paths: the configured percentile of its samples
+ *
+ * @param samples
+ * @param nb
+ * @return uint32_t
+ */
+static uint32_t doca_ar_probe_path_rtt(uint32_t *samples, int nb)
+{
+    uint32_t sorted[MAX_PROBE_ROUNDS];
+    if (ar_config.probePercentile == 0 || nb == 1)
+    {
+        uint32_t min = samples[0];
+        for (int i = 1; i < nb; i++)
+            min = RTE_MIN(min, samples[i]);
+        return min;
+    }
+    rte_memcpy(sorted, samples, nb * sizeof(uint32_t));
+    for (int i = 1; i < nb; i++) // insertion sort, nb <= MAX_PROBE_ROUNDS
+    {
+        uint32_t v = sorted[i];
+        int j = i - 1;
+        for (; j >= 0 && sorted[j] > v; j--)
+            sorted[j + 1] = sorted[j];
+        sorted[j + 1] = v;
+    }
+    int rank = (ar_config.probePercentile * nb + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/**
+ * @brief timer callback: the reply window is over or PROBE_TIMEOUT is reached, choose the path with the lowest RTT
+ *
+ * @param timer
+ * @param arg
+ */
+static void doca_ar_probe_decide(__rte_unused struct rte_timer *timer, void *arg)
+{
+    struct doca_ar_probe *probe = arg;
+    struct doca_ar_conn *conn = probe->conn;
+    uint16_t bestPath = conn->match.sport;
+    uint32_t bestRtt = UINT32_MAX;
+
+    for (int p = 0; p < PROBE_PATH_AMOUNT; p++)
+    {
+        conn->probePort[p] = probe->ports[p];
+        conn->probeRtt[p] = probe->nb_samples[p] ? doca_ar_probe_path_rtt(probe->samples[p], probe->nb_samples[p]) : UINT32_MAX;
+    }
+    if (probe->nb_replies)
+    {
+        // with --probe-metric fwdvar the path table turns the delays into forward delay variation
+        struct doca_ar_path_key key = {.sip = conn->match.sip, .dip = conn->match.dip, .ipv6 = conn->match.ipv6};
+        doca_ar_path_update(&key, conn->probePort, conn->probeRtt, PROBE_PATH_AMOUNT, &probe->owd.path);
+    }
+    for (int p = 0; p < PROBE_PATH_AMOUNT; p++)
+    {
+        if (conn->probeRtt[p] < bestRtt) // ties keep the lower index, the original sport is probed first
+        {
+            bestRtt = conn->probeRtt[p];
+            bestPath = probe->ports[p];
+        }
+    }
+    if (probe->nb_replies < PROBE_PATH_AMOUNT * ar_config.probeRounds)
+        doca_ar_stats()->probeTimeout++;
+    if (probe->nb_replies == 0)
+    {
+        DOCA_LOG_ERR("Probe Timeout: Not Find Best Path for Not Received Probe Packets");
+        doca_ar_print_match(&conn->match);
+    }
+    else
+    {
+        if (bestPath != conn->match.sport)
+        {
+            doca_ar_stats()->pathSwitch++;
+            DOCA_LOG_INFO("FlowTD[%lu]:%d==>%d", probe->FlowID, rte_be_to_cpu_16(conn->match.sport), rte_be_to_cpu_16(bestPath));
+        }
+    }
+    doca_ar_probe_resolve(probe, bestPath);
+}
+
+/* OvS flow for sending back probe packets in receiver DPU
+ovs-ofctl del-flows ovsbr1
+ovs-ofctl add-flow ovsbr1 "priority=300,in_port=p0,udp,tp_dst=4789,nw_tos=0x20 actions=mod_dl_dst:08:c0:eb:bf:ef:9a,mod_tp_dst:4788,output:IN_PORT"
+ovs-ofctl add-flow ovsbr1 "priority=100,in_port=p0 actions=output:pf0hpf"
+ovs-ofctl add-flow ovsbr1 "priority=100,in_port=pf0hpf actions=output:p0"
+*/
+
+/**
+ * @brief build a probe packet from the outer headers of a vxlan packet on an ipv6 underlay
+ *
+ * @param mbuf
+ * @param hdr outer ether header, followed by ipv6 and udp headers
+ * @param sport
+ * @param flowID
+ */
+static void doca_ar_probe_fill6(struct rte_mbuf *mbuf, const struct rte_ether_hdr *hdr, uint16_t sport, uint64_t flowID)
+{
+    const struct rte_ipv6_hdr *this_ip = (const struct rte_ipv6_hdr *)(hdr + 1);
+    const struct rte_udp_hdr *this_udp_h = (const struct rte_udp_hdr *)(this_ip + 1);
+    struct rte_ether_hdr *ether_h;
+    struct rte_ipv6_hdr *ip;
+    struct rte_udp_hdr *udp_h;
+    struct rte_vxlan_hdr *vxlan_h;
+    struct PROBE_HDR *pay;
+    /**Ether**/
+    ether_h = (struct rte_ether_hdr *)rte_pktmbuf_append(mbuf, sizeof(struct rte_ether_hdr));
+    rte_memcpy(ether_h, hdr, sizeof(struct rte_ether_hdr));
+    /**IPv6**/
+    ip = (struct rte_ipv6_hdr *)rte_pktmbuf_append(mbuf, sizeof(struct rte_ipv6_hdr));
+    rte_memcpy(ip, this_ip, sizeof(struct rte_ipv6_hdr));
+    ip->vtc_flow = rte_cpu_to_be_32(6 << 28 | 0x20 << 20); // traffic class 0x20 like the tos of ipv4 probes, flow label 0
+    ip->payload_len = rte_cpu_to_be_16(PROBE_UDP_LEN);
+    ip->proto = IPPROTO_UDP;
+    ip->hop_limits = 64;
+    /**UDP**/
+    udp_h = (struct rte_udp_hdr *)rte_pktmbuf_append(mbuf, sizeof(struct rte_udp_hdr));
+    rte_memcpy(udp_h, this_udp_h, sizeof(struct rte_udp_hdr));
+    udp_h->src_port = sport;
+    udp_h->dgram_len = rte_cpu_to_be_16(PROBE_UDP_LEN);
+    /**VXLAN**/
+    vxlan_h = (struct rte_vxlan_hdr *)rte_pktmbuf_append(mbuf, sizeof(struct rte_vxlan_hdr));
+    vxlan_h->vx_flags = rte_cpu_to_be_32(0x08000000);
+    vxlan_h->vx_vni = rte_cpu_to_be_32(PROBE_VNI << 8);
+    /**Payload**/
+    pay = (struct PROBE_HDR *)rte_pktmbuf_append(mbuf, sizeof(struct PROBE_HDR));
+    pay->timeStamp = rte_rdtsc();
+    pay->FlowID = flowID;
+    pay->nicTime = 0;
+    pay->txTime = 0;
+    pay->rxTime = 0;
+    pay->refTxTime = 0;
+    pay->stamps = 0;
+    pay->reserved = 0;
+    /**offload cksum, mandatory for udp over ipv6**/
+    mbuf->l2_len = sizeof(struct rte_ether_hdr);
+    mbuf->l3_len = sizeof(struct rte_ipv6_hdr);
+    mbuf->ol_flags |= PKT_TX_IPV6 | PKT_TX_UDP_CKSUM;
+    udp_h->dgram_cksum = rte_ipv6_phdr_cksum(ip, mbuf->ol_flags);
+}
+
+void doca_ar_probe_fill(struct rte_mbuf *mbuf, const struct rte_ether_hdr *hdr, uint16_t sport, uint64_t flowID)
+{
+    if (hdr->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV6))
+    {
+        doca_ar_probe_fill6(mbuf, hdr, sport, flowID);
+        return;
+    }
+    const struct rte_ipv4_hdr *this_ip = (const struct rte_ipv4_hdr *)(hdr + 1);
+    const struct rte_udp_hdr *this_udp_h = (const struct rte_udp_hdr *)(this_ip + 1);
+    struct rte_ether_hdr *ether_h;
+    struct rte_ipv4_hdr *ip;
+    struct rte_udp_hdr *udp_h;
+    struct rte_vxlan_hdr *vxlan_h;
+    struct PROBE_HDR *pay;
+    /**Ether**/
+    ether_h = (struct rte_ether_hdr *)rte_pktmbuf_append(mbuf, sizeof(struct rte_ether_hdr));
+    rte_memcpy(ether_h, hdr, sizeof(struct rte_ether_hdr));
+    /**IP**/
+    ip = (struct rte_ipv4_hdr *)rte_pktmbuf_append(mbuf, sizeof(struct rte_ipv4_hdr));
+    rte_memcpy(ip, this_ip, sizeof(struct rte_ipv4_hdr));
+    ip->version_ihl = 0x45;
+    ip->type_of_service = 0x20;
+    ip->total_length = htons(sizeof(struct rte_ipv4_hdr) + PROBE_UDP_LEN);
+    ip->packet_id = 0;
+    ip->fragment_offset = 0;
+    ip->time_to_live = 64; // ttl = 64
+    ip->next_proto_id = IPPROTO_UDP;
+    ip->hdr_checksum = 0;
+    /**UDP**/
+    udp_h = (struct rte_udp_hdr *)rte_pktmbuf_append(mbuf, sizeof(struct rte_udp_hdr));
+    rte_memcpy(udp_h, this_udp_h, sizeof(struct rte_udp_hdr));
+    udp_h->src_port = sport;
+    udp_h->dgram_cksum = 0;
+    udp_h->dgram_len = rte_cpu_to_be_16(PROBE_UDP_LEN);
+    /**VXLAN**/
+    vxlan_h = (struct rte_vxlan_hdr *)rte_pktmbuf_append(mbuf, sizeof(struct rte_vxlan_hdr));
+    vxlan_h->vx_flags = rte_cpu_to_be_32(0x08000000);
+    vxlan_h->vx_vni = rte_cpu_to_be_32(PROBE_VNI << 8);
+    /**Payload**/
+    pay = (struct PROBE_HDR *)rte_pktmbuf_append(mbuf, sizeof(struct PROBE_HDR));
+    pay->timeStamp = rte_rdtsc();
+    pay->FlowID = flowID;
+    pay->nicTime = 0;
+    pay->txTime = 0;
+    pay->rxTime = 0;
+    pay->refTxTime = 0;
+    pay->stamps = 0;
+    pay->reserved = 0;
+    /**offload cksum**/
+    mbuf->l2_len = sizeof(struct rte_ether_hdr);
+    mbuf->l3_len = sizeof(struct rte_ipv4_hdr);
+    mbuf->ol_flags |= PKT_TX_IPV4 | PKT_TX_IP_CKSUM | PKT_TX_UDP_CKSUM;
+}
+
+int doca_ar_probe_tmpl_init(struct doca_ar_probe_tmpl *tmpl, const struct rte_ether_hdr *hdr)
+{
+    struct rte_mbuf *mbuf = rte_pktmbuf_alloc(PROBE_MBUF_POOL);
+    if (mbuf == NULL)
+        return -1;
+    doca_ar_probe_fill(mbuf, hdr, 0, 0);
+    rte_memcpy(tmpl->bytes, rte_pktmbuf_mtod(mbuf, void *), mbuf->data_len);
+    tmpl->len = mbuf->data_len;
+    tmpl->l3_len = mbuf->l3_len;
+    tmpl->ol_flags = mbuf->ol_flags;
+    rte_pktmbuf_free(mbuf);
+    return 0;
+}
+
+/**
+ * @brief get the probe template of the destination of a conn from the cache of its worker, built from the first packet on a miss
+ *
+ * @param shard
+ * @param conn
+ * @param hdr outer ether header of the first packet of the conn
+ * @return struct doca_ar_probe_tmpl* NULL if no template can be built
+ */
+static struct doca_ar_probe_tmpl *doca_ar_probe_tmpl_get(struct doca_ar_probe_shard *shard, struct doca_ar_conn *conn, const struct rte_ether_hdr *hdr)
+{
+    struct doca_ar_path_key key = {.sip = conn->match.sip, .dip = conn->match.dip, .ipv6 = conn->match.ipv6};
+    int pos = rte_hash_lookup(shard->tmplTable, &key);
+    if (pos >= 0)
+    {
+        // the next hop may have changed its mac since the template was built
+        if (memcmp(shard->tmpls[pos].bytes, hdr, 2 * RTE_ETHER_ADDR_LEN) == 0)
+            return &shard->tmpls[pos];
+    }
+    else
+    {
+        pos = rte_hash_add_key(shard->tmplTable, &key);
+        if (pos < 0)
+        {
+            rte_hash_reset(shard->tmplTable);
+            pos = rte_hash_add_key(shard->tmplTable, &key);
+        }
+        if (pos < 0 || pos >= PROBE_TMPL_CACHE)
+            return NULL;
+    }
+    if (doca_ar_probe_tmpl_init(&shard->tmpls[pos], hdr) != 0)
+    {
+        rte_hash_del_key(shard->tmplTable, &key);
+        return NULL;
+    }
+    return &shard->tmpls[pos];
+}
+
+void doca_ar_probe_set_ttl(struct rte_mbuf *mbuf, uint8_t ttl, uint16_t tag)
+{
+    struct rte_ether_hdr *eth = rte_pktmbuf_mtod(mbuf, struct rte_ether_hdr *);
+    if (eth->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV6))
+    {
+        struct rte_ipv6_hdr *ip6 = (struct rte_ipv6_hdr *)(eth + 1);
+        ip6->hop_limits = ttl; // the flow label is left alone, switches may hash it
+        return;
+    }
+    struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(eth + 1);
+    ip->time_to_live = ttl;
+    ip->packet_id = rte_cpu_to_be_16(tag); // the header checksum is offloaded
+}
+
+struct PROBE_HDR *doca_ar_probe_parse_reply(struct rte_mbuf *m, uint16_t *sport)
+{
+    if (RTE_ETH_IS_IPV6_HDR(m->packet_type))
+    {
+        struct rte_ipv6_hdr *ip6 = rte_pktmbuf_mtod_offset(m, struct rte_ipv6_hdr *, sizeof(struct rte_ether_hdr));
+        struct rte_udp_hdr *udp6 = (struct rte_udp_hdr *)(ip6 + 1);
+        if (ip6->proto != IPPROTO_UDP || udp6->dst_port != rte_cpu_to_be_16(PROBE_REPLY_PORT))
+            return NULL;
+        *sport = udp6->src_port;
+        return doca_ar_probe_payload(udp6);
+    }
+    if (!RTE_ETH_IS_IPV4_HDR(m->packet_type))
+        return NULL;
+    struct rte_ipv4_hdr *ip = rte_pktmbuf_mtod_offset(m, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
+    if (ip->next_proto_id != IPPROTO_UDP)
+        return NULL;
+    struct rte_udp_hdr *udp = rte_pktmbuf_mtod_offset(m, struct rte_udp_hdr *, sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr));
+    if (udp->dst_port != rte_cpu_to_be_16(PROBE_REPLY_PORT))
+        return NULL;
+    *sport = udp->src_port;
+    return doca_ar_probe_payload(udp);
+}
+
+void doca_ar_probe_stamp_tx(struct rte_mbuf **pkts, uint16_t nb)
+{
+    uint64_t now = rte_rdtsc(), clk = 0, txNs;
+    if (probeHwTs)
+        rte_eth_read_clock(to_net_port, &clk);
+    txNs = clk ? doca_ar_probe_ns(clk, nicHz) : doca_ar_probe_ns(now, rte_get_tsc_hz());
+    for (uint16_t i = 0; i < nb; i++)
+    {
+        struct rte_mbuf *m = pkts[i];
+        struct PROBE_HDR *pay = doca_ar_probe_payload(rte_pktmbuf_mtod_offset(m, struct rte_udp_hdr *, m->l2_len + m->l3_len));
+        pay->timeStamp = now;
+        pay->nicTime = clk;
+        pay->txTime = txNs;
+    }
+}
+
+void doca_ar_probe_stamp_rx(const struct rte_mbuf *m, struct PROBE_HDR *hdr)
+{
+    uint64_t hwNs = 0, rxTsc = rte_rdtsc(), rx = 0;
+    if (probeHwTs && hdr->nicTime && (m->ol_flags & rxTsFlag))
+    {
+        rx = *RTE_MBUF_DYNFIELD(m, rxTsOffset, const rte_mbuf_timestamp_t *);
+        if (rx > hdr->nicTime)
+            hwNs = (rx - hdr->nicTime) * 1000000000 / nicHz;
+    }
+    if (hdr->stamps & PROBE_STAMP_RX)
+    {
+        // the clocks of sender and reflector are not synchronized, the offset stays in until it is estimated
+        uint64_t txNs = rx ? hdr->txTime : doca_ar_probe_ns(hdr->timeStamp, rte_get_tsc_hz());
+        uint64_t rxNs = rx ? doca_ar_probe_ns(rx, nicHz) : doca_ar_probe_ns(rxTsc, rte_get_tsc_hz());
+        hdr->rxTime = hdr->rxTime - txNs;
+        hdr->refTxTime = hdr->stamps & PROBE_STAMP_TX ? rxNs - hdr->refTxTime : 0;
+    }
+    hdr->timeStamp = (rxTsc - hdr->timeStamp) * 1000000000 / rte_get_tsc_hz();
+    hdr->nicTime = hwNs;
+}
+
+uint32_t doca_ar_probe_sample(const struct PROBE_HDR *hdr, struct doca_ar_probe_owd *owd, int p)
+{
+    uint32_t rtt = doca_ar_probe_reply_rtt(hdr);
+    if (!(hdr->stamps & PROBE_STAMP_RX))
+        return rtt;
+    int64_t fwd = (int64_t)hdr->rxTime;
+    owd->path.fwd[p] = RTE_MIN(owd->path.fwd[p], fwd);
+    if (hdr->stamps & PROBE_STAMP_TX)
+    {
+        // fwd = d_fwd + offset, rev = d_rev - offset, the least delayed reply has the most symmetric delays
+        int64_t rev = (int64_t)hdr->refTxTime, delay = fwd + rev;
+        if (delay >= 0 && delay < owd->path.delay)
+        {
+            owd->path.delay = (uint32_t)delay;
+            owd->path.offset = (fwd - rev) / 2;
+        }
+    }
+    if (ar_config.probeMetric == PROBE_METRIC_RTT)
+        return rtt;
+    if (owd->rtt == 0)
+    {
+        owd->fwd = fwd;
+        owd->rtt = rtt;
+        return rtt;
+    }
+    int64_t delay = (int64_t)owd->rtt + (fwd - owd->fwd);
+    return delay <= 0 ? 1 : (uint32_t)RTE_MIN(delay, (int64_t)UINT32_MAX - 1);
+}
+
+int doca_ar_probe_reflect(struct rte_mbuf *m)
+{
+    struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+    struct rte_ether_addr mac;
+    struct rte_udp_hdr *udp;
+    struct rte_ipv6_hdr *ip6 = NULL;
+    uint32_t l3Len;
+
+    if (eth->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV6))
+    {
+        ip6 = (struct rte_ipv6_hdr *)(eth + 1);
+        if (ip6->proto != IPPROTO_UDP)
+            return -1;
+        l3Len = sizeof(struct rte_ipv6_hdr);
+    }
+    else if (eth->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4))
+    {
+        struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(eth + 1);
+        if (ip->version_ihl != 0x45 || ip->next_proto_id != IPPROTO_UDP)
+            return -1;
+        l3Len = sizeof(struct rte_ipv4_hdr);
+    }
+    else
+        return -1;
+    if (rte_pktmbuf_data_len(m) < sizeof(struct rte_ether_hdr) + l3Len + PROBE_UDP_LEN)
+        return -1;
+    udp = rte_pktmbuf_mtod_offset(m, struct rte_udp_hdr *, sizeof(struct rte_ether_hdr) + l3Len);
+    const struct rte_vxlan_hdr *vxlan = (const struct rte_vxlan_hdr *)(udp + 1);
+    if (udp->dst_port != rte_cpu_to_be_16(4789) || vxlan->vx_vni != rte_cpu_to_be_32(PROBE_VNI << 8))
+        return -1;
+
+    if (ar_config.reflectorStamp)
+    {
+        uint64_t rx = rte_rdtsc();
+        struct PROBE_HDR *pay = doca_ar_probe_payload(udp);
+        if (probeHwTs && (m->ol_flags & rxTsFlag))
+        {
+            pay->rxTime = doca_ar_probe_ns(*RTE_MBUF_DYNFIELD(m, rxTsOffset, const rte_mbuf_timestamp_t *), nicHz);
+            pay->stamps = PROBE_STAMP_RX | PROBE_STAMP_NIC;
+        }
+        else
+        {
+            pay->rxTime = doca_ar_probe_ns(rx, rte_get_tsc_hz());
+            pay->stamps = PROBE_STAMP_RX;
+        }
+    }
+    // back to the router it came from, like mod_dl_dst of the OvS rule
+    rte_ether_addr_copy(&eth->d_addr, &mac);
+    rte_ether_addr_copy(ar_config.hasReflectorMac ? &ar_config.reflectorMac : &eth->s_addr, &eth->d_addr);
+    rte_ether_addr_copy(&mac, &eth->s_addr);
+    udp->dst_port = rte_cpu_to_be_16(PROBE_REPLY_PORT);
+    m->l2_len = sizeof(struct rte_ether_hdr);
+    m->l3_len = l3Len;
+    if (ip6 != NULL)
+    {
+        // the payload changed, the udp cksum is mandatory over ipv6
+        m->ol_flags = PKT_TX_IPV6 | PKT_TX_UDP_CKSUM;
+        udp->dgram_cksum = rte_ipv6_phdr_cksum(ip6, m->ol_flags);
+    }
+    else
+    {
+        m->ol_flags = 0;
+        udp->dgram_cksum = 0;
+    }
+    return 0;
+}
+
+void doca_ar_probe_stamp_reflect(struct rte_mbuf **pkts, uint16_t nb)
+{
+    uint64_t tscNs, nicNs = 0, clk = 0;
+    if (!ar_config.reflectorStamp)
+        return;
+    tscNs = doca_ar_probe_ns(rte_rdtsc(), rte_get_tsc_hz());
+    if (probeHwTs && rte_eth_read_clock(to_net_port, &clk) == 0)
+        nicNs = doca_ar_probe_ns(clk, nicHz);
+    for (uint16_t i = 0; i < nb; i++)
+    {
+        struct rte_mbuf *m = pkts[i];
+        struct PROBE_HDR *pay = doca_ar_probe_payload(rte_pktmbuf_mtod_offset(m, struct rte_udp_hdr *, m->l2_len + m->l3_len));
+        // on the clock rxTime was stamped by
+        if (!(pay->stamps & PROBE_STAMP_NIC))
+            pay->refTxTime = tscNs;
+        else if (nicNs)
+            pay->refTxTime = nicNs;
+        else
+            continue;
+        pay->stamps |= PROBE_STAMP_TX;
+    }
+}
+
+void doca_ar_probe_flush(uint16_t queue)
+{
+    struct doca_ar_probe_shard *shard = &PROBE_SHARDS[queue];
+    uint16_t nb = shard->nb_tx;
+    if (nb == 0)
+        return;
+    // stamped right before they leave, the time held back is not charged to the RTT
+    doca_ar_probe_stamp_tx(shard->tx, nb);
+    uint16_t nb_tx = rte_eth_tx_burst(to_net_port, queue, shard->tx, nb);
+    struct doca_ar_stats *stats = doca_ar_stats();
+    stats->tx[to_net_port] += nb_tx;
+    stats->probeSent += nb_tx;
+    if (unlikely(nb_tx < nb))
+    {
+        stats->drop[to_net_port] += nb - nb_tx;
+        rte_pktmbuf_free_bulk(&shard->tx[nb_tx], nb - nb_tx);
+    }
+    shard->nb_tx = 0;
+}
+
+int doca_ar_probe_start(struct doca_ar_conn *conn, struct rte_mbuf *m)
+{
+    struct doca_ar_probe *probe = NULL;
+    struct doca_ar_probe_shard *shard = &PROBE_SHARDS[conn->queue];
+    struct doca_ar_probe_tmpl *tmpl;
+    int count = PROBE_PATH_AMOUNT * ar_config.probeRounds;
+    uint64_t flowID = ((uint64_t)conn->queue << PROBE_OWNER_SHIFT) | (rte_rdtsc() & ((1ULL << PROBE_OWNER_SHIFT) - 1));
+
+    tmpl = doca_ar_probe_tmpl_get(shard, conn, rte_pktmbuf_mtod(m, struct rte_ether_hdr *));
+    if (tmpl == NULL)
+        return -1;
+    if (rte_mempool_get(PROBE_POOL, (void **)&probe) != 0)
+    {
+        DOCA_LOG_ERR("Too many pending probes, skip probing");
+        return -1;
+    }
+    if (shard->nb_tx + count > PROBE_TX_BURST)
+        doca_ar_probe_flush(conn->queue);
+    struct rte_mbuf **mbufs = &shard->tx[shard->nb_tx];
+    if (rte_pktmbuf_alloc_bulk(PROBE_MBUF_POOL, mbufs, count) != 0)
+    {
+        rte_mempool_put(PROBE_POOL, (void *)probe);
+        return -1;
+    }
+    probe->FlowID = flowID;
+    probe->conn = conn;
+    probe->born = rte_rdtsc();
+    probe->nb_parked = 0;
+    probe->nb_replies = 0;
+    doca_ar_probe_owd_reset(&probe->owd);
+    for (int p = 0; p < PROBE_PATH_AMOUNT; p++)
+    {
+        probe->ports[p] = rte_cpu_to_be_16(rte_be_to_cpu_16(conn->match.sport) + p);
+        probe->nb_samples[p] = 0;
+    }
+    if (rte_hash_add_key_data(shard->table, &probe->FlowID, probe) < 0)
+    {
+        DOCA_LOG_ERR("PROBE_TABLE Add failed");
+        rte_pktmbuf_free_bulk(mbufs, count);
+        rte_mempool_put(PROBE_POOL, (void *)probe);
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        // rounds are sent one after another over all paths
+        doca_ar_probe_build(mbufs[i], tmpl, probe->ports[i % PROBE_PATH_AMOUNT], flowID);
+    }
+    shard->nb_tx += count;
+
+    conn->probe = probe;
+    probe->parked[probe->nb_parked++] = m;
+    rte_timer_init(&probe->timer);
+    rte_timer_reset(&probe->timer, PROBE_TIMEOUT * rte_get_timer_hz() / 1000, SINGLE,
+                    rte_lcore_id(), doca_ar_probe_decide, probe);
+    return 0;
+}
+
+int doca_ar_probe_park(struct doca_ar_conn *conn, struct rte_mbuf *m)
+{
+    struct doca_ar_probe *probe = conn->probe;
+    if (probe == NULL || probe->nb_parked >= MAX_PARKED_PKTS)
+        return -1;
+    probe->parked[probe->nb_parked++] = m;
+    return 0;
+}
+
+/**
+ * @brief compare a reply with the previous one of the same path of the probe by both clocks
+ *
+ * @param noise
+ * @param probe
+ * @param p index of the path
+ * @param hdr reply stamped by doca_ar_probe_stamp_rx
+ */
+static void doca_ar_probe_account_noise(struct doca_ar_probe_noise *noise, struct doca_ar_probe *probe, int p, const struct PROBE_HDR *hdr)
+{
+    uint32_t tsc = RTE_MIN(hdr->timeStamp, (uint64_t)UINT32_MAX - 1), hw = RTE_MIN(hdr->nicTime, (uint64_t)UINT32_MAX - 1);
+    noise->tscMin = RTE_MIN(noise->tscMin, tsc);
+    if (hw)
+        noise->hwMin = RTE_MIN(noise->hwMin, hw);
+    if (probe->nb_samples[p])
+    {
+        noise->tscPairs++;
+        noise->tscDiff += tsc > probe->lastTsc[p] ? tsc - probe->lastTsc[p] : probe->lastTsc[p] - tsc;
+        if (hw && probe->lastHw[p])
+        {
+            noise->hwPairs++;
+            noise->hwDiff += hw > probe->lastHw[p] ? hw - probe->lastHw[p] : probe->lastHw[p] - hw;
+        }
+    }
+    probe->lastTsc[p] = tsc;
+    probe->lastHw[p] = hw;
+}
+
+/**
+ * @brief match a probe reply against the pending probes of the worker which sent the probe
+ *
+ * @param queue the owner worker
+ * @param m
+ * @param hdr
+ * @param sport
+ */
+static void doca_ar_probe_match_reply(uint16_t queue, struct rte_mbuf *m, struct PROBE_HDR *hdr, uint16_t sport)
+{
+    struct doca_ar_probe *probe = NULL;
+    // replies of resolved probes are not in the table any more and simply discarded
+    if (rte_hash_lookup_data(PROBE_SHARDS[queue].table, &hdr->FlowID, (void **)&probe) < 0)
+    {
+        rte_pktmbuf_free(m);
+        return;
+    }
+    for (int p = 0; p < PROBE_PATH_AMOUNT; p++)
+    {
+        if (probe->ports[p] != sport || probe->nb_samples[p] >= MAX_PROBE_ROUNDS)
+            continue;
+        doca_ar_probe_account_noise(&PROBE_SHARDS[queue].noise, probe, p, hdr);
+        doca_ar_hist_record(HIST_PROBE_RTT + p, doca_ar_probe_reply_rtt(hdr));
+        probe->samples[p][probe->nb_samples[p]++] = doca_ar_probe_sample(hdr, &probe->owd, p);
+        break;
+    }
+    rte_pktmbuf_free(m);
+    if (++probe->nb_replies >= PROBE_PATH_AMOUNT * ar_config.probeRounds)
+    {
+        doca_ar_probe_decide(&probe->timer, probe); // every probe packet is back, no need to wait
+    }
+    else if (probe->nb_replies == 1)
+    {
+        // the first reply opens the window, slower paths still have probeWindowUs to come back
+        rte_timer_reset(&probe->timer, (uint64_t)ar_config.probeWindowUs * rte_get_timer_hz() / 1000000, SINGLE,
+                        rte_lcore_id(), doca_ar_probe_decide, probe);
+    }
+}
+
+int doca_ar_probe_handle_reply(uint16_t queue, struct rte_mbuf *m)
+{
+    uint16_t sport;
+    struct PROBE_HDR *hdr = doca_ar_probe_parse_reply(m, &sport);
+    if (hdr == NULL)
+    {
+        rte_pktmbuf_free(m);
+        return 0;
+    }
+    doca_ar_stats()->probeRcvd++;
+    // from now on the reply carries its RTT, waiting in the reply ring is not charged to it
+    doca_ar_probe_stamp_rx(m, hdr);
+    uint16_t owner = hdr->FlowID >> PROBE_OWNER_SHIFT;
+    if (owner == queue)
+        doca_ar_probe_match_reply(queue, m, hdr, sport);
+    else if (owner >= nbProbeShards || rte_ring_enqueue(PROBE_SHARDS[owner].replies, m) != 0)
+        rte_pktmbuf_free(m);
+    return 1;
+}
+
+uint16_t doca_ar_probe_poll(uint16_t queue)
+{
+    struct doca_ar_probe_shard *shard = &PROBE_SHARDS[queue];
+    struct rte_mbuf *replies[PROBE_REPLY_BURST];
+    uint16_t sport, nb_rx = 0;
+
+    // probe_queue only carries probe replies, whichever worker gets it dispatches them by the owner in the FlowID
+    if (!ar_config.proberIntervalMs && rte_spinlock_trylock(&replyLock))
+    {
+        nb_rx = rte_eth_rx_burst(to_net_port, probe_queue, replies, PROBE_REPLY_BURST);
+        rte_spinlock_unlock(&replyLock);
+        for (uint16_t i = 0; i < nb_rx; i++)
+            doca_ar_probe_handle_reply(queue, replies[i]);
+    }
+
+    unsigned int nb = rte_ring_dequeue_burst(shard->replies, (void **)replies, RTE_DIM(replies), NULL);
+    for (unsigned int i = 0; i < nb; i++)
+        doca_ar_probe_match_reply(queue, replies[i], doca_ar_probe_parse_reply(replies[i], &sport), sport);
+
+    uint64_t now = rte_rdtsc();
+    if (now - shard->lastTimerManage > PROBE_TIMER_RESOLUTION_US * rte_get_tsc_hz() / 1000000)
+    {
+        rte_timer_manage();
+        shard->lastTimerManage = now;
+    }
+    return nb_rx;
+}
+
+uint16_t doca_ar_probe_drain(uint16_t queue, struct rte_mbuf **pkts, uint16_t max)
+{
+    return rte_ring_dequeue_burst(PROBE_SHARDS[queue].release, (void **)pkts, max, NULL);
+}
+
+const struct doca_ar_probe_noise *doca_ar_probe_noise(uint16_t queue)
+{
+    return &PROBE_SHARDS[queue].noise;
+}
+
+uint32_t doca_ar_probe_pending()
+{
+    return PROBE_POOL ? rte_mempool_in_use_count(PROBE_POOL) : 0;
+}
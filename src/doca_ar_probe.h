@@ -0,0 +1,330 @@
+/**
+ * @file doca_ar_probe.h
+ * @author Mark Chen (markchen77888@gmail.com)
+ * @brief non-blocking probe engine: new conns are parked in a pending-probe table until their probe replies or timeout arrive
+ * @version 1.0
+ * @date 2024-01-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef DOCA_AR_PROBE_H_
+#define DOCA_AR_PROBE_H_
+#include "doca_ar_env.h"
+#include "doca_ar_conntrack.h"
+#include "doca_ar_path.h"
+#include <rte_timer.h>
+#include <rte_mbuf.h>
+#include <rte_cycles.h>
+#include <rte_memcpy.h>
+
+#define PROBE_TIMEOUT 50         ///< Probe Timeout[ms]
+#define PROBE_REPLY_PORT 4788    ///< udp dst port of probe packets sent back by the receiver DPU
+#define PROBE_VNI 0xfffffe       ///< vni of the vxlan header in front of PROBE_HDR, lets a reflector match probes in hardware
+#define MAX_PENDING_PROBE 1024   ///< maximum new conns waiting for probe replies at the same time
+#define MAX_PARKED_PKTS 8        ///< maximum packets of a probing conn held back until its best path is known
+#define PROBE_RELEASE_RING 4096  ///< size of the ring holding parked packets released by resolved probes
+#define PROBE_REPLY_RING 1024    ///< size of the ring holding probe replies handed over by other workers
+#define PROBE_REPLY_BURST 64     ///< num of rx_burst on probe_queue
+#define PROBE_OWNER_SHIFT 56     ///< FlowID carries the worker which sent the probe in its top byte
+#define PROBE_TMPL_CACHE 1024    ///< probe templates cached by one worker, the cache starts over when it is full
+#define PROBE_TX_BURST 256       ///< probe packets a worker holds back to send them in one tx_burst
+#define PROBE_MBUF_POOL_SIZE 16383
+#define PROBE_MBUF_CACHE 256
+
+/**
+ * @brief the user-defined probe packets header
+ *
+ */
+struct PROBE_HDR
+{
+    uint64_t timeStamp; ///< tsc when sent, replaced by the TSC RTT[ns] once the reply is received
+    uint64_t FlowID;    ///< used to distinguish probe packets we sent just now, packets sent before will be discarded
+    uint64_t nicTime;   ///< NIC clock when sent with hardware timestamps, replaced by the NIC RTT[ns] (0 if unknown) once the reply is received
+    uint64_t txTime;    ///< send time[ns] on the sender clock, the NIC clock with hardware timestamps, otherwise the tsc
+    uint64_t rxTime;    ///< receive time[ns] on the reflector clock, replaced by the forward delay plus the clock offset[ns] once the reply is received
+    uint64_t refTxTime; ///< send time[ns] on the reflector clock, replaced by the reverse delay less the clock offset[ns] once the reply is received
+    uint32_t stamps;    ///< PROBE_STAMP_* of the reflector, 0 if it did not stamp
+    uint32_t reserved;
+};
+
+#define PROBE_STAMP_RX 0x1  ///< rxTime is stamped
+#define PROBE_STAMP_TX 0x2  ///< refTxTime is stamped
+#define PROBE_STAMP_NIC 0x4 ///< the reflector stamped by its NIC clock, otherwise by its tsc
+
+/**
+ * @brief one-way delays within one probe round
+ *
+ */
+struct doca_ar_probe_owd
+{
+    int64_t fwd;  ///< forward delay plus clock offset of the first stamped reply[ns], the offset cancels out against it
+    uint32_t rtt; ///< RTT of the same reply[ns], 0 if no stamped reply came back yet
+    struct doca_ar_path_owd path; ///< least forward delay of every path and the offset sample, handed to the path table
+};
+
+/**
+ * @brief reset the one-way delays when a probe round is sent
+ *
+ * @param owd
+ */
+static inline void doca_ar_probe_owd_reset(struct doca_ar_probe_owd *owd)
+{
+    owd->rtt = 0;
+    for (int p = 0; p < PROBE_PATH_AMOUNT; p++)
+        owd->path.fwd[p] = INT64_MAX;
+    owd->path.delay = UINT32_MAX;
+}
+
+#define PROBE_UDP_LEN (sizeof(struct rte_udp_hdr) + sizeof(struct rte_vxlan_hdr) + sizeof(struct PROBE_HDR)) ///< udp length of probe packets
+#define PROBE_PKT_LEN (sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv6_hdr) + PROBE_UDP_LEN)                  ///< longest probe packet, on an ipv6 underlay
+
+/**
+ * @brief payload of a probe packet, behind its udp header and a vxlan header carrying PROBE_VNI
+ *
+ * @param udp
+ * @return struct PROBE_HDR*
+ */
+static inline struct PROBE_HDR *doca_ar_probe_payload(const struct rte_udp_hdr *udp)
+{
+    return (struct PROBE_HDR *)((uintptr_t)(udp + 1) + sizeof(struct rte_vxlan_hdr));
+}
+
+/**
+ * @brief a prebuilt probe packet towards one destination, only the src port, FlowID and timestamp differ between its probes
+ *
+ */
+struct doca_ar_probe_tmpl
+{
+    uint8_t bytes[PROBE_PKT_LEN];
+    uint16_t len;      ///< length of the probe packet
+    uint16_t l3_len;
+    uint64_t ol_flags; ///< cksum offload of the probe packet
+};
+
+/**
+ * @brief context of a conn waiting for its probe replies
+ *
+ */
+struct doca_ar_probe
+{
+    uint64_t FlowID;                            ///< key of the pending-probe table, carried in PROBE_HDR
+    struct doca_ar_conn *conn;                  ///< the new conn being probed
+    struct rte_timer timer;                     ///< fires at PROBE_TIMEOUT, or at the end of the reply window after the first reply
+    uint64_t born;                              ///< tsc when the probe started, i.e. the first packet of the conn
+    uint16_t nb_replies;                        ///< probe packets came back so far
+    uint16_t ports[PROBE_PATH_AMOUNT];          ///< src port of every probed path
+    uint8_t nb_samples[PROBE_PATH_AMOUNT];      ///< amount of RTT samples of every path
+    uint32_t samples[PROBE_PATH_AMOUNT][MAX_PROBE_ROUNDS]; ///< RTT samples[ns] of every path
+    struct doca_ar_probe_owd owd;               ///< one-way delays of the replies stamped by a reflector
+    uint32_t lastTsc[PROBE_PATH_AMOUNT];        ///< TSC RTT[ns] of the latest reply of every path, for the noise floor
+    uint32_t lastHw[PROBE_PATH_AMOUNT];         ///< NIC RTT[ns] of the latest reply of every path, 0 if it had no rx timestamp
+    uint16_t nb_parked;                         ///< amount of packets in parked
+    struct rte_mbuf *parked[MAX_PARKED_PKTS];   ///< packets of this conn received before the best path is known
+} __rte_cache_aligned;
+
+/**
+ * @brief noise floor of both clocks, from back-to-back replies on the same path of one probe
+ *
+ * Such replies cross the fabric within microseconds, so the difference between their RTT is mostly measurement noise.
+ */
+struct doca_ar_probe_noise
+{
+    uint64_t tscPairs; ///< pairs of back-to-back replies compared
+    uint64_t tscDiff;  ///< sum of the RTT differences of the pairs[ns]
+    uint32_t tscMin;   ///< minimum RTT[ns]
+    uint64_t hwPairs;  ///< pairs of back-to-back replies both with an rx timestamp
+    uint64_t hwDiff;
+    uint32_t hwMin;
+};
+
+/**
+ * @brief init probe context mempool, and pending-probe table, release ring and reply ring of every worker
+ *
+ * @param maxPending maximum pending probes of one worker
+ * @param nbWorkers
+ * @return int
+ */
+int doca_ar_probe_init_env(int maxPending, int nbWorkers);
+/**
+ * @brief build a probe packet from the outer headers of a vxlan packet
+ *
+ * @param mbuf empty mbuf to hold the probe packet
+ * @param hdr outer ether header, followed by ipv4 or ipv6 and udp headers
+ * @param sport src port (big endian) of the probed path
+ * @param flowID
+ */
+void doca_ar_probe_fill(struct rte_mbuf *mbuf, const struct rte_ether_hdr *hdr, uint16_t sport, uint64_t flowID);
+/**
+ * @brief prebuild the probe packet of a destination with doca_ar_probe_fill
+ *
+ * @param tmpl
+ * @param hdr outer ether header of a vxlan packet towards the destination, followed by ipv4 or ipv6 and udp headers
+ * @return int
+ */
+int doca_ar_probe_tmpl_init(struct doca_ar_probe_tmpl *tmpl, const struct rte_ether_hdr *hdr);
+/**
+ * @brief build a probe packet from a template: one copy, then patch the src port, FlowID and timestamp
+ *
+ * The udp cksum left in the template does not cover the src port, ipv4 sends it as 0 and ipv6 only carries the pseudo header cksum for the offload.
+ *
+ * @param mbuf empty mbuf of PROBE_MBUF_POOL
+ * @param tmpl
+ * @param sport src port (big endian) of the probed path
+ * @param flowID
+ */
+static inline void doca_ar_probe_build(struct rte_mbuf *mbuf, const struct doca_ar_probe_tmpl *tmpl, uint16_t sport, uint64_t flowID)
+{
+    uint8_t *pkt = rte_pktmbuf_mtod(mbuf, uint8_t *);
+    rte_memcpy(pkt, tmpl->bytes, tmpl->len);
+    mbuf->data_len = tmpl->len;
+    mbuf->pkt_len = tmpl->len;
+    mbuf->l2_len = sizeof(struct rte_ether_hdr);
+    mbuf->l3_len = tmpl->l3_len;
+    mbuf->ol_flags = tmpl->ol_flags;
+    struct rte_udp_hdr *udp_h = (struct rte_udp_hdr *)(pkt + mbuf->l2_len + mbuf->l3_len);
+    struct PROBE_HDR *pay = doca_ar_probe_payload(udp_h);
+    udp_h->src_port = sport;
+    pay->timeStamp = rte_rdtsc();
+    pay->FlowID = flowID;
+}
+/**
+ * @brief stamp probe packets right before they are sent, with the tsc and the NIC clock if hardware timestamps are on
+ *
+ * @param pkts probe packets built by doca_ar_probe_build
+ * @param nb
+ */
+void doca_ar_probe_stamp_tx(struct rte_mbuf **pkts, uint16_t nb);
+/**
+ * @brief turn the send times of a received probe reply into its RTT by both clocks, and the times stamped by a reflector
+ * into the one-way delays, should be called as soon as it is received
+ *
+ * @param m
+ * @param hdr
+ */
+void doca_ar_probe_stamp_rx(const struct rte_mbuf *m, struct PROBE_HDR *hdr);
+/**
+ * @brief RTT of a reply stamped by doca_ar_probe_stamp_rx, by the NIC clock if it has one
+ *
+ * @param hdr
+ * @return uint32_t RTT[ns]
+ */
+static inline uint32_t doca_ar_probe_reply_rtt(const struct PROBE_HDR *hdr)
+{
+    return RTE_MIN(hdr->nicTime ? hdr->nicTime : hdr->timeStamp, (uint64_t)UINT32_MAX - 1);
+}
+/**
+ * @brief delay of the path of a reply stamped by doca_ar_probe_stamp_rx, compared between the paths of one probe
+ *
+ * With --probe-metric forward or fwdvar and a stamping reflector, it is the RTT of the first stamped reply of the probe plus how much longer
+ * the forward delay of this reply is, i.e. differences of the reverse paths are left out. Otherwise it is the RTT.
+ * The one-way delays of the reply are folded into owd either way.
+ *
+ * @param hdr
+ * @param owd one-way delays of the probe, reset by doca_ar_probe_owd_reset when the probe is sent
+ * @param p index of the path of the reply
+ * @return uint32_t [ns]
+ */
+uint32_t doca_ar_probe_sample(const struct PROBE_HDR *hdr, struct doca_ar_probe_owd *owd, int p);
+/**
+ * @brief set hardware timestamps up if --probe-timestamp hw asks for them, TSC is kept if the port cannot timestamp
+ *
+ */
+void doca_ar_probe_ts_init();
+/**
+ * @brief turn a probe received by a reflector into its reply in place: swap the macs, dst port PROBE_REPLY_PORT,
+ * and the receive time if --reflector-stamp
+ *
+ * @param m
+ * @return int 0 if m is a probe and is ready to be sent back out of to_net_port
+ */
+int doca_ar_probe_reflect(struct rte_mbuf *m);
+/**
+ * @brief stamp the send time of probes reflected by doca_ar_probe_reflect right before they are sent, if --reflector-stamp
+ *
+ * @param pkts
+ * @param nb
+ */
+void doca_ar_probe_stamp_reflect(struct rte_mbuf **pkts, uint16_t nb);
+/**
+ * @brief limit the hops of a probe packet built by doca_ar_probe_fill, the router where it expires answers with time exceeded
+ *
+ * @param mbuf
+ * @param ttl
+ * @param tag carried in the ipv4 packet id quoted back in the time exceeded message, ipv6 has no such field but ICMPv6 quotes the FlowID too
+ */
+void doca_ar_probe_set_ttl(struct rte_mbuf *mbuf, uint8_t ttl, uint16_t tag);
+/**
+ * @brief check whether a packet is a probe packet sent back by the receiver DPU
+ *
+ * @param m
+ * @param sport src port (big endian) of the probed path
+ * @return struct PROBE_HDR* NULL if it is not a probe packet
+ */
+struct PROBE_HDR *doca_ar_probe_parse_reply(struct rte_mbuf *m, uint16_t *sport);
+/**
+ * @brief build probe packets for a new conn from the cached template of its destination and park it in the pending-probe table of the worker owning it
+ *
+ * The probe packets are held back until doca_ar_probe_flush, so that the probes of all the new conns of a burst go out together.
+ *
+ * @param conn the new conn, its bestPath stays the original sport until the probe is resolved
+ * @param m first packet of this new conn, parked on success
+ * @return int 0 if the conn is parked, otherwise the packet should be forwarded on the current path
+ */
+int doca_ar_probe_start(struct doca_ar_conn *conn, struct rte_mbuf *m);
+/**
+ * @brief send the probe packets held back by a worker in one tx_burst, should be called once per burst of the worker
+ *
+ * @param queue worker queue
+ */
+void doca_ar_probe_flush(uint16_t queue);
+/**
+ * @brief hold a packet of a probing conn back until its best path is known
+ *
+ * @param conn
+ * @param m
+ * @return int 0 if the packet is parked, -1 if the park queue is full and the packet should be dropped to keep the conn in order
+ */
+int doca_ar_probe_park(struct doca_ar_conn *conn, struct rte_mbuf *m);
+/**
+ * @brief match a packet received from the network against pending probes, the packet is consumed
+ *
+ * The RTT is taken right here, a reply of another worker is handed over through the reply ring of its owner with its RTT in the timestamp.
+ *
+ * @param queue worker queue handling the packet
+ * @param m
+ * @return int 1 if it is a probe packet sent back by the receiver DPU
+ */
+int doca_ar_probe_handle_reply(uint16_t queue, struct rte_mbuf *m);
+/**
+ * @brief receive probe replies on probe_queue if no other worker is at it, handle replies handed over by other workers
+ * and run expired probe timers, should be called in the polling loop of the worker
+ *
+ * @param queue worker queue
+ * @return uint16_t amount of packets received on probe_queue
+ */
+uint16_t doca_ar_probe_poll(uint16_t queue);
+/**
+ * @brief get parked packets whose conn has been resolved, they are already modified onto the best path
+ *
+ * @param queue worker queue
+ * @param pkts
+ * @param max
+ * @return uint16_t amount of released packets
+ */
+uint16_t doca_ar_probe_drain(uint16_t queue, struct rte_mbuf **pkts, uint16_t max);
+/**
+ * @brief get the noise floor measured by a worker
+ *
+ * @param queue worker queue
+ * @return const struct doca_ar_probe_noise*
+ */
+const struct doca_ar_probe_noise *doca_ar_probe_noise(uint16_t queue);
+/**
+ * @brief conns waiting for their probe replies on all the workers
+ *
+ * @return uint32_t
+ */
+uint32_t doca_ar_probe_pending();
+
+#endif /* DOCA_AR_PROBE_H_ */
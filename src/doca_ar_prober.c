@@ -0,0 +1,518 @@
+/**
+ * @file doca_ar_prober.c
+ * @author Mark Chen (markchen77888@gmail.com)
+ * @brief background prober running on its own lcore: periodically probes every active destination VTEP and publishes the path table
+ * @version 1.0
+ * @date 2024-01-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "doca_ar_prober.h"
+#include "doca_ar_probe.h"
+#include "doca_ar_path.h"
+#include "doca_ar_stats.h"
+#include <rte_hash.h>
+#include <rte_hash_crc.h>
+#include <rte_mempool.h>
+#include <rte_malloc.h>
+#include <rte_memcpy.h>
+#include <rte_ring.h>
+#include <rte_ethdev.h>
+#include <rte_icmp.h>
+DOCA_LOG_REGISTER(DOCA_AR_PROBER);
+
+#define PROBER_BURST 64                                                                                      ///< num of rx_burst on the probe queue
+#define PROBE_TEMPLATE_LEN (sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv6_hdr) + sizeof(struct rte_udp_hdr)) ///< outer headers copied from the first packet, long enough for an ipv6 underlay
+#define PROBER_DST_BITS 16                                                                                   ///< low bits of the FlowID carry the destination index
+#define PROBER_DISCOVERY_FLOWID (1ULL << 63)                                                                 ///< FlowID of discovery probes, the low 16 bits carry their tag
+#define DISCOVERY_TAG(round, hop) ((uint16_t)(((round) & 0xfff) << 4 | (hop)))                                ///< tag of a discovery probe: its round and ttl
+
+/**
+ * @brief a destination announced by the worker
+ *
+ */
+struct doca_ar_prober_msg
+{
+    struct doca_ar_path_key key;
+    uint16_t sport;                  ///< outer src port of the first packet, the first probed path
+    uint8_t hdr[PROBE_TEMPLATE_LEN]; ///< outer headers of the first packet towards the destination
+};
+
+/**
+ * @brief probing state of one destination, only touched by the prober lcore
+ *
+ */
+struct doca_ar_prober_dst
+{
+    struct doca_ar_path_key key;
+    struct doca_ar_probe_tmpl tmpl;    ///< probe packet built from the outer headers of the first packet
+    uint32_t round;                    ///< round number of the latest probe, carried in the FlowID
+    uint64_t sent;                     ///< tsc of the latest probe
+    uint16_t nb_replies;               ///< replies of the latest round
+    bool published;                    ///< the latest round has been written into the path table
+    uint16_t ports[PROBE_PATH_AMOUNT]; ///< src port of every probed path
+    uint32_t rtt[PROBE_PATH_AMOUNT];   ///< RTT[ns] of the latest round, UINT32_MAX if not back yet
+    struct doca_ar_probe_owd owd;      ///< one-way delays of the latest round
+    uint8_t nb_ports;                  ///< probed paths, fewer than PROBE_PATH_AMOUNT if path discovery found fewer distinct ones
+    uint8_t nb_next;                   ///< representatives found by the latest discovery, switched to by the next probe round
+    uint16_t next[PROBE_PATH_AMOUNT];  ///< src port of every distinct path found by the latest discovery
+    uint16_t discRound;                ///< round number of the latest discovery, carried in the tag of its probes
+    bool discDone;                     ///< the latest discovery has been grouped into representatives
+    uint64_t discSent;                 ///< tsc of the latest discovery
+    uint16_t cand[DISCOVERY_CANDIDATES];    ///< src ports traced by discovery, the first one is the port of the announcing conn
+    uint32_t candSig[DISCOVERY_CANDIDATES]; ///< hash of the routers which answered on the traced hops, equal on the same path
+    uint8_t candHops[DISCOVERY_CANDIDATES]; ///< bitmap of the traced hops which answered
+};
+
+extern volatile bool force_quit;
+struct rte_ring *PROBER_MSG = NULL;           ///< destinations announced by the worker
+struct rte_mempool *PROBER_MSG_POOL = NULL;   ///< mempool of struct doca_ar_prober_msg
+static struct rte_hash *PROBER_DST_TABLE;     ///< VTEP pair ==> index of proberDst
+static struct doca_ar_prober_dst *proberDst;  ///< destinations being probed, indexed by the key position
+static struct rte_mempool *proberPool;        ///< probe packets mempool
+
+int doca_ar_prober_init_env()
+{
+    PROBER_MSG_POOL = rte_mempool_create("PROBER_MSG_POOL", PROBER_MSG_RING * 2 - 1,
+                                         sizeof(struct doca_ar_prober_msg), 0, 0,
+                                         NULL, NULL, NULL, NULL,
+                                         rte_socket_id(), 0);
+    PROBER_MSG = rte_ring_create("PROBER_MSG", PROBER_MSG_RING, rte_socket_id(), RING_F_SC_DEQ);
+    if (PROBER_MSG_POOL == NULL || PROBER_MSG == NULL)
+    {
+        DOCA_LOG_ERR("Create PROBER_MSG fail");
+        return -1;
+    }
+
+    const struct rte_hash_parameters ProberDstTable =
+        {
+            .name = "PROBER_DST_TABLE",
+            .entries = PROBER_MAX_DST,
+            .reserved = 0,
+            .key_len = sizeof(struct doca_ar_path_key),
+            .hash_func = rte_hash_crc,
+            .hash_func_init_val = 0,
+            .socket_id = rte_socket_id(),
+            .extra_flag = 0,
+        };
+    PROBER_DST_TABLE = rte_hash_create(&ProberDstTable);
+    proberDst = rte_zmalloc("PROBER_DST", PROBER_MAX_DST * sizeof(struct doca_ar_prober_dst), RTE_CACHE_LINE_SIZE);
+    if (PROBER_DST_TABLE == NULL || proberDst == NULL)
+    {
+        DOCA_LOG_ERR("Create ProberDstTable fail!");
+        return -1;
+    }
+    DOCA_LOG_INFO("Init prober success, probe every %u ms on queue %d", ar_config.proberIntervalMs, probe_queue);
+    return 0;
+}
+
+void doca_ar_prober_announce(struct doca_ar_conn *conn, struct rte_mbuf *m)
+{
+    struct doca_ar_path_key key = {.sip = conn->match.sip, .dip = conn->match.dip, .ipv6 = conn->match.ipv6};
+    struct doca_ar_prober_msg *msg;
+    uint64_t now = rte_rdtsc();
+
+    // refresh lastUsed at most every PROBER_IDLE_MS/2, lastUsed is reset to 0 when the prober drops the destination
+    struct doca_ar_path_entry *entry = doca_ar_path_lookup(&key);
+    if (entry != NULL && entry->lastUsed != 0 && now - entry->lastUsed < (uint64_t)PROBER_IDLE_MS / 2 * rte_get_tsc_hz() / 1000)
+        return;
+    if (entry != NULL)
+        entry->lastUsed = now;
+    if (rte_mempool_get(PROBER_MSG_POOL, (void **)&msg) != 0)
+        return;
+    msg->key = key;
+    msg->sport = conn->match.sport;
+    rte_memcpy(msg->hdr, rte_pktmbuf_mtod(m, void *), PROBE_TEMPLATE_LEN);
+    if (rte_ring_enqueue(PROBER_MSG, msg) != 0)
+        rte_mempool_put(PROBER_MSG_POOL, msg);
+}
+
+void doca_ar_prober_keepalive(struct doca_ar_conn *conn)
+{
+    struct doca_ar_path_key key = {.sip = conn->match.sip, .dip = conn->match.dip, .ipv6 = conn->match.ipv6};
+    uint64_t now = rte_rdtsc();
+
+    // the prober owns the probe template, a destination it dropped already can only come back with a new conn
+    struct doca_ar_path_entry *entry = doca_ar_path_lookup(&key);
+    if (entry != NULL && entry->lastUsed != 0 && now - entry->lastUsed >= (uint64_t)PROBER_IDLE_MS / 2 * rte_get_tsc_hz() / 1000)
+        entry->lastUsed = now;
+}
+
+/**
+ * @brief add announced destinations into the probing list
+ *
+ */
+static void doca_ar_prober_recv_msg()
+{
+    struct doca_ar_prober_msg *msgs[PROBER_BURST];
+    unsigned int nb = rte_ring_dequeue_burst(PROBER_MSG, (void **)msgs, PROBER_BURST, NULL);
+    for (unsigned int i = 0; i < nb; i++)
+    {
+        if (rte_hash_lookup(PROBER_DST_TABLE, &msgs[i]->key) < 0)
+        {
+            int pos = rte_hash_add_key(PROBER_DST_TABLE, &msgs[i]->key);
+            if (pos >= 0 && pos < PROBER_MAX_DST)
+            {
+                struct doca_ar_prober_dst *dst = &proberDst[pos];
+                memset(dst, 0, sizeof(struct doca_ar_prober_dst));
+                dst->key = msgs[i]->key;
+                dst->published = true;
+                dst->discDone = true;
+                if (doca_ar_probe_tmpl_init(&dst->tmpl, (const struct rte_ether_hdr *)msgs[i]->hdr) != 0)
+                {
+                    DOCA_LOG_ERR("Build probe template fail");
+                    rte_hash_del_key(PROBER_DST_TABLE, &msgs[i]->key);
+                    rte_mempool_put(PROBER_MSG_POOL, msgs[i]);
+                    continue;
+                }
+                // consecutive ports until path discovery learns which ports lead onto distinct paths
+                dst->nb_ports = PROBE_PATH_AMOUNT;
+                for (int p = 0; p < PROBE_PATH_AMOUNT; p++)
+                    dst->ports[p] = rte_cpu_to_be_16(rte_be_to_cpu_16(msgs[i]->sport) + p);
+                dst->cand[0] = msgs[i]->sport;
+                for (int c = 1; c < DISCOVERY_CANDIDATES; c++)
+                    dst->cand[c] = rte_cpu_to_be_16(49152 + ((rte_be_to_cpu_16(msgs[i]->sport) + c * DISCOVERY_PORT_STRIDE) & 0x3fff));
+                // publish an empty entry right now so that the worker sees the destination as known
+                doca_ar_path_update(&dst->key, dst->ports, dst->rtt, 0, NULL);
+                struct doca_ar_path_entry *entry = doca_ar_path_lookup(&dst->key);
+                if (entry != NULL)
+                    entry->lastUsed = rte_rdtsc();
+            }
+            else
+                DOCA_LOG_ERR("Too many destinations to probe");
+        }
+        rte_mempool_put(PROBER_MSG_POOL, msgs[i]);
+    }
+}
+
+/**
+ * @brief write the latest round of a destination into the path table
+ *
+ * @param dst
+ */
+static void doca_ar_prober_publish(struct doca_ar_prober_dst *dst)
+{
+    if (dst->nb_replies < dst->nb_ports)
+        doca_ar_stats()->probeTimeout++;
+    doca_ar_path_update(&dst->key, dst->ports, dst->rtt, dst->nb_ports, &dst->owd.path);
+    dst->published = true;
+}
+
+/**
+ * @brief start a new probe round towards a destination
+ *
+ * @param pos index of the destination
+ * @param now
+ */
+static void doca_ar_prober_send(int pos, uint64_t now)
+{
+    struct doca_ar_prober_dst *dst = &proberDst[pos];
+    struct rte_mbuf *mbufs[PROBE_PATH_AMOUNT];
+
+    if (rte_pktmbuf_alloc_bulk(proberPool, mbufs, PROBE_PATH_AMOUNT) != 0)
+        return;
+    if (!dst->published)
+        doca_ar_prober_publish(dst); // the interval is shorter than PROBE_TIMEOUT
+    if (dst->nb_next)
+    {
+        // switch to the discovered representatives between two rounds
+        rte_memcpy(dst->ports, dst->next, sizeof(dst->ports));
+        dst->nb_ports = dst->nb_next;
+        dst->nb_next = 0;
+    }
+    dst->round++;
+    dst->sent = now;
+    dst->nb_replies = 0;
+    doca_ar_probe_owd_reset(&dst->owd);
+    dst->published = false;
+    uint64_t flowID = ((uint64_t)dst->round << PROBER_DST_BITS) | pos;
+    for (int p = 0; p < PROBE_PATH_AMOUNT; p++)
+    {
+        dst->rtt[p] = UINT32_MAX;
+        if (p < dst->nb_ports)
+            doca_ar_probe_build(mbufs[p], &dst->tmpl, dst->ports[p], flowID);
+        else
+            rte_pktmbuf_free(mbufs[p]);
+    }
+    doca_ar_probe_stamp_tx(mbufs, dst->nb_ports);
+    int nb_tx = rte_eth_tx_burst(to_net_port, probe_queue, mbufs, dst->nb_ports);
+    struct doca_ar_stats *stats = doca_ar_stats();
+    stats->tx[to_net_port] += nb_tx;
+    stats->probeSent += nb_tx;
+    if (unlikely(nb_tx < dst->nb_ports))
+    {
+        stats->drop[to_net_port] += dst->nb_ports - nb_tx;
+        do
+        {
+            rte_pktmbuf_free(mbufs[nb_tx]);
+        } while (++nb_tx < dst->nb_ports);
+    }
+}
+
+/**
+ * @brief trace every candidate port of a destination with ttl-limited probes, the routers on the traced hops answer with time exceeded
+ *
+ * @param pos index of the destination
+ * @param now
+ */
+static void doca_ar_prober_discover(int pos, uint64_t now)
+{
+    struct doca_ar_prober_dst *dst = &proberDst[pos];
+    struct rte_mbuf *mbufs[DISCOVERY_CANDIDATES];
+
+    dst->discRound++;
+    dst->discSent = now;
+    dst->discDone = false;
+    memset(dst->candSig, 0, sizeof(dst->candSig));
+    memset(dst->candHops, 0, sizeof(dst->candHops));
+    for (uint32_t hop = 1; hop <= ar_config.discoveryHops; hop++)
+    {
+        uint16_t tag = DISCOVERY_TAG(dst->discRound, hop);
+        if (rte_pktmbuf_alloc_bulk(proberPool, mbufs, DISCOVERY_CANDIDATES) != 0)
+            return;
+        for (int c = 0; c < DISCOVERY_CANDIDATES; c++)
+        {
+            doca_ar_probe_build(mbufs[c], &dst->tmpl, dst->cand[c], PROBER_DISCOVERY_FLOWID | tag);
+            doca_ar_probe_set_ttl(mbufs[c], hop, tag);
+        }
+        int nb_tx = rte_eth_tx_burst(to_net_port, probe_queue, mbufs, DISCOVERY_CANDIDATES);
+        struct doca_ar_stats *stats = doca_ar_stats();
+        stats->tx[to_net_port] += nb_tx;
+        stats->probeSent += nb_tx;
+        stats->drop[to_net_port] += DISCOVERY_CANDIDATES - nb_tx;
+        while (nb_tx < DISCOVERY_CANDIDATES)
+            rte_pktmbuf_free(mbufs[nb_tx++]);
+    }
+}
+
+/**
+ * @brief group the traced candidates of a destination by the routers they crossed, one representative port per distinct path
+ *
+ * @param dst
+ */
+static void doca_ar_prober_discovered(struct doca_ar_prober_dst *dst)
+{
+    uint8_t complete = (1u << ar_config.discoveryHops) - 1;
+    uint32_t sigs[PROBE_PATH_AMOUNT];
+    uint16_t ports[PROBE_PATH_AMOUNT];
+    int nb = 0;
+
+    dst->discDone = true;
+    for (int c = 0; c < DISCOVERY_CANDIDATES && nb < PROBE_PATH_AMOUNT; c++)
+    {
+        int s = 0;
+        if (dst->candHops[c] != complete)
+            continue; // a router did not answer, e.g. it rate-limits icmp
+        while (s < nb && sigs[s] != dst->candSig[c])
+            s++;
+        if (s < nb)
+            continue; // same routers as an earlier candidate
+        sigs[nb] = dst->candSig[c];
+        ports[nb++] = dst->cand[c];
+    }
+    if (nb == 0)
+    {
+        DOCA_LOG_WARN("No candidate of a destination was traced on all %u hops, keep probing its ports", ar_config.discoveryHops);
+        return;
+    }
+    rte_memcpy(dst->next, ports, nb * sizeof(uint16_t));
+    dst->nb_next = nb;
+}
+
+/**
+ * @brief record a time exceeded message answering a discovery probe
+ *
+ * The quoted probe gives the destination and the candidate port, the tag gives the round and the hop, the sender is the router on that hop.
+ *
+ * @param m
+ * @return int 1 if the packet answers a discovery probe, 0 if it is some other icmp for host
+ */
+static int doca_ar_prober_handle_icmp(struct rte_mbuf *m)
+{
+    struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+    uint32_t len = rte_pktmbuf_data_len(m);
+    struct doca_ar_path_key key = {0};
+    const struct rte_udp_hdr *udp;
+    const uint8_t *router;
+    uint32_t routerLen;
+    uint16_t tag;
+
+    if (eth->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4))
+    {
+        const struct rte_ipv4_hdr *ip = (const struct rte_ipv4_hdr *)(eth + 1);
+        uint32_t ihl = (ip->version_ihl & 0xf) * 4;
+        const struct rte_icmp_hdr *icmp = (const struct rte_icmp_hdr *)((const uint8_t *)ip + ihl);
+        const struct rte_ipv4_hdr *orig = (const struct rte_ipv4_hdr *)(icmp + 1);
+        // routers quote at least the ip header and 8 bytes of the probe, i.e. its udp header
+        if (ip->next_proto_id != IPPROTO_ICMP || len < sizeof(*eth) + ihl + sizeof(*icmp) + sizeof(*orig) + sizeof(*udp) ||
+            icmp->icmp_type != 11 || icmp->icmp_code != 0 || orig->next_proto_id != IPPROTO_UDP ||
+            len < sizeof(*eth) + ihl + sizeof(*icmp) + (orig->version_ihl & 0xf) * 4 + sizeof(*udp))
+            return 0;
+        udp = (const struct rte_udp_hdr *)((const uint8_t *)orig + (orig->version_ihl & 0xf) * 4);
+        key.sip = orig->src_addr;
+        key.dip = orig->dst_addr;
+        tag = rte_be_to_cpu_16(orig->packet_id);
+        router = (const uint8_t *)&ip->src_addr;
+        routerLen = sizeof(ip->src_addr);
+    }
+    else if (eth->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV6))
+    {
+        const struct rte_ipv6_hdr *ip6 = (const struct rte_ipv6_hdr *)(eth + 1);
+        const struct rte_icmp_hdr *icmp = (const struct rte_icmp_hdr *)(ip6 + 1);
+        const struct rte_ipv6_hdr *orig = (const struct rte_ipv6_hdr *)(icmp + 1);
+        const struct PROBE_HDR *pay = doca_ar_probe_payload((const struct rte_udp_hdr *)(orig + 1));
+        // ICMPv6 quotes as much as fits into the minimum mtu, the FlowID carries the tag
+        if (ip6->proto != IPPROTO_ICMPV6 || len < (uint32_t)((const uint8_t *)(pay + 1) - (const uint8_t *)eth) ||
+            icmp->icmp_type != 3 || icmp->icmp_code != 0 || orig->proto != IPPROTO_UDP || !(pay->FlowID & PROBER_DISCOVERY_FLOWID))
+            return 0;
+        int sip = doca_ar_addr6_id(orig->src_addr), dip = doca_ar_addr6_id(orig->dst_addr);
+        if (sip < 0 || dip < 0)
+            return 0;
+        udp = (const struct rte_udp_hdr *)(orig + 1);
+        key.sip = sip;
+        key.dip = dip;
+        key.ipv6 = 1;
+        tag = (uint16_t)pay->FlowID;
+        router = ip6->src_addr;
+        routerLen = sizeof(ip6->src_addr);
+    }
+    else
+        return 0;
+    if (udp->dst_port != rte_cpu_to_be_16(4789))
+        return 0;
+    int pos = rte_hash_lookup(PROBER_DST_TABLE, &key);
+    if (pos < 0 || pos >= PROBER_MAX_DST)
+        return 0;
+
+    struct doca_ar_prober_dst *dst = &proberDst[pos];
+    uint32_t hop = tag & 0xf;
+    if (tag != DISCOVERY_TAG(dst->discRound, hop) || dst->discDone || hop == 0 || hop > ar_config.discoveryHops)
+        return 1; // an older round
+    for (int c = 0; c < DISCOVERY_CANDIDATES; c++)
+    {
+        if (dst->cand[c] == udp->src_port && !(dst->candHops[c] & (1 << (hop - 1))))
+        {
+            dst->candHops[c] |= 1 << (hop - 1);
+            dst->candSig[c] ^= rte_hash_crc(router, routerLen, hop);
+            break;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief match a probe reply against the latest round of its destination
+ *
+ * @param m
+ * @return int 1 if it is a probe reply
+ */
+static int doca_ar_prober_handle_reply(struct rte_mbuf *m)
+{
+    uint16_t sport;
+    struct PROBE_HDR *hdr = doca_ar_probe_parse_reply(m, &sport);
+    if (hdr == NULL)
+        return 0;
+    doca_ar_stats()->probeRcvd++;
+    if (hdr->FlowID & PROBER_DISCOVERY_FLOWID)
+        return 1; // a discovery probe with a ttl long enough to reach the receiver
+    uint32_t pos = hdr->FlowID & ((1 << PROBER_DST_BITS) - 1);
+    if (pos >= PROBER_MAX_DST)
+        return 1;
+    struct doca_ar_prober_dst *dst = &proberDst[pos];
+    if ((hdr->FlowID >> PROBER_DST_BITS) != dst->round || dst->published)
+        return 1; // reply of an older round
+    for (int p = 0; p < dst->nb_ports; p++)
+    {
+        if (dst->ports[p] == sport && dst->rtt[p] == UINT32_MAX)
+        {
+            doca_ar_probe_stamp_rx(m, hdr);
+            dst->rtt[p] = doca_ar_probe_sample(hdr, &dst->owd, p);
+            doca_ar_hist_record(HIST_PROBE_RTT + p, doca_ar_probe_reply_rtt(hdr));
+            if (++dst->nb_replies == dst->nb_ports)
+                doca_ar_prober_publish(dst);
+            break;
+        }
+    }
+    return 1;
+}
+
+int doca_ar_prober(void *args)
+{
+    struct rte_mbuf *packets[PROBER_BURST], *toHost[PROBER_BURST];
+    uint64_t hz = rte_get_tsc_hz();
+    uint64_t interval = (uint64_t)ar_config.proberIntervalMs * hz / 1000, timeout = (uint64_t)PROBE_TIMEOUT * hz / 1000;
+    uint64_t idle = (uint64_t)PROBER_IDLE_MS * hz / 1000;
+    uint64_t discInterval = (uint64_t)DISCOVERY_INTERVAL_MS * hz / 1000, discTimeout = (uint64_t)DISCOVERY_TIMEOUT_MS * hz / 1000;
+
+    proberPool = rte_mempool_lookup("PROBE_MBUF_POOL");
+    if (proberPool == NULL)
+    {
+        DOCA_LOG_ERR("Cannot find packet mempool ERR");
+        return 0;
+    }
+    DOCA_LOG_INFO("Start prober on core %d", rte_lcore_id());
+    while (!force_quit)
+    {
+        doca_ar_prober_recv_msg();
+
+        int nb_rx = rte_eth_rx_burst(to_net_port, probe_queue, packets, PROBER_BURST), nb_host = 0;
+        doca_ar_stats()->rx[to_net_port] += nb_rx;
+        for (int i = 0; i < nb_rx; i++)
+        {
+            // with path discovery all the icmp of the underlay comes here, what does not answer a discovery probe goes on to host
+            if (doca_ar_prober_handle_reply(packets[i]) || !ar_config.discoveryHops || doca_ar_prober_handle_icmp(packets[i]))
+                rte_pktmbuf_free(packets[i]);
+            else
+                toHost[nb_host++] = packets[i];
+        }
+        if (nb_host)
+        {
+            int nb_tx = rte_eth_tx_burst(to_host_port, probe_queue, toHost, nb_host);
+            doca_ar_stats()->tx[to_host_port] += nb_tx;
+            doca_ar_stats()->drop[to_host_port] += nb_host - nb_tx;
+            while (nb_tx < nb_host)
+                rte_pktmbuf_free(toHost[nb_tx++]);
+        }
+
+        struct doca_ar_path_key *key;
+        void *data;
+        uint32_t iter = 0, nb_idle = 0;
+        int idlePos[PROBER_BURST];
+        uint64_t now = rte_rdtsc();
+        int pos;
+        while ((pos = rte_hash_iterate(PROBER_DST_TABLE, (const void **)&key, &data, &iter)) >= 0)
+        {
+            struct doca_ar_prober_dst *dst = &proberDst[pos];
+            if (!dst->published && now - dst->sent > timeout)
+                doca_ar_prober_publish(dst); // paths not back in PROBE_TIMEOUT are published as lost
+            if (ar_config.discoveryHops && !dst->discDone && now - dst->discSent > discTimeout)
+                doca_ar_prober_discovered(dst);
+            if (ar_config.discoveryHops && now - dst->discSent > discInterval)
+                doca_ar_prober_discover(pos, now);
+            if (now - dst->sent < interval)
+                continue;
+            struct doca_ar_path_entry *entry = doca_ar_path_lookup(key);
+            if (entry == NULL || now - entry->lastUsed > idle)
+            {
+                if (nb_idle < PROBER_BURST)
+                    idlePos[nb_idle++] = pos;
+                continue;
+            }
+            doca_ar_prober_send(pos, now);
+        }
+        // keys are not deleted while iterating
+        for (uint32_t i = 0; i < nb_idle; i++)
+        {
+            struct doca_ar_prober_dst *dst = &proberDst[idlePos[i]];
+            struct doca_ar_path_entry *entry = doca_ar_path_lookup(&dst->key);
+            if (entry != NULL)
+                entry->lastUsed = 0;
+            rte_hash_del_key(PROBER_DST_TABLE, &dst->key);
+        }
+        doca_ar_stats_publish();
+    }
+    doca_ar_stats_publish();
+    DOCA_LOG_INFO("lcore %d quit from probing", rte_lcore_id());
+    return 0;
+}
@@ -0,0 +1,52 @@
+/**
+ * @file doca_ar_prober.h
+ * @author Mark Chen (markchen77888@gmail.com)
+ * @brief background prober running on its own lcore: periodically probes every active destination VTEP and publishes the path table
+ * @version 1.0
+ * @date 2024-01-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef DOCA_AR_PROBER_H_
+#define DOCA_AR_PROBER_H_
+#include "doca_ar_env.h"
+#include "doca_ar_conntrack.h"
+
+#define PROBER_MAX_DST 1024      ///< maximum destination VTEPs probed by the prober at the same time
+#define PROBER_IDLE_MS 10000     ///< a destination without new conns for this long is not probed any more[ms]
+#define PROBER_MSG_RING 1024     ///< size of the ring announcing destinations from the worker to the prober
+#define DISCOVERY_MAX_HOPS 8     ///< maximum hops traced by path discovery
+#define DISCOVERY_CANDIDATES 32  ///< src ports traced per destination, the distinct paths among them become the probed ports
+#define DISCOVERY_PORT_STRIDE 1021 ///< candidates are spread over the entropy port range 49152-65535 with this stride
+#define DISCOVERY_TIMEOUT_MS 200 ///< time exceeded messages of a discovery round are collected this long[ms]
+#define DISCOVERY_INTERVAL_MS 30000 ///< paths of a destination are discovered again this often, the fabric may rehash[ms]
+
+/**
+ * @brief init prober resources, should be called before the worker starts announcing destinations
+ *
+ * @return int
+ */
+int doca_ar_prober_init_env();
+/**
+ * @brief tell the prober that a new conn goes to its destination, called by the worker for every new conn
+ *
+ * @param conn
+ * @param m first packet of the conn, its outer headers are used to build probe packets
+ */
+void doca_ar_prober_announce(struct doca_ar_conn *conn, struct rte_mbuf *m);
+/**
+ * @brief keep the destination of a long-lived conn probed, called when an offloaded conn is re-evaluated for rerouting
+ *
+ * @param conn
+ */
+void doca_ar_prober_keepalive(struct doca_ar_conn *conn);
+/**
+ * @brief main loop of the prober lcore
+ *
+ * @param args
+ * @return int
+ */
+int doca_ar_prober(void *args);
+
+#endif /* DOCA_AR_PROBER_H_ */
@@ -0,0 +1,131 @@
+/**
+ * @file doca_ar_reroute.c
+ * @author Mark Chen (markchen77888@gmail.com)
+ * @brief live rerouting of offloaded conns: re-evaluate their path against the path table and move them in a flowlet gap
+ * @version 1.0
+ * @date 2024-01-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "doca_ar_reroute.h"
+#include "doca_ar_path.h"
+#include "doca_ar_stats.h"
+#include "doca_ar_pipe.h"
+#include "doca_ar_prober.h"
+DOCA_LOG_REGISTER(DOCA_AR_REROUTE);
+
+static struct doca_ar_reroute_stats rerouteStats[MAX_WORKERS] = {0}; ///< rerouting counters of every worker
+
+/**
+ * @brief entry counter queries of a worker in the current wheel tick
+ *
+ */
+struct reroute_budget
+{
+    uint64_t tick;    ///< wheel tick the queries are counted in
+    uint32_t queries; ///< queries issued in the tick
+} __rte_cache_aligned;
+static struct reroute_budget rerouteBudget[MAX_WORKERS] = {0}; ///< query budget of every worker
+
+/**
+ * @brief forget the pending reroute of a conn
+ *
+ * @param conn
+ * @return uint32_t the next check[ms]
+ */
+static uint32_t reroute_reset(struct doca_ar_conn *conn)
+{
+    conn->reroutePath = 0;
+    conn->rerouteTries = 0;
+    return ar_config.rerouteIntervalMs;
+}
+
+/**
+ * @brief query the entry counter of a conn within the per tick budget of its worker
+ *
+ * @param conn
+ * @param pkts
+ * @return int 0 on success, 1 if the budget is used up, -1 if the query failed
+ */
+static int reroute_query(struct doca_ar_conn *conn, uint64_t *pkts)
+{
+    struct reroute_budget *budget = &rerouteBudget[conn->queue];
+    uint64_t tick = doca_ar_wheel_tick();
+
+    if (budget->tick != tick)
+    {
+        budget->tick = tick;
+        budget->queries = 0;
+    }
+    if (budget->queries >= REROUTE_MAX_QUERIES)
+    {
+        rerouteStats[conn->queue].deferred++;
+        return 1;
+    }
+    budget->queries++;
+    return doca_ar_flow_query(conn, pkts) < 0 ? -1 : 0;
+}
+
+uint32_t doca_ar_reroute_check(struct doca_ar_conn *conn)
+{
+    struct doca_ar_reroute_stats *stats = &rerouteStats[conn->queue];
+    uint32_t gapMs = RTE_MAX((ar_config.flowletGapUs + 999) / 1000, 1000u / WHEEL_TICK_HZ);
+    // any faster path wins a flowlet, only PATH_MIN_GAIN_NS keeps measurement noise from moving the conn back and forth
+    uint32_t hysteresis = ar_config.lbScheme == FLOWLET ? 0 : ar_config.rerouteHysteresis;
+    uint64_t pkts;
+    int ret;
+
+    if (conn->reroutePath == 0)
+    {
+        stats->checks++;
+        if (ar_config.proberIntervalMs)
+            doca_ar_prober_keepalive(conn); // a long-lived conn keeps its destination probed
+        uint16_t better = doca_ar_path_better(conn, hysteresis);
+        if (better == 0)
+            return reroute_reset(conn);
+        ret = reroute_query(conn, &pkts);
+        if (ret > 0)
+            return gapMs;
+        if (ret < 0)
+            return reroute_reset(conn);
+        stats->pending++;
+        conn->reroutePath = better;
+        conn->rerouteHits = (uint32_t)pkts;
+        return gapMs;
+    }
+    ret = reroute_query(conn, &pkts);
+    if (ret > 0)
+        return gapMs;
+    if (ret < 0)
+        return reroute_reset(conn);
+    if ((uint32_t)pkts != conn->rerouteHits)
+    {
+        // still sending, packets in flight on the slower path would arrive after the ones sent on the new path
+        conn->rerouteHits = (uint32_t)pkts;
+        if (++conn->rerouteTries < REROUTE_MAX_TRIES)
+            return gapMs;
+        stats->noGap++;
+        return reroute_reset(conn);
+    }
+    stats->flowlets++;
+    uint16_t oldPath = conn->bestPath;
+    conn->bestPath = conn->reroutePath; // read by mod_entry
+    if (doca_ar_mod_flow(conn))
+    {
+        stats->rerouted++;
+        doca_ar_stats()->pathSwitch++;
+    }
+    else
+    {
+        // the conn is still forwarded on its old path, or falls back to software and is offloaded onto it again
+        conn->bestPath = oldPath;
+        stats->modFail++;
+    }
+    return reroute_reset(conn);
+}
+
+const struct doca_ar_reroute_stats *doca_ar_reroute_stats(uint16_t queue)
+{
+    return &rerouteStats[queue];
+}
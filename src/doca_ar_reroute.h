@@ -0,0 +1,57 @@
+/**
+ * @file doca_ar_reroute.h
+ * @author Mark Chen (markchen77888@gmail.com)
+ * @brief live rerouting of offloaded conns: re-evaluate their path against the path table and move them in a flowlet gap
+ * @version 1.0
+ * @date 2024-01-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef DOCA_AR_REROUTE_H_
+#define DOCA_AR_REROUTE_H_
+#include "doca_ar_env.h"
+#include "doca_ar_conntrack.h"
+
+#define REROUTE_MAX_TRIES 8            ///< flowlet gap samples of a busy conn before the pending reroute is given up until the next interval
+#define REROUTE_FLOWLET_INTERVAL_MS 100 ///< re-evaluation interval of --lb-scheme flowlet without --reroute-interval[ms]
+#define REROUTE_MAX_QUERIES 64          ///< entry counter queries of a worker per wheel tick, the conns beyond wait for their next sample
+
+/**
+ * @brief rerouting counters of a worker
+ *
+ */
+struct doca_ar_reroute_stats
+{
+    uint64_t checks;   ///< offloaded conns re-evaluated
+    uint64_t pending;  ///< conns found on a path clearly slower than another one
+    uint64_t rerouted; ///< conns moved onto the faster path
+    uint64_t noGap;    ///< pending reroutes given up because the conn never paused for a flowlet gap
+    uint64_t flowlets; ///< flowlet gaps seen, the next packet of the conn starts a new flowlet
+    uint64_t deferred; ///< samples postponed because the worker used up REROUTE_MAX_QUERIES in the tick
+    uint64_t modFail;  ///< reroutes the flow backend failed to apply, the conn kept its path
+} __rte_cache_aligned;
+
+/**
+ * @brief re-evaluate the path of an offloaded conn, called by the worker owning it when its lifetime timer expires
+ *
+ * A conn on a path slower than another one by more than --reroute-hysteresis becomes pending, the packet counter of its entry
+ * is then sampled every --flowlet-gap (at least one wheel tick). Once it did not move between two samples the conn has paused
+ * longer than the RTT difference of the paths, so moving it cannot reorder its packets, and mod_src_port of its entry is updated.
+ * With the FLOWLET scheme there is no hysteresis, so any faster path makes the conn pending and its next flowlet takes it.
+ * Only pending conns are sampled per flowlet gap, and a worker queries at most REROUTE_MAX_QUERIES entry counters per tick,
+ * so sampling never takes more than a bounded share of the aging budget away from expiry.
+ *
+ * @param conn
+ * @return uint32_t when the conn should be checked again[ms]
+ */
+uint32_t doca_ar_reroute_check(struct doca_ar_conn *conn);
+/**
+ * @brief rerouting counters of a worker
+ *
+ * @param queue
+ * @return const struct doca_ar_reroute_stats*
+ */
+const struct doca_ar_reroute_stats *doca_ar_reroute_stats(uint16_t queue);
+
+#endif /* DOCA_AR_REROUTE_H_ */
@@ -0,0 +1,156 @@
+/**
+ * @file doca_ar_stats.c
+ * @author Mark Chen (markchen77888@gmail.com)
+ * @brief per-lcore counters of the datapath, written without atomics by their own lcore and read as consistent snapshots
+ * @version 1.0
+ * @date 2024-01-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "doca_ar_stats.h"
+#include <string.h>
+#include <rte_atomic.h>
+#include <rte_malloc.h>
+DOCA_LOG_REGISTER(DOCA_AR_STATS);
+
+struct doca_ar_lcore_stats LCORE_STATS[STATS_SLOTS]; ///< counters of every lcore
+struct doca_ar_lcore_hist *LCORE_HIST[RTE_MAX_LCORE]; ///< histograms of every lcore, NULL for lcores not enabled
+static const char *const HIST_NAMES[HIST_MAX] = {
+    [HIST_PROBE_RTT] = "probe_rtt_slot0",
+    [HIST_PROBE_RTT + 1] = "probe_rtt_slot1",
+    [HIST_PROBE_RTT + 2] = "probe_rtt_slot2",
+    [HIST_PROBE_RTT + 3] = "probe_rtt_slot3",
+    [HIST_SETUP] = "flow_setup",
+    [HIST_OFFLOAD] = "flow_offload",
+    [HIST_AGING] = "aging_round",
+};
+
+int doca_ar_stats_init()
+{
+    unsigned int lcore;
+    RTE_BUILD_BUG_ON(PROBE_PATH_AMOUNT != 4); // one name per probe slot in HIST_NAMES
+    RTE_LCORE_FOREACH(lcore)
+    {
+        LCORE_HIST[lcore] = rte_zmalloc_socket(NULL, sizeof(struct doca_ar_lcore_hist), RTE_CACHE_LINE_SIZE, rte_lcore_to_socket_id(lcore));
+        if (LCORE_HIST[lcore] == NULL)
+        {
+            DOCA_LOG_ERR("Alloc histograms of lcore %u fail", lcore);
+            return -1;
+        }
+    }
+    DOCA_LOG_INFO("Create %d histograms x %u lcores success", HIST_MAX, rte_lcore_count());
+    return 0;
+}
+
+void doca_ar_stats_publish()
+{
+    unsigned int lcore = rte_lcore_id();
+    if (lcore >= RTE_MAX_LCORE)
+        return; // the shared block has no single writer, it is read from cur
+    struct doca_ar_lcore_stats *ls = &LCORE_STATS[lcore];
+    ls->seq++;
+    rte_smp_wmb();
+    ls->pub = ls->cur;
+    rte_smp_wmb();
+    ls->seq++;
+}
+
+int doca_ar_stats_snapshot(unsigned int slot, struct doca_ar_stats *s)
+{
+    struct doca_ar_lcore_stats *ls = &LCORE_STATS[slot];
+    static const struct doca_ar_stats zero;
+    uint32_t seq;
+
+    if (slot == rte_lcore_id())
+        doca_ar_stats_publish();
+    if (slot >= RTE_MAX_LCORE)
+        *s = ls->cur;
+    else
+    {
+        // the writer only holds seq odd for one copy, retrying is cheaper than making it wait
+        do
+        {
+            seq = ls->seq;
+            rte_smp_rmb();
+            *s = ls->pub;
+            rte_smp_rmb();
+        } while ((seq & 1) || seq != ls->seq);
+    }
+    return memcmp(s, &zero, sizeof(zero)) != 0;
+}
+
+void doca_ar_stats_total(struct doca_ar_stats *total)
+{
+    struct doca_ar_stats s;
+    memset(total, 0, sizeof(*total));
+    for (unsigned int slot = 0; slot < STATS_SLOTS; slot++)
+    {
+        if (!doca_ar_stats_snapshot(slot, &s))
+            continue;
+        for (int i = 0; i < NB_PORTS; i++)
+        {
+            total->rx[i] += s.rx[i];
+            total->tx[i] += s.tx[i];
+            total->drop[i] += s.drop[i];
+        }
+        total->newConns += s.newConns;
+        total->connFails += s.connFails;
+        total->probeSent += s.probeSent;
+        total->probeRcvd += s.probeRcvd;
+        total->probeTimeout += s.probeTimeout;
+        total->pathSwitch += s.pathSwitch;
+        total->offloadOk += s.offloadOk;
+        total->offloadFail += s.offloadFail;
+        total->aged += s.aged;
+    }
+}
+
+uint64_t doca_ar_hist_snapshot(enum DOCA_AR_HIST id, struct doca_ar_hist *h)
+{
+    uint64_t count = 0;
+    memset(h, 0, sizeof(*h));
+    for (unsigned int lcore = 0; lcore < RTE_MAX_LCORE; lcore++)
+    {
+        const struct doca_ar_hist *l = LCORE_HIST[lcore] ? &LCORE_HIST[lcore]->h[id] : NULL;
+        if (l == NULL)
+            continue;
+        for (uint32_t b = 0; b < HIST_BUCKETS; b++)
+        {
+            uint64_t n = *(const volatile uint64_t *)&l->buckets[b];
+            h->buckets[b] += n;
+            count += n;
+        }
+        h->sum += l->sum;
+        h->max = RTE_MAX(h->max, l->max);
+    }
+    return count;
+}
+
+uint64_t doca_ar_hist_bucket_max(uint32_t bucket)
+{
+    if (bucket < HIST_SUB)
+        return bucket;
+    uint32_t shift = bucket / HIST_SUB - 1;
+    return ((uint64_t)(HIST_SUB + bucket % HIST_SUB + 1) << shift) - 1;
+}
+
+uint64_t doca_ar_hist_quantile(const struct doca_ar_hist *h, uint64_t count, double q)
+{
+    uint64_t rank = (uint64_t)(q * count + 0.5), seen = 0;
+    if (count == 0)
+        return 0;
+    rank = RTE_MAX(rank, 1ULL);
+    for (uint32_t b = 0; b < HIST_BUCKETS; b++)
+    {
+        seen += h->buckets[b];
+        if (seen >= rank)
+            return RTE_MIN(doca_ar_hist_bucket_max(b), h->max);
+    }
+    return h->max;
+}
+
+const char *doca_ar_hist_name(enum DOCA_AR_HIST id)
+{
+    return id < HIST_MAX ? HIST_NAMES[id] : "unknown";
+}
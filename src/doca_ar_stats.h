@@ -0,0 +1,204 @@
+/**
+ * @file doca_ar_stats.h
+ * @author Mark Chen (markchen77888@gmail.com)
+ * @brief per-lcore counters of the datapath, written without atomics by their own lcore and read as consistent snapshots
+ * @version 1.0
+ * @date 2024-01-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef DOCA_AR_STATS_H_
+#define DOCA_AR_STATS_H_
+#include "doca_ar_env.h"
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+
+#define STATS_SLOTS (RTE_MAX_LCORE + 1) ///< a block per lcore, and a shared one for threads which are not lcores
+#define HIST_SUB_BITS 3                 ///< every power of two is split into 8 linear sub-buckets, i.e. values are kept within 12.5%
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 36                ///< values from 2^36 ns (68s) on share the last bucket
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
+/**
+ * @brief counters of one lcore
+ *
+ */
+struct doca_ar_stats
+{
+    uint64_t rx[NB_PORTS];   ///< packets received on every port
+    uint64_t tx[NB_PORTS];   ///< packets sent out of every port
+    uint64_t drop[NB_PORTS]; ///< packets to be sent out of every port but freed because the tx ring or the park queue of their conn was full
+    uint64_t newConns;       ///< conns added into the conntrack
+    uint64_t connFails;      ///< new conns the conntrack had no room for
+    uint64_t probeSent;      ///< probe packets sent
+    uint64_t probeRcvd;      ///< probe replies received, or probes reflected with --role reflector
+    uint64_t probeTimeout;   ///< probes and prober rounds which ended with replies missing
+    uint64_t pathSwitch;     ///< conns placed onto another path than their original one, or rerouted
+    uint64_t offloadOk;      ///< entries added into upstream_vxlanPipe
+    uint64_t offloadFail;    ///< entries the flow backend failed to add
+    uint64_t aged;           ///< conns aged by the flow backend or expired by the timer wheel
+};
+
+/**
+ * @brief counters of one lcore, the lcore copies cur into pub under seq once per loop so that readers never see half of an update
+ *
+ * cur and pub are on cache lines of their own, readers only touch pub and never slow down the lcore counting into cur.
+ */
+struct doca_ar_lcore_stats
+{
+    struct doca_ar_stats cur;                    ///< counted into by the lcore at any time
+    volatile uint32_t seq __rte_cache_aligned;   ///< sequence counter guarding pub, odd while pub is being written
+    struct doca_ar_stats pub;                    ///< cur as of the latest doca_ar_stats_publish
+} __rte_cache_aligned;
+
+/**
+ * @brief latencies kept in histograms
+ *
+ */
+enum DOCA_AR_HIST
+{
+    HIST_PROBE_RTT,                                 ///< RTT of probe replies, one histogram per slot of the probe (n-th probed port, not a path) up to HIST_SETUP
+    HIST_SETUP = HIST_PROBE_RTT + PROBE_PATH_AMOUNT, ///< first packet of a new conn to the decision of its path
+    HIST_OFFLOAD,                                   ///< entry of a conn queued to completed
+    HIST_AGING,                                     ///< duration of an aging round
+    HIST_MAX
+};
+
+/**
+ * @brief log-linear histogram of latencies[ns] like HdrHistogram: values below HIST_SUB are exact,
+ * above that every power of two has HIST_SUB buckets
+ *
+ */
+struct doca_ar_hist
+{
+    uint64_t buckets[HIST_BUCKETS];
+    uint64_t sum; ///< sum of the recorded values[ns]
+    uint64_t max; ///< largest recorded value[ns]
+};
+
+/**
+ * @brief histograms of one lcore, only written by the lcore
+ *
+ */
+struct doca_ar_lcore_hist
+{
+    struct doca_ar_hist h[HIST_MAX];
+} __rte_cache_aligned;
+
+extern struct doca_ar_lcore_stats LCORE_STATS[STATS_SLOTS];
+extern struct doca_ar_lcore_hist *LCORE_HIST[RTE_MAX_LCORE];
+
+/**
+ * @brief counters of the calling lcore
+ *
+ * @return struct doca_ar_stats*
+ */
+static inline struct doca_ar_stats *doca_ar_stats()
+{
+    unsigned int lcore = rte_lcore_id();
+    return &LCORE_STATS[lcore < RTE_MAX_LCORE ? lcore : RTE_MAX_LCORE].cur;
+}
+/**
+ * @brief tsc cycles to ns
+ *
+ * @param cycles
+ * @return uint64_t
+ */
+static inline uint64_t doca_ar_stats_ns(uint64_t cycles)
+{
+    uint64_t hz = rte_get_tsc_hz();
+    return cycles / hz * 1000000000 + cycles % hz * 1000000000 / hz;
+}
+/**
+ * @brief bucket of a value
+ *
+ * @param v
+ * @return uint32_t
+ */
+static inline uint32_t doca_ar_hist_bucket(uint64_t v)
+{
+    if (v < HIST_SUB)
+        return v;
+    int msb = 63 - __builtin_clzll(v);
+    if (msb >= HIST_MAX_BITS)
+        return HIST_BUCKETS - 1;
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB + ((v >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+/**
+ * @brief record a latency into a histogram of the calling lcore, nothing happens on threads which are not lcores
+ *
+ * @param id
+ * @param ns
+ */
+static inline void doca_ar_hist_record(enum DOCA_AR_HIST id, uint64_t ns)
+{
+    unsigned int lcore = rte_lcore_id();
+    if (unlikely(lcore >= RTE_MAX_LCORE || LCORE_HIST[lcore] == NULL))
+        return;
+    struct doca_ar_hist *h = &LCORE_HIST[lcore]->h[id];
+    h->buckets[doca_ar_hist_bucket(ns)]++;
+    h->sum += ns;
+    if (ns > h->max)
+        h->max = ns;
+}
+/**
+ * @brief allocate the histograms of every lcore
+ *
+ * @return int
+ */
+int doca_ar_stats_init();
+/**
+ * @brief make the counters of the calling lcore visible to snapshots, called once per loop of the lcore
+ *
+ */
+void doca_ar_stats_publish();
+/**
+ * @brief consistent copy of the counters of one lcore as of its latest doca_ar_stats_publish, never waits for the lcore
+ *
+ * @param slot lcore id, or RTE_MAX_LCORE for threads which are not lcores
+ * @param s
+ * @return int 1 if the lcore counted anything
+ */
+int doca_ar_stats_snapshot(unsigned int slot, struct doca_ar_stats *s);
+/**
+ * @brief sum of the snapshots of all the lcores
+ *
+ * @param total
+ */
+void doca_ar_stats_total(struct doca_ar_stats *total);
+/**
+ * @brief sum of a histogram over all the lcores, read without stopping them
+ *
+ * Every bucket is a counter of its own lcore, so the snapshot may miss values recorded meanwhile but never counts half of one.
+ *
+ * @param id
+ * @param h
+ * @return uint64_t amount of recorded values
+ */
+uint64_t doca_ar_hist_snapshot(enum DOCA_AR_HIST id, struct doca_ar_hist *h);
+/**
+ * @brief smallest value at or above the given share of the values of a histogram
+ *
+ * @param h
+ * @param count amount of values returned by doca_ar_hist_snapshot
+ * @param q quantile in [0, 1]
+ * @return uint64_t upper bound of the bucket holding the quantile[ns], 0 if the histogram is empty
+ */
+uint64_t doca_ar_hist_quantile(const struct doca_ar_hist *h, uint64_t count, double q);
+/**
+ * @brief upper bound of a bucket
+ *
+ * @param bucket
+ * @return uint64_t [ns]
+ */
+uint64_t doca_ar_hist_bucket_max(uint32_t bucket);
+/**
+ * @brief name of a histogram, e.g. probe_rtt_slot0
+ *
+ * @param id
+ * @return const char*
+ */
+const char *doca_ar_hist_name(enum DOCA_AR_HIST id);
+
+#endif /* DOCA_AR_STATS_H_ */
@@ -0,0 +1,147 @@
+/**
+ * @file doca_ar_wheel.c
+ * @author Mark Chen (markchen77888@gmail.com)
+ * @brief hierarchical timer wheel for conn lifetimes, one per worker, O(1) arm and cancel
+ * @version 1.0
+ * @date 2024-01-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include "doca_ar_wheel.h"
+#include <string.h>
+#include <rte_cycles.h>
+
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_RANGE (1ULL << (WHEEL_BITS * WHEEL_LEVELS)) ///< ticks covered by all the levels
+
+uint64_t doca_ar_wheel_tick()
+{
+    return rte_get_timer_cycles() / (rte_get_timer_hz() / WHEEL_TICK_HZ);
+}
+
+void doca_ar_wheel_init(struct doca_ar_wheel *w, uint64_t now)
+{
+    memset(w, 0, sizeof(*w));
+    w->now = now;
+    w->dueTail = &w->due;
+}
+
+static void wheel_link(struct doca_ar_wheel_node **head, struct doca_ar_wheel_node *node)
+{
+    node->next = *head;
+    if (*head)
+        (*head)->pprev = &node->next;
+    *head = node;
+    node->pprev = head;
+}
+
+/**
+ * @brief append an expired timer to the due list
+ *
+ * @param w
+ * @param node
+ */
+static void wheel_due(struct doca_ar_wheel *w, struct doca_ar_wheel_node *node)
+{
+    node->next = NULL;
+    node->pprev = w->dueTail;
+    *w->dueTail = node;
+    w->dueTail = &node->next;
+    node->due = 1;
+    w->nbDue++;
+}
+
+void doca_ar_wheel_del(struct doca_ar_wheel *w, struct doca_ar_wheel_node *node)
+{
+    if (node->pprev == NULL)
+        return;
+    if (node->due && w->dueTail == &node->next)
+        w->dueTail = node->pprev; // the last expired timer
+    *node->pprev = node->next;
+    if (node->next)
+        node->next->pprev = node->pprev;
+    node->next = NULL;
+    node->pprev = NULL;
+    if (node->due)
+        w->nbDue--;
+    else
+        w->nbArmed--;
+    node->due = 0;
+}
+
+void doca_ar_wheel_add(struct doca_ar_wheel *w, struct doca_ar_wheel_node *node, uint64_t expire)
+{
+    uint64_t diff, slotTick;
+    int lvl = 0;
+
+    doca_ar_wheel_del(w, node);
+    node->expire = expire;
+    if (expire <= w->now)
+    {
+        wheel_due(w, node);
+        return;
+    }
+    diff = expire - w->now;
+    // clamped timers cascade again until they really expire
+    slotTick = diff < WHEEL_RANGE ? expire : w->now + WHEEL_RANGE - 1;
+    diff = slotTick - w->now;
+    while (lvl < WHEEL_LEVELS - 1 && diff >= (1ULL << (WHEEL_BITS * (lvl + 1))))
+        lvl++;
+    wheel_link(&w->slots[lvl][(slotTick >> (WHEEL_BITS * lvl)) & WHEEL_MASK], node);
+    w->nbArmed++;
+}
+
+/**
+ * @brief re-add all timers of an upper level slot, they land on lower levels or the due list
+ *
+ * @param w
+ * @param lvl
+ * @param idx
+ */
+static void wheel_cascade(struct doca_ar_wheel *w, int lvl, int idx)
+{
+    struct doca_ar_wheel_node *node = w->slots[lvl][idx], *next;
+    w->slots[lvl][idx] = NULL;
+    for (; node != NULL; node = next)
+    {
+        next = node->next;
+        node->pprev = NULL;
+        w->nbArmed--;
+        doca_ar_wheel_add(w, node, node->expire);
+    }
+}
+
+int doca_ar_wheel_advance(struct doca_ar_wheel *w, uint64_t now)
+{
+    int ticks = 0;
+    while (w->now < now && ticks < WHEEL_MAX_TICKS)
+    {
+        struct doca_ar_wheel_node *node, *next;
+        w->now++;
+        ticks++;
+        for (int lvl = 1; lvl < WHEEL_LEVELS; lvl++)
+        {
+            if (w->now & ((1ULL << (WHEEL_BITS * lvl)) - 1))
+                break;
+            wheel_cascade(w, lvl, (w->now >> (WHEEL_BITS * lvl)) & WHEEL_MASK);
+        }
+        node = w->slots[0][w->now & WHEEL_MASK];
+        w->slots[0][w->now & WHEEL_MASK] = NULL;
+        for (; node != NULL; node = next)
+        {
+            next = node->next;
+            w->nbArmed--;
+            wheel_due(w, node);
+        }
+    }
+    return ticks;
+}
+
+struct doca_ar_wheel_node *doca_ar_wheel_pop(struct doca_ar_wheel *w)
+{
+    struct doca_ar_wheel_node *node = w->due;
+    if (node != NULL)
+        doca_ar_wheel_del(w, node);
+    return node;
+}
@@ -0,0 +1,94 @@
+/**
+ * @file doca_ar_wheel.h
+ * @author Mark Chen (markchen77888@gmail.com)
+ * @brief hierarchical timer wheel for conn lifetimes, one per worker, O(1) arm and cancel
+ * @version 1.0
+ * @date 2024-01-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef DOCA_AR_WHEEL_H_
+#define DOCA_AR_WHEEL_H_
+#include <stdint.h>
+#include <stddef.h>
+
+#define WHEEL_TICK_HZ 1000    ///< resolution of the wheel, 1 tick = 1ms
+#define WHEEL_BITS 6          ///< every level has 64 slots
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4        ///< 64^4 ticks, timers further away are clamped and rechecked on expiry
+#define WHEEL_MAX_TICKS 4096  ///< maximum ticks caught up by one doca_ar_wheel_advance, bounds the work after a stall
+
+/**
+ * @brief timer embedded in the object it times, not armed while pprev is NULL
+ *
+ */
+struct doca_ar_wheel_node
+{
+    struct doca_ar_wheel_node *next;
+    struct doca_ar_wheel_node **pprev;
+    uint64_t expire; ///< tick the timer expires at
+    uint8_t due;     ///< expired and waiting on the due list
+};
+
+/**
+ * @brief a timer wheel, only touched by the worker owning it
+ *
+ * Expired timers are appended to the due list when the wheel advances, and popped oldest first by the caller at its own budget,
+ * so a burst of expirations is spread over several aging rounds instead of one and no timer starves behind newer ones.
+ */
+struct doca_ar_wheel
+{
+    uint64_t now;                       ///< current tick
+    uint32_t nbArmed;                   ///< timers in the slots
+    uint32_t nbDue;                     ///< expired timers not popped yet, i.e. the aging backlog
+    struct doca_ar_wheel_node *due;       ///< expired timers, oldest first
+    struct doca_ar_wheel_node **dueTail;  ///< next pointer of the last expired timer, timers are appended here
+    struct doca_ar_wheel_node *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+};
+
+/**
+ * @brief current tick of the system
+ *
+ * @return uint64_t
+ */
+uint64_t doca_ar_wheel_tick();
+/**
+ * @brief init an empty wheel
+ *
+ * @param w
+ * @param now current tick
+ */
+void doca_ar_wheel_init(struct doca_ar_wheel *w, uint64_t now);
+/**
+ * @brief arm or re-arm a timer, a timer expiring at or before the current tick goes to the due list directly
+ *
+ * @param w
+ * @param node
+ * @param expire tick
+ */
+void doca_ar_wheel_add(struct doca_ar_wheel *w, struct doca_ar_wheel_node *node, uint64_t expire);
+/**
+ * @brief cancel a timer, nothing happens if it is not armed
+ *
+ * @param w
+ * @param node
+ */
+void doca_ar_wheel_del(struct doca_ar_wheel *w, struct doca_ar_wheel_node *node);
+/**
+ * @brief advance the wheel to now, cascading the upper levels and moving expired timers onto the due list
+ *
+ * @param w
+ * @param now current tick
+ * @return int amount of ticks advanced
+ */
+int doca_ar_wheel_advance(struct doca_ar_wheel *w, uint64_t now);
+/**
+ * @brief pop an expired timer from the due list
+ *
+ * @param w
+ * @return struct doca_ar_wheel_node* NULL if nothing expired
+ */
+struct doca_ar_wheel_node *doca_ar_wheel_pop(struct doca_ar_wheel *w);
+
+#endif /* DOCA_AR_WHEEL_H_ */
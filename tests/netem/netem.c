@@ -0,0 +1,779 @@
+/**
+ * @file netem.c
+ * @author Mark Chen (markchen77888@gmail.com)
+ * @brief multipath network emulator: reflects probes like the receiver DPU and measures the MaxFCT of generated flows
+ * @version 1.0
+ * @date 2024-01-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <getopt.h>
+#include <rte_eal.h>
+#include <rte_ethdev.h>
+#include <rte_cycles.h>
+#include <rte_malloc.h>
+#include <rte_random.h>
+#include <rte_hash_crc.h>
+#include <rte_mbuf_dyn.h>
+#include "netem.h"
+
+#define RTE_LOGTYPE_NETEM RTE_LOGTYPE_USER1
+#define NETEM_POOL_SIZE 65535
+#define NETEM_RING_SIZE 1024
+#define NETEM_TX_BUF 512
+#define NETEM_HDR_LEN (2 * (sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_udp_hdr)) + sizeof(struct rte_vxlan_hdr))
+
+static volatile bool force_quit;
+static struct netem_config CFG = {
+    .hostPort = 0,
+    .netPort = 1,
+    .nbQueues = 1,
+    .nbPaths = 4,
+    .hash = NETEM_HASH_CRC,
+    .seed = 0,
+    .bufferUs = 1000,
+    .nbFlows = 10,
+    .flowKB = 5 * 1024,
+    .pktLen = 1400,
+    .flowGbps = 10,
+    .rounds = 30,
+    .gapMs = 100,
+    .timeoutMs = 1000,
+};
+static struct netem_path PATHS[NETEM_MAX_PATHS];
+static struct netem_flow FLOWS[NETEM_MAX_FLOWS];
+static struct rte_mempool *POOL;
+static int DEPARTURE_OFFSET; ///< offset of the dynfield holding the departure tsc of a packet
+static uint64_t TSC_HZ;
+
+static struct rte_mbuf *TX_NET[NETEM_TX_BUF];
+static uint16_t NB_TX_NET;
+static double MAXFCT[1024]; ///< MaxFCT[ms] of every round
+static uint32_t LOST[1024]; ///< packets not delivered in every round
+
+static const struct rte_ether_addr HOST_MAC = {{0x02, 0, 0, 0, 0, 0x01}};
+static const struct rte_ether_addr PEER_MAC = {{0x02, 0, 0, 0, 0, 0x02}};
+static const uint32_t OUTER_SIP = RTE_IPV4(192, 168, 200, 2);
+static const uint32_t OUTER_DIP = RTE_IPV4(192, 168, 200, 1);
+static const uint32_t INNER_SIP = RTE_IPV4(192, 168, 233, 2);
+static const uint32_t INNER_DIP = RTE_IPV4(192, 168, 233, 1);
+
+static void signal_handler(int signum)
+{
+    if (signum == SIGINT || signum == SIGTERM)
+    {
+        printf("\n\nSignal %d received, preparing to exit...\n", signum);
+        force_quit = true;
+    }
+}
+
+static inline uint64_t *departure(struct rte_mbuf *m)
+{
+    return RTE_MBUF_DYNFIELD(m, DEPARTURE_OFFSET, uint64_t *);
+}
+
+static inline uint64_t us_to_tsc(double us)
+{
+    return (uint64_t)(us * TSC_HZ / 1E6);
+}
+
+/**
+ * @brief serialization time of a packet on a link
+ *
+ * @param len bytes
+ * @param gbps available bandwidth
+ * @return uint64_t tsc
+ */
+static inline uint64_t tx_time(uint32_t len, double gbps)
+{
+    return (uint64_t)(len * 8 * TSC_HZ / (gbps * 1E9));
+}
+
+/**
+ * @brief pick the path of a packet by its outer 4-tuple
+ *
+ * @param ip outer ipv4 header
+ * @param udp outer udp header
+ * @return int
+ */
+static int path_of(const struct rte_ipv4_hdr *ip, const struct rte_udp_hdr *udp)
+{
+    uint32_t h;
+    switch (CFG.hash)
+    {
+    case NETEM_HASH_XOR:
+        h = ip->src_addr ^ ip->dst_addr ^ udp->src_port ^ ((uint32_t)udp->dst_port << 16) ^ CFG.seed;
+        h ^= h >> 16;
+        h ^= h >> 8;
+        break;
+    case NETEM_HASH_SPORT:
+        h = rte_be_to_cpu_16(udp->src_port) + CFG.seed;
+        break;
+    default:
+        h = rte_hash_crc_4byte(ip->src_addr, CFG.seed);
+        h = rte_hash_crc_4byte(ip->dst_addr, h);
+        h = rte_hash_crc_4byte(((uint32_t)udp->src_port << 16) | udp->dst_port, h);
+    }
+    return h % CFG.nbPaths;
+}
+
+/**
+ * @brief put a packet on one direction of a path, the packet is consumed
+ *
+ * The background load keeps a standing queue of loadPct% of the buffer ahead of every packet, like an elephant tcp flow filling
+ * the bottleneck, and takes loadPct% of the bandwidth, so probes on a loaded path see the queueing delay and drops a busy switch would cause.
+ *
+ * @param link
+ * @param cfg
+ * @param m
+ * @param now
+ * @param fwd whether the background load of the path applies
+ */
+static void link_enqueue(struct netem_link *link, const struct netem_path_cfg *cfg, struct rte_mbuf *m, uint64_t now, bool fwd)
+{
+    double gbps = cfg->gbps * (fwd ? (100 - cfg->loadPct) / 100 : 1);
+    uint64_t standing = fwd ? us_to_tsc(CFG.bufferUs * cfg->loadPct / 100) : 0; ///< queue of the background load
+    uint64_t start = RTE_MAX(now, link->nextFree);
+
+    if (cfg->lossPct > 0 && rte_rand() % 1000000 < cfg->lossPct * 10000)
+    {
+        link->lost++;
+        rte_pktmbuf_free(m);
+        return;
+    }
+    if (start - now + standing > us_to_tsc(CFG.bufferUs) || link->tail - link->head == NETEM_LINK_SLOTS)
+    {
+        link->drops++;
+        rte_pktmbuf_free(m);
+        return;
+    }
+    link->nextFree = start + tx_time(m->pkt_len, gbps);
+    *departure(m) = link->nextFree + standing + us_to_tsc(cfg->delayUs);
+    link->slots[link->tail++ % NETEM_LINK_SLOTS] = m;
+}
+
+/**
+ * @brief take the next packet whose departure time has come
+ *
+ * @param link
+ * @param now
+ * @return struct rte_mbuf* NULL if none
+ */
+static struct rte_mbuf *link_dequeue(struct netem_link *link, uint64_t now)
+{
+    struct rte_mbuf *m;
+    if (link->head == link->tail)
+        return NULL;
+    m = link->slots[link->head % NETEM_LINK_SLOTS];
+    if (*departure(m) > now)
+        return NULL;
+    link->head++;
+    link->pkts++;
+    return m;
+}
+
+static void tx_net(struct rte_mbuf *m)
+{
+    if (NB_TX_NET == NETEM_TX_BUF)
+    {
+        rte_pktmbuf_free(m);
+        return;
+    }
+    TX_NET[NB_TX_NET++] = m;
+}
+
+static void tx_flush(uint16_t port, struct rte_mbuf **pkts, uint16_t *nb)
+{
+    uint16_t sent = 0;
+    while (sent < *nb)
+    {
+        uint16_t n = rte_eth_tx_burst(port, 0, pkts + sent, *nb - sent);
+        if (n == 0)
+            break;
+        sent += n;
+    }
+    if (sent < *nb)
+        rte_pktmbuf_free_bulk(pkts + sent, *nb - sent);
+    *nb = 0;
+}
+
+/**
+ * @brief a packet reached the receiver end of a path: reflect probes like the OvS rule of the receiver DPU, account generated packets
+ *
+ * @param pathId
+ * @param m
+ * @param round current round
+ * @param now
+ */
+static void deliver_fwd(int pathId, struct rte_mbuf *m, uint32_t round, uint64_t now)
+{
+    struct netem_path *path = &PATHS[pathId];
+    struct rte_ether_hdr *eth = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+    struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(eth + 1);
+    struct rte_udp_hdr *udp = (struct rte_udp_hdr *)(ip + 1);
+    struct netem_payload *pay;
+    struct netem_flow *flow;
+
+    if (ip->type_of_service == NETEM_PROBE_TOS && udp->dst_port == rte_cpu_to_be_16(NETEM_VXLAN_PORT))
+    {
+        udp->dst_port = rte_cpu_to_be_16(NETEM_PROBE_REPLY_PORT);
+        rte_ether_addr_copy(&eth->s_addr, &eth->d_addr);
+        rte_ether_addr_copy(&PEER_MAC, &eth->s_addr);
+        path->probes++;
+        link_enqueue(&path->rev, &path->cfg, m, now, false);
+        return;
+    }
+    if (m->pkt_len >= NETEM_HDR_LEN + sizeof(struct netem_payload))
+    {
+        pay = rte_pktmbuf_mtod_offset(m, struct netem_payload *, NETEM_HDR_LEN);
+        if (pay->magic == NETEM_PAYLOAD_MAGIC && pay->round == round && pay->flowId < CFG.nbFlows)
+        {
+            flow = &FLOWS[pay->flowId];
+            flow->rcvd++;
+            flow->lastRx = now;
+            flow->lastPath = pathId;
+            path->dataPkts++;
+        }
+    }
+    rte_pktmbuf_free(m);
+}
+
+/**
+ * @brief packets from the network port of DOCA-AR enter the path picked by their outer 4-tuple
+ *
+ * @param now
+ */
+static void rx_net(uint64_t now)
+{
+    struct rte_mbuf *pkts[NETEM_BURST];
+    uint16_t q, i, nb;
+    for (q = 0; q < CFG.nbQueues; q++)
+    {
+        nb = rte_eth_rx_burst(CFG.netPort, q, pkts, NETEM_BURST);
+        for (i = 0; i < nb; i++)
+        {
+            struct rte_ether_hdr *eth = rte_pktmbuf_mtod(pkts[i], struct rte_ether_hdr *);
+            struct rte_ipv4_hdr *ip = (struct rte_ipv4_hdr *)(eth + 1);
+            int p;
+            if (eth->ether_type != rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4) || ip->next_proto_id != IPPROTO_UDP)
+            {
+                rte_pktmbuf_free(pkts[i]);
+                continue;
+            }
+            p = path_of(ip, (struct rte_udp_hdr *)(ip + 1));
+            link_enqueue(&PATHS[p].fwd, &PATHS[p].cfg, pkts[i], now, true);
+        }
+    }
+}
+
+/**
+ * @brief packets hairpinned to the host port by DOCA-AR are not part of the measurement
+ *
+ */
+static void rx_host(void)
+{
+    struct rte_mbuf *pkts[NETEM_BURST];
+    uint16_t q, nb;
+    for (q = 0; q < CFG.nbQueues; q++)
+    {
+        nb = rte_eth_rx_burst(CFG.hostPort, q, pkts, NETEM_BURST);
+        if (nb)
+            rte_pktmbuf_free_bulk(pkts, nb);
+    }
+}
+
+/**
+ * @brief build a vxlan packet of a generated flow, the outer sport is the entropy of the inner 5-tuple like the sender VTEP
+ *
+ * @param flowId
+ * @param round
+ * @param now
+ * @return struct rte_mbuf*
+ */
+static struct rte_mbuf *build_pkt(uint32_t flowId, uint32_t round, uint64_t now)
+{
+    struct netem_flow *flow = &FLOWS[flowId];
+    struct rte_mbuf *m = rte_pktmbuf_alloc(POOL);
+    struct rte_ether_hdr *eth;
+    struct rte_ipv4_hdr *ip;
+    struct rte_udp_hdr *udp;
+    struct rte_vxlan_hdr *vxlan;
+    struct netem_payload *pay;
+    uint16_t innerLen = sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_udp_hdr) + CFG.pktLen;
+    uint16_t outerLen = sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_udp_hdr) + sizeof(struct rte_vxlan_hdr) + sizeof(struct rte_ether_hdr) + innerLen;
+    if (m == NULL)
+        return NULL;
+    eth = (struct rte_ether_hdr *)rte_pktmbuf_append(m, sizeof(struct rte_ether_hdr) + outerLen);
+    if (eth == NULL)
+    {
+        rte_pktmbuf_free(m);
+        return NULL;
+    }
+    memset(eth, 0, sizeof(struct rte_ether_hdr) + outerLen);
+    /* outer */
+    rte_ether_addr_copy(&PEER_MAC, &eth->d_addr);
+    rte_ether_addr_copy(&HOST_MAC, &eth->s_addr);
+    eth->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4);
+    ip = (struct rte_ipv4_hdr *)(eth + 1);
+    ip->version_ihl = RTE_IPV4_VHL_DEF;
+    ip->time_to_live = 64;
+    ip->next_proto_id = IPPROTO_UDP;
+    ip->total_length = rte_cpu_to_be_16(outerLen);
+    ip->src_addr = rte_cpu_to_be_32(OUTER_SIP);
+    ip->dst_addr = rte_cpu_to_be_32(OUTER_DIP);
+    ip->hdr_checksum = rte_ipv4_cksum(ip);
+    udp = (struct rte_udp_hdr *)(ip + 1);
+    udp->src_port = rte_cpu_to_be_16(flow->outerSport);
+    udp->dst_port = rte_cpu_to_be_16(NETEM_VXLAN_PORT);
+    udp->dgram_len = rte_cpu_to_be_16(outerLen - sizeof(struct rte_ipv4_hdr));
+    vxlan = (struct rte_vxlan_hdr *)(udp + 1);
+    vxlan->vx_flags = rte_cpu_to_be_32(0x08000000);
+    vxlan->vx_vni = rte_cpu_to_be_32(1 << 8);
+    /* inner */
+    eth = (struct rte_ether_hdr *)(vxlan + 1);
+    rte_ether_addr_copy(&PEER_MAC, &eth->d_addr);
+    rte_ether_addr_copy(&HOST_MAC, &eth->s_addr);
+    eth->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4);
+    ip = (struct rte_ipv4_hdr *)(eth + 1);
+    ip->version_ihl = RTE_IPV4_VHL_DEF;
+    ip->time_to_live = 64;
+    ip->next_proto_id = IPPROTO_UDP;
+    ip->total_length = rte_cpu_to_be_16(innerLen);
+    ip->src_addr = rte_cpu_to_be_32(INNER_SIP);
+    ip->dst_addr = rte_cpu_to_be_32(INNER_DIP);
+    ip->hdr_checksum = rte_ipv4_cksum(ip);
+    udp = (struct rte_udp_hdr *)(ip + 1);
+    udp->src_port = rte_cpu_to_be_16(flow->innerSport);
+    udp->dst_port = rte_cpu_to_be_16(5001);
+    udp->dgram_len = rte_cpu_to_be_16(innerLen - sizeof(struct rte_ipv4_hdr));
+    pay = (struct netem_payload *)(udp + 1);
+    pay->magic = NETEM_PAYLOAD_MAGIC;
+    pay->round = round;
+    pay->flowId = flowId;
+    pay->seq = flow->sent;
+    pay->txTsc = now;
+    return m;
+}
+
+/**
+ * @brief reset flows for a new round, every round uses new inner sports so that DOCA-AR sees new conns
+ *
+ * @param round
+ * @param now
+ */
+static void round_start(uint32_t round, uint64_t now)
+{
+    uint32_t i, total = (CFG.flowKB * 1024 + CFG.pktLen - 1) / CFG.pktLen;
+    for (i = 0; i < CFG.nbFlows; i++)
+    {
+        struct netem_flow *flow = &FLOWS[i];
+        uint32_t tuple[3];
+        memset(flow, 0, sizeof(*flow));
+        flow->innerSport = 10000 + (round * CFG.nbFlows + i) % 50000;
+        tuple[0] = INNER_SIP;
+        tuple[1] = INNER_DIP;
+        tuple[2] = ((uint32_t)flow->innerSport << 16) | 5001;
+        flow->outerSport = 49152 + (rte_hash_crc(tuple, sizeof(tuple), 0) & 0x3fff);
+        flow->total = total;
+        flow->start = now;
+        flow->nextTx = now;
+    }
+}
+
+/**
+ * @brief send the packets of every flow at its pace
+ *
+ * @param round
+ * @param now
+ * @return uint64_t tsc of the latest packet sent, 0 if all flows are sent
+ */
+static uint64_t generate(uint32_t round, uint64_t now)
+{
+    struct rte_mbuf *pkts[NETEM_BURST];
+    uint64_t gap = tx_time(CFG.pktLen + NETEM_HDR_LEN, CFG.flowGbps);
+    uint16_t nb = 0;
+    uint32_t i, busy = 0;
+    for (i = 0; i < CFG.nbFlows; i++)
+    {
+        struct netem_flow *flow = &FLOWS[i];
+        if (flow->sent == flow->total)
+            continue;
+        busy++;
+        if (flow->nextTx > now || nb == NETEM_BURST)
+            continue;
+        pkts[nb] = build_pkt(i, round, now);
+        if (pkts[nb] == NULL)
+            break;
+        nb++;
+        flow->sent++;
+        flow->nextTx += gap;
+    }
+    tx_flush(CFG.hostPort, pkts, &nb);
+    return busy ? now : 0;
+}
+
+/**
+ * @brief check whether every flow of the round is completed
+ *
+ * @param lastTx tsc of the latest packet sent
+ * @param now
+ * @return bool
+ */
+static bool round_done(uint64_t lastTx, uint64_t now)
+{
+    uint32_t i;
+    for (i = 0; i < CFG.nbFlows; i++)
+        if (FLOWS[i].rcvd < FLOWS[i].total)
+            return lastTx != 0 && now - lastTx > us_to_tsc(CFG.timeoutMs * 1000.0);
+    return true;
+}
+
+/**
+ * @brief MaxFCT of the round, the completion time of the slowest flow
+ *
+ * @param round
+ */
+static void round_report(uint32_t round)
+{
+    double maxFct = 0;
+    uint32_t i, lost = 0;
+    for (i = 0; i < CFG.nbFlows; i++)
+    {
+        struct netem_flow *flow = &FLOWS[i];
+        double fct = flow->lastRx > flow->start ? (flow->lastRx - flow->start) * 1E3 / TSC_HZ : 0;
+        maxFct = RTE_MAX(maxFct, fct);
+        lost += flow->total - RTE_MIN(flow->rcvd, flow->total);
+    }
+    MAXFCT[round] = maxFct;
+    LOST[round] = lost;
+    printf("Round %u: MaxFCT %.3f ms, lost %u pkts\n", round, maxFct, lost);
+}
+
+static void print_summary(uint32_t rounds)
+{
+    double mn = 0, mx = 0, sum = 0;
+    uint32_t i, lost = 0;
+    int p;
+    for (i = 0; i < rounds; i++)
+    {
+        mn = i == 0 ? MAXFCT[i] : RTE_MIN(mn, MAXFCT[i]);
+        mx = RTE_MAX(mx, MAXFCT[i]);
+        sum += MAXFCT[i];
+        lost += LOST[i];
+    }
+    printf("\n-------------------------Paths----------------------------\n");
+    for (p = 0; p < CFG.nbPaths; p++)
+    {
+        struct netem_path *path = &PATHS[p];
+        printf("Path %d: delay %uus bw %.1fGbps load %.0f%% loss %.2f%% | data %lu probes %lu | drops %lu/%lu lost %lu/%lu\n",
+               p, path->cfg.delayUs, path->cfg.gbps, path->cfg.loadPct, path->cfg.lossPct, path->dataPkts, path->probes,
+               path->fwd.drops, path->rev.drops, path->fwd.lost, path->rev.lost);
+    }
+    if (rounds == 0)
+        return;
+    printf("-------------------------MaxFCT---------------------------\n");
+    printf("Flows %u x %uKB, %u rounds, lost %u pkts\n", CFG.nbFlows, CFG.flowKB, rounds, lost);
+    printf("(min[ms],max[ms],avg[ms]) ( %.3f %.3f %.3f )\n", mn, mx, sum / rounds);
+}
+
+static void netem_run(void)
+{
+    uint64_t now = rte_rdtsc(), lastTx = 0, roundAt = now;
+    uint32_t round = 0;
+    bool active = false;
+    int p;
+
+    while (!force_quit && round < CFG.rounds)
+    {
+        now = rte_rdtsc();
+        if (!active && now >= roundAt)
+        {
+            round_start(round, now);
+            active = true;
+        }
+        if (active)
+            lastTx = generate(round, now) ?: lastTx;
+        rx_net(now);
+        rx_host();
+        for (p = 0; p < CFG.nbPaths; p++)
+        {
+            struct rte_mbuf *m;
+            while ((m = link_dequeue(&PATHS[p].fwd, now)) != NULL)
+                deliver_fwd(p, m, round, now);
+            while ((m = link_dequeue(&PATHS[p].rev, now)) != NULL)
+                tx_net(m);
+        }
+        tx_flush(CFG.netPort, TX_NET, &NB_TX_NET);
+        if (active && round_done(lastTx, now))
+        {
+            round_report(round++);
+            active = false;
+            lastTx = 0;
+            roundAt = now + us_to_tsc(CFG.gapMs * 1000.0);
+        }
+    }
+    print_summary(round);
+}
+
+/**
+ * @brief parse a comma separated list of per-path values, a single value applies to every path
+ *
+ * @param arg
+ * @param field offset of the value in struct netem_path_cfg
+ * @param isDouble
+ * @return int
+ */
+static int parse_list(const char *arg, size_t field, bool isDouble)
+{
+    char *dup = strdup(arg), *save = NULL, *tok;
+    double last = 0;
+    int p = 0;
+    for (tok = strtok_r(dup, ",", &save); tok != NULL && p < NETEM_MAX_PATHS; tok = strtok_r(NULL, ",", &save), p++)
+    {
+        last = atof(tok);
+        if (isDouble)
+            *(double *)((char *)&CFG.paths[p] + field) = last;
+        else
+            *(uint32_t *)((char *)&CFG.paths[p] + field) = (uint32_t)last;
+    }
+    free(dup);
+    if (p == 0)
+        return -1;
+    for (; p < NETEM_MAX_PATHS; p++)
+    {
+        if (isDouble)
+            *(double *)((char *)&CFG.paths[p] + field) = last;
+        else
+            *(uint32_t *)((char *)&CFG.paths[p] + field) = (uint32_t)last;
+    }
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [EAL options] -- [options]\n"
+           "  --host-port N     port connected with the host port of DOCA-AR (default 0)\n"
+           "  --net-port N      port connected with the network port of DOCA-AR (default 1)\n"
+           "  --queues N        rx/tx queues of both ports (default 1)\n"
+           "  --paths K         emulated paths (default 4, max %d)\n"
+           "  --hash H          crc|xor|sport, hash of the outer 4-tuple picking the path (default crc)\n"
+           "  --seed S          init value of the hash (default 0)\n"
+           "  --delay LIST      one-way delay of every path[us] (default 10)\n"
+           "  --bw LIST         bandwidth of every path[Gbps] (default 25)\n"
+           "  --loss LIST       random loss of every path[%%] (default 0)\n"
+           "  --load LIST       background load of every path[%%] (default 0)\n"
+           "  --elephant P:L    congestion profile, an elephant flow takes L%% of path P and keeps L%% of its buffer queued (default load 80)\n"
+           "  --buffer US       maximum queueing delay of a path[us] (default 1000)\n"
+           "  --flows N         parallel flows of a round (default 10)\n"
+           "  --size KB         message size of a flow[KB] (default 5120)\n"
+           "  --pkt-len B       inner udp payload[B] (default 1400)\n"
+           "  --rate G          sending rate of a flow[Gbps] (default 10)\n"
+           "  --rounds R        test times (default 30)\n"
+           "  --gap MS          idle time between rounds[ms] (default 100)\n"
+           "  --timeout MS      end a round this long after its last packet (default 1000)\n",
+           prog, NETEM_MAX_PATHS);
+}
+
+static int parse_args(int argc, char **argv)
+{
+    static const struct option opts[] = {
+        {"host-port", required_argument, NULL, 'H'},
+        {"net-port", required_argument, NULL, 'N'},
+        {"queues", required_argument, NULL, 'q'},
+        {"paths", required_argument, NULL, 'k'},
+        {"hash", required_argument, NULL, 'h'},
+        {"seed", required_argument, NULL, 's'},
+        {"delay", required_argument, NULL, 'd'},
+        {"bw", required_argument, NULL, 'b'},
+        {"loss", required_argument, NULL, 'l'},
+        {"load", required_argument, NULL, 'L'},
+        {"elephant", required_argument, NULL, 'e'},
+        {"buffer", required_argument, NULL, 'B'},
+        {"flows", required_argument, NULL, 'f'},
+        {"size", required_argument, NULL, 'S'},
+        {"pkt-len", required_argument, NULL, 'p'},
+        {"rate", required_argument, NULL, 'r'},
+        {"rounds", required_argument, NULL, 'R'},
+        {"gap", required_argument, NULL, 'g'},
+        {"timeout", required_argument, NULL, 't'},
+        {"help", no_argument, NULL, '?'},
+        {NULL, 0, NULL, 0}};
+    int opt, p, ret = 0;
+    char *sep;
+
+    for (p = 0; p < NETEM_MAX_PATHS; p++)
+        CFG.paths[p] = (struct netem_path_cfg){.delayUs = 10, .gbps = 25, .lossPct = 0, .loadPct = 0};
+    while ((opt = getopt_long(argc, argv, "", opts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'H':
+            CFG.hostPort = atoi(optarg);
+            break;
+        case 'N':
+            CFG.netPort = atoi(optarg);
+            break;
+        case 'q':
+            CFG.nbQueues = atoi(optarg);
+            break;
+        case 'k':
+            CFG.nbPaths = atoi(optarg);
+            break;
+        case 'h':
+            if (strcmp(optarg, "crc") == 0)
+                CFG.hash = NETEM_HASH_CRC;
+            else if (strcmp(optarg, "xor") == 0)
+                CFG.hash = NETEM_HASH_XOR;
+            else if (strcmp(optarg, "sport") == 0)
+                CFG.hash = NETEM_HASH_SPORT;
+            else
+                ret = -1;
+            break;
+        case 's':
+            CFG.seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            ret |= parse_list(optarg, offsetof(struct netem_path_cfg, delayUs), false);
+            break;
+        case 'b':
+            ret |= parse_list(optarg, offsetof(struct netem_path_cfg, gbps), true);
+            break;
+        case 'l':
+            ret |= parse_list(optarg, offsetof(struct netem_path_cfg, lossPct), true);
+            break;
+        case 'L':
+            ret |= parse_list(optarg, offsetof(struct netem_path_cfg, loadPct), true);
+            break;
+        case 'e':
+            p = atoi(optarg);
+            sep = strchr(optarg, ':');
+            if (p < 0 || p >= NETEM_MAX_PATHS)
+                ret = -1;
+            else
+                CFG.paths[p].loadPct = sep ? atof(sep + 1) : 80;
+            break;
+        case 'B':
+            CFG.bufferUs = atoi(optarg);
+            break;
+        case 'f':
+            CFG.nbFlows = atoi(optarg);
+            break;
+        case 'S':
+            CFG.flowKB = atoi(optarg);
+            break;
+        case 'p':
+            CFG.pktLen = atoi(optarg);
+            break;
+        case 'r':
+            CFG.flowGbps = atof(optarg);
+            break;
+        case 'R':
+            CFG.rounds = atoi(optarg);
+            break;
+        case 'g':
+            CFG.gapMs = atoi(optarg);
+            break;
+        case 't':
+            CFG.timeoutMs = atoi(optarg);
+            break;
+        default:
+            ret = -1;
+        }
+    }
+    if (CFG.nbPaths < 1 || CFG.nbPaths > NETEM_MAX_PATHS || CFG.nbFlows < 1 || CFG.nbFlows > NETEM_MAX_FLOWS ||
+        CFG.rounds > RTE_DIM(MAXFCT) || CFG.nbQueues < 1 || CFG.flowGbps <= 0 || CFG.flowKB == 0 ||
+        CFG.pktLen < sizeof(struct netem_payload) || CFG.pktLen + NETEM_HDR_LEN > RTE_MBUF_DEFAULT_DATAROOM)
+        ret = -1;
+    for (p = 0; p < CFG.nbPaths; p++)
+        if (CFG.paths[p].gbps <= 0 || CFG.paths[p].loadPct < 0 || CFG.paths[p].loadPct >= 100)
+            ret = -1;
+    if (ret)
+        usage(argv[0]);
+    return ret;
+}
+
+static int port_init(uint16_t port)
+{
+    struct rte_eth_conf conf = {0};
+    uint16_t q;
+    int ret;
+
+    ret = rte_eth_dev_configure(port, CFG.nbQueues, CFG.nbQueues, &conf);
+    if (ret < 0)
+        return ret;
+    for (q = 0; q < CFG.nbQueues; q++)
+    {
+        ret = rte_eth_rx_queue_setup(port, q, NETEM_RING_SIZE, rte_eth_dev_socket_id(port), NULL, POOL);
+        if (ret < 0)
+            return ret;
+        ret = rte_eth_tx_queue_setup(port, q, NETEM_RING_SIZE, rte_eth_dev_socket_id(port), NULL);
+        if (ret < 0)
+            return ret;
+    }
+    ret = rte_eth_dev_start(port);
+    if (ret < 0)
+        return ret;
+    rte_eth_promiscuous_enable(port);
+    return 0;
+}
+
+static int paths_init(void)
+{
+    int p;
+    for (p = 0; p < CFG.nbPaths; p++)
+    {
+        PATHS[p].cfg = CFG.paths[p];
+        PATHS[p].fwd.slots = rte_zmalloc("NETEM_FWD", NETEM_LINK_SLOTS * sizeof(struct rte_mbuf *), 0);
+        PATHS[p].rev.slots = rte_zmalloc("NETEM_REV", NETEM_LINK_SLOTS * sizeof(struct rte_mbuf *), 0);
+        if (PATHS[p].fwd.slots == NULL || PATHS[p].rev.slots == NULL)
+            return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct rte_mbuf_dynfield desc = {
+        .name = "netem_departure",
+        .size = sizeof(uint64_t),
+        .align = __alignof__(uint64_t),
+    };
+    int ret = rte_eal_init(argc, argv);
+    if (ret < 0)
+        rte_exit(EXIT_FAILURE, "Failed to init EAL\n");
+    argc -= ret;
+    argv += ret;
+    if (parse_args(argc, argv) < 0)
+        rte_exit(EXIT_FAILURE, "Invalid arguments\n");
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+    TSC_HZ = rte_get_tsc_hz();
+
+    DEPARTURE_OFFSET = rte_mbuf_dynfield_register(&desc);
+    if (DEPARTURE_OFFSET < 0)
+        rte_exit(EXIT_FAILURE, "Failed to register mbuf dynfield\n");
+    POOL = rte_pktmbuf_pool_create("NETEM_POOL", NETEM_POOL_SIZE, 256, 0, RTE_MBUF_DEFAULT_BUF_SIZE, rte_socket_id());
+    if (POOL == NULL)
+        rte_exit(EXIT_FAILURE, "Failed to create mbuf pool\n");
+    if (!rte_eth_dev_is_valid_port(CFG.hostPort) || !rte_eth_dev_is_valid_port(CFG.netPort) || CFG.hostPort == CFG.netPort)
+        rte_exit(EXIT_FAILURE, "Invalid ports %u and %u\n", CFG.hostPort, CFG.netPort);
+    if (port_init(CFG.hostPort) < 0 || port_init(CFG.netPort) < 0)
+        rte_exit(EXIT_FAILURE, "Failed to init ports\n");
+    if (paths_init() < 0)
+        rte_exit(EXIT_FAILURE, "Failed to init paths\n");
+
+    RTE_LOG(INFO, NETEM, "%d paths, %u flows x %uKB, %u rounds\n", CFG.nbPaths, CFG.nbFlows, CFG.flowKB, CFG.rounds);
+    netem_run();
+
+    rte_eth_dev_stop(CFG.hostPort);
+    rte_eth_dev_stop(CFG.netPort);
+    rte_eth_dev_close(CFG.hostPort);
+    rte_eth_dev_close(CFG.netPort);
+    rte_eal_cleanup();
+    return 0;
+}
@@ -0,0 +1,133 @@
+/**
+ * @file netem.h
+ * @author Mark Chen (markchen77888@gmail.com)
+ * @brief multipath network emulator for benchmarking DOCA-AR on one host: K paths picked by hashing the outer 4-tuple, per-path delay, bandwidth, queueing and loss
+ * @version 1.0
+ * @date 2024-01-07
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+#ifndef NETEM_H_
+#define NETEM_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include <rte_mbuf.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_udp.h>
+
+#define NETEM_MAX_PATHS 16        ///< maximum emulated paths
+#define NETEM_MAX_FLOWS 1024      ///< maximum flows of one round
+#define NETEM_LINK_SLOTS 16384    ///< packets in flight on one direction of a path
+#define NETEM_BURST 32            ///< num of rx_burst and tx_burst
+#define NETEM_PAYLOAD_MAGIC 0x4e45544d ///< "NETM", marks packets generated by the emulator
+#define NETEM_PROBE_TOS 0x20      ///< tos of probe packets, matched like the OvS rule of the receiver DPU
+#define NETEM_VXLAN_PORT 4789
+#define NETEM_PROBE_REPLY_PORT 4788
+
+/**
+ * @brief hash mapping the outer 4-tuple onto a path, like the ECMP hash of the switches
+ *
+ */
+enum NETEM_HASH
+{
+    NETEM_HASH_CRC,  ///< crc32 of (sip,dip,sport,dport)
+    NETEM_HASH_XOR,  ///< xor fold of (sip,dip,sport,dport), cheap switch hash
+    NETEM_HASH_SPORT ///< sport modulo the paths, consecutive sports land on consecutive paths
+};
+
+/**
+ * @brief parameters of one path, both directions share them
+ *
+ */
+struct netem_path_cfg
+{
+    uint32_t delayUs; ///< one-way propagation delay[us]
+    double gbps;      ///< bottleneck bandwidth[Gbps]
+    double lossPct;   ///< random loss[%]
+    double loadPct;   ///< bandwidth and buffer taken by background traffic in the forward direction[%], e.g. an elephant flow
+};
+
+/**
+ * @brief parameters of the emulator
+ *
+ */
+struct netem_config
+{
+    uint16_t hostPort;  ///< connected with the host port of DOCA-AR, generated flows are sent here
+    uint16_t netPort;   ///< connected with the network port of DOCA-AR, emulated paths start here
+    uint16_t nbQueues;  ///< rx/tx queues of both ports
+    int nbPaths;
+    enum NETEM_HASH hash;
+    uint32_t seed;      ///< init value of the path hash
+    uint32_t bufferUs;  ///< maximum queueing delay of a path before tail drop[us]
+    struct netem_path_cfg paths[NETEM_MAX_PATHS];
+    uint32_t nbFlows;   ///< parallel flows of one round, like iperf -P
+    uint32_t flowKB;    ///< message size of every flow[KB], like iperf -n
+    uint32_t pktLen;    ///< inner udp payload of generated packets[B]
+    double flowGbps;    ///< sending rate of every flow[Gbps]
+    uint32_t rounds;    ///< test times
+    uint32_t gapMs;     ///< idle time between rounds[ms]
+    uint32_t timeoutMs; ///< a round ends this long after its last packet was sent even if packets are lost[ms]
+};
+
+/**
+ * @brief payload of generated packets, after the inner udp header
+ *
+ */
+struct netem_payload
+{
+    uint32_t magic;
+    uint32_t round;
+    uint32_t flowId;
+    uint32_t seq;
+    uint64_t txTsc;
+} __rte_packed;
+
+/**
+ * @brief one direction of a path: a FIFO of packets ordered by departure time
+ *
+ */
+struct netem_link
+{
+    struct rte_mbuf **slots;
+    uint32_t head;
+    uint32_t tail;
+    uint64_t nextFree; ///< tsc when the bottleneck is free to serialize the next packet
+    uint64_t pkts;     ///< packets delivered
+    uint64_t drops;    ///< packets dropped because the buffer is full
+    uint64_t lost;     ///< packets dropped randomly
+};
+
+/**
+ * @brief an emulated path
+ *
+ */
+struct netem_path
+{
+    struct netem_path_cfg cfg;
+    struct netem_link fwd;  ///< DOCA-AR ==> receiver
+    struct netem_link rev;  ///< receiver ==> DOCA-AR, carries reflected probes
+    uint64_t probes;        ///< probes reflected on this path
+    uint64_t dataPkts;      ///< generated packets delivered on this path
+};
+
+/**
+ * @brief state of a generated flow
+ *
+ */
+struct netem_flow
+{
+    uint16_t innerSport;
+    uint16_t outerSport; ///< entropy sport chosen by the sender VTEP from the inner 5-tuple
+    uint32_t total;      ///< packets of the message
+    uint32_t sent;
+    uint32_t rcvd;
+    uint64_t start;      ///< tsc of the first packet
+    uint64_t nextTx;     ///< tsc of the next packet
+    uint64_t lastRx;     ///< tsc of the latest packet delivered
+    uint16_t lastPath;   ///< path of the latest packet delivered
+};
+
+#endif /* NETEM_H_ */
@@ -0,0 +1,18 @@
+#!/bin/bash
+# Benchmark DOCA-AR against the multipath emulator on one host, both processes are connected by memif.
+# doca_ar: port0 faces the host (flow generator), port1 faces the network (emulated paths).
+HOST_SOCK=/tmp/doca_ar_host.sock
+NET_SOCK=/tmp/doca_ar_net.sock
+LB_SCHEME=${LB_SCHEME:-ar}
+
+./build/doca_ar --vdev=net_memif0,role=server,socket=$HOST_SOCK --vdev=net_memif1,role=server,socket=$NET_SOCK -l 1-3 \
+	-- --flow-backend sw --lb-scheme $LB_SCHEME &
+AR_PID=$!
+sleep 5
+
+# 4 paths, the elephant flow takes 80% of path 0, 10 flows x 5MB per round like tests/10flow
+./tests/netem/build/netem --vdev=net_memif0,role=client,socket=$HOST_SOCK --vdev=net_memif1,role=client,socket=$NET_SOCK -l 5 --file-prefix netem \
+	-- --queues 3 --paths 4 --delay 10 --bw 25 --elephant 0:80 --flows 10 --size 5120 --rounds 30 "$@"
+
+kill -INT $AR_PID
+wait $AR_PID